@@ -0,0 +1,1894 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "noise_gen.h"
+#include "noise_cpu.h"
+#include "noise_renderer.h"
+#include "shader_utils.h"
+#include "chunk_manager.h"
+#include "volume_cache.h"
+#include "camera.h"
+#include "thread_pool.h"
+#include "timer.h"
+#include "vector_math.h"
+
+#include <GLFW/glfw3.h>
+
+#define BenchSeed        1234
+#define BenchRepetitions 3
+
+/* Size of the level used by the renderer's benchmarks. */
+#define LevelWidth  DefaultLevelWidth
+#define LevelHeight DefaultLevelHeight
+#define LevelDepth  DefaultLevelDepth
+
+typedef struct bench_command {
+  const char *name;
+  const char *help;
+  int (*run)(int argc, char **argv, int has_gl);
+} bench_command;
+
+static int bench_noise(int argc, char **argv, int has_gl);
+static int bench_noise4d(int argc, char **argv, int has_gl);
+static int bench_variants(int argc, char **argv, int has_gl);
+static int bench_startup(int argc, char **argv, int has_gl);
+static int bench_readback(int argc, char **argv, int has_gl);
+static int bench_threads(int argc, char **argv, int has_gl);
+static int bench_workgroups(int argc, char **argv, int has_gl);
+static int bench_animate(int argc, char **argv, int has_gl);
+static int bench_mesher(int argc, char **argv, int has_gl);
+static int bench_mesh(int argc, char **argv, int has_gl);
+static int bench_occupancy(int argc, char **argv, int has_gl);
+static int bench_octaves(int argc, char **argv, int has_gl);
+static int bench_cells(int argc, char **argv, int has_gl);
+static int bench_render(int argc, char **argv, int has_gl);
+static int bench_chunks(int argc, char **argv, int has_gl);
+static int bench_cache(int argc, char **argv, int has_gl);
+
+static const bench_command commands[] = {
+  {"noise", "[size] [octaves]: CPU and GPU noise throughput", bench_noise},
+  {"noise4d", "[sizes...]: time per slice of 4D Perlin and simplex noise",
+   bench_noise4d},
+  {"variants", "[size]: time to switch between octave counts and generators",
+   bench_variants},
+  {"startup", ": time to create every program, compiled and loaded from the "
+   "cache", bench_startup},
+  {"readback", "[sizes...]: time and size of a perlin4d slice in each output "
+   "format", bench_readback},
+  {"threads", "[sizes...]: CPU noise scaling with the thread count",
+   bench_threads},
+  {"workgroups", ": retunes the compute shaders' workgroup sizes",
+   bench_workgroups},
+  {"animate", "[frames] [depth]: frame times of synchronous and pipelined "
+   "perlin4d slices", bench_animate},
+  {"mesher", "[slices]: checks the GPU mesher against the CPU one",
+   bench_mesher},
+  {"mesh", "[sizes...]: triangle counts and meshing time of each mesher",
+   bench_mesh},
+  {"occupancy", "[sizes...]: size of occupancy volumes and time to build and "
+   "cull them", bench_occupancy},
+  {"octaves", "[size] [cell]: occupancy masks with every octave versus "
+   "stopping early, with lattice cells of cell voxels", bench_octaves},
+  {"cells", "[size]: Perlin noise with each cell's corners hashed per voxel "
+   "versus once per workgroup or brick, by octave frequency", bench_cells},
+  {"render", "[frames]: build time, upload size and frame time of each mode",
+   bench_render},
+  {"chunks", "[frames] [speed]: frame times while flying through streamed "
+   "chunks", bench_chunks},
+  {"cache", "[size]: time to generate a volume versus loading it from the "
+   "cache", bench_cache},
+};
+
+#define CommandCount (sizeof(commands)/sizeof(*commands))
+
+static void usage(const char *name);
+
+int main(int argc, char **argv) {
+  const bench_command *command = NULL;
+  for (size_t i = 0; argc > 1 && i < CommandCount; i++) {
+    if (strcmp(argv[1], commands[i].name) == 0)
+      command = &commands[i];
+  }
+
+  if (!command) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  /* The GPU side of each benchmark is skipped when no GL context can be
+   * created, e.g. on headless build hosts. */
+  int has_gl = 0;
+  GLFWwindow *window = NULL;
+  if (glfwInit()) {
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    window = glfwCreateWindow(64, 64, "gl_noise_bench", NULL, NULL);
+    if (window) {
+      glfwMakeContextCurrent(window);
+      has_gl = glewInit() == GLEW_OK;
+    }
+  }
+
+  if (!has_gl)
+    fprintf(stderr, "No GL context, only running CPU benchmarks.\n");
+
+  int status = command->run(argc - 2, argv + 2, has_gl);
+
+  if (has_gl) noise_release_programs();
+  if (window) glfwDestroyWindow(window);
+  glfwTerminate();
+
+  return status;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s command [args...]\n\ncommands:\n", name);
+  for (size_t i = 0; i < CommandCount; i++)
+    fprintf(stderr, "  %s %s\n", commands[i].name, commands[i].help);
+}
+
+static const char *noise_kind_names[] = {
+  "perlin3d", "simplex3d", "perlin4d", "simplex4d", "white"
+};
+
+#define BenchStart (vec4){0, 0, 0, 0}
+#define BenchScale (vec4){1.0/30, 1.0/30, 1.0/30, 0.1}
+#define BenchSliceW 1.5
+
+/* Runs a generator BenchRepetitions times and returns the best time. Every
+ * run uses BenchSeed, so that all backends produce the same volume. */
+static double time_gpu(noise_kind kind, size_t size, size_t octave_count,
+                       GLfloat *noise) {
+  vec4 start = BenchStart, scale = BenchScale;
+  vec3 start3 = {start.x, start.y, start.z};
+  vec3 scale3 = {scale.x, scale.y, scale.z};
+
+  double best = INFINITY;
+  for (size_t i = 0; i < BenchRepetitions; i++) {
+
+    double t;
+    if (kind == NoisePerlin4d || kind == NoiseSimplex4d) {
+      perlin4d_gen gen;
+      if (kind == NoisePerlin4d)
+        perlin4d_init(&gen, size, size, size, octave_count, start, scale,
+                      BenchSeed);
+      else
+        simplex4d_init(&gen, size, size, size, octave_count, start, scale,
+                       BenchSeed);
+      glFinish();
+      t = timer_now();
+      perlin4d_slice(&gen, BenchSliceW, noise);
+      t = timer_now() - t;
+      perlin4d_release(&gen);
+    }
+    else if (kind == NoiseWhite) {
+      white_gen gen;
+      white_init(&gen);
+      glFinish();
+      t = timer_now();
+      white_generate(&gen, size, size, size, noise, 0, 0, 0, BenchSeed);
+      t = timer_now() - t;
+      white_release(&gen);
+    }
+    else {
+      perlin3d_gen gen;
+      if (kind == NoisePerlin3d) perlin3d_init(&gen, BenchSeed);
+      else simplex3d_init(&gen, BenchSeed);
+
+      glFinish();
+      t = timer_now();
+      perlin3d_generate(&gen, size, size, size, noise,
+                        octave_count, start3, scale3);
+      t = timer_now() - t;
+      perlin3d_release(&gen);
+    }
+
+    if (t < best) best = t;
+  }
+
+  return best;
+}
+
+static double time_cpu(noise_kind kind, size_t size, size_t octave_count,
+                       GLfloat *noise) {
+  vec4 start = BenchStart, scale = BenchScale;
+  vec3 start3 = {start.x, start.y, start.z};
+  vec3 scale3 = {scale.x, scale.y, scale.z};
+
+  double best = INFINITY;
+  for (size_t i = 0; i < BenchRepetitions; i++) {
+
+    double t;
+    if (kind == NoisePerlin4d || kind == NoiseSimplex4d) {
+      perlin4d_cpu_gen gen;
+      if (kind == NoisePerlin4d)
+        perlin4d_cpu_init(&gen, size, size, size, octave_count, start, scale,
+                          BenchSeed);
+      else
+        simplex4d_cpu_init(&gen, size, size, size, octave_count, start,
+                           scale, BenchSeed);
+      t = timer_now();
+      perlin4d_cpu_slice(&gen, BenchSliceW, noise);
+      t = timer_now() - t;
+      perlin4d_cpu_release(&gen);
+    }
+    else {
+      t = timer_now();
+      if (kind == NoisePerlin3d)
+        perlin3d_cpu(size, size, size, noise, octave_count, start3, scale3,
+                     BenchSeed);
+      else if (kind == NoiseSimplex3d)
+        simplex3d_cpu(size, size, size, noise, octave_count, start3, scale3,
+                      BenchSeed);
+      else
+        white_noise(size, size, size, noise, BenchSeed);
+      t = timer_now() - t;
+    }
+
+    if (t < best) best = t;
+  }
+
+  return best;
+}
+
+static double max_difference(const GLfloat *a, const GLfloat *b, size_t n) {
+  double ret = 0;
+  for (size_t i = 0; i < n; i++) {
+    double d = fabs(a[i] - b[i]);
+    if (d > ret) ret = d;
+  }
+
+  return ret;
+}
+
+static int bench_noise(int argc, char **argv, int has_gl) {
+  size_t size         = argc > 0 ? strtoul(argv[0], NULL, 10) : 128;
+  size_t octave_count = argc > 1 ? strtoul(argv[1], NULL, 10) : 3;
+  size_t voxels = size*size*size;
+
+  GLfloat *gpu = malloc(sizeof(*gpu)*voxels);
+  GLfloat *cpu = malloc(sizeof(*cpu)*voxels);
+  if (!gpu || !cpu) {
+    fprintf(stderr, "Failed to allocate %zu^3 volumes.\n", size);
+    free(gpu);
+    free(cpu);
+    return 1;
+  }
+
+  int status = 0;
+
+  printf("%zu^3 voxels, %zu octaves\n", size, octave_count);
+  printf("%-10s %-8s %-8s %14s %12s\n", "generator", "hash", "backend",
+         "voxels/s", "max diff");
+
+  noise_cpu_isa best_isa = noise_cpu_best_isa();
+  for (noise_kind kind = NoisePerlin3d; kind <= NoiseWhite; kind++) {
+    /* White noise only uses integer operations, so it must match exactly. */
+    double tolerance = kind == NoiseWhite ? 0 : NoiseCpuTolerance;
+
+    /* White noise has no gradients to pick. */
+    noise_hash_mode last_mode = kind == NoiseWhite ?
+      NoiseHashTable : NoiseHashInteger;
+    for (noise_hash_mode mode = NoiseHashTable; mode <= last_mode; mode++) {
+      noise_set_hash_mode(mode);
+      const char *name = noise_kind_names[kind];
+      const char *hash = kind == NoiseWhite ? "-" : noise_hash_mode_name(mode);
+
+      if (has_gl) {
+        double t = time_gpu(kind, size, octave_count, gpu);
+        printf("%-10s %-8s %-8s %14.4g %12s\n", name, hash, "gpu",
+               voxels/t, "-");
+      }
+
+      for (noise_cpu_isa isa = NoiseCpuScalar; isa <= best_isa; isa++) {
+        noise_cpu_set_isa(isa);
+        double t = time_cpu(kind, size, octave_count, cpu);
+
+        if (has_gl) {
+          double diff = max_difference(gpu, cpu, voxels);
+          printf("%-10s %-8s %-8s %14.4g %12.3g\n", name, hash,
+                 noise_cpu_isa_name(isa), voxels/t, diff);
+          if (diff > tolerance) status = 1;
+        }
+        else {
+          printf("%-10s %-8s %-8s %14.4g %12s\n", name, hash,
+                 noise_cpu_isa_name(isa), voxels/t, "-");
+        }
+      }
+    }
+  }
+
+  noise_set_hash_mode(NoiseHashTable);
+  noise_cpu_set_isa(best_isa);
+
+  /* The last volume filled is white noise, which must come out the same when
+   * filled as eight pieces, in any order. */
+  size_t half = size/2;
+  GLfloat *piece = malloc(sizeof(*piece)*(half + 1)*(half + 1)*(half + 1));
+  int pieces_match = piece != NULL;
+  for (size_t i = 8; pieces_match && i-- > 0;) {
+    size_t x0 = i & 1 ? half : 0, y0 = i & 2 ? half : 0, z0 = i & 4 ? half : 0;
+    size_t w = i & 1 ? size - half : half;
+    size_t h = i & 2 ? size - half : half;
+    size_t d = i & 4 ? size - half : half;
+
+    white_noise_cpu(w, h, d, piece, x0, y0, z0, BenchSeed);
+    for (size_t z = 0; z < d; z++) {
+      for (size_t y = 0; y < h; y++) {
+        if (memcmp(piece + w*y + w*h*z,
+                   cpu + x0 + size*(y0 + y) + size*size*(z0 + z),
+                   sizeof(*piece)*w) != 0)
+          pieces_match = 0;
+      }
+    }
+  }
+  free(piece);
+
+  printf("white noise filled in pieces: %s\n",
+         pieces_match ? "same" : "DIFFERENT");
+  if (!pieces_match) status = 1;
+
+  free(cpu);
+  free(gpu);
+
+  return status;
+}
+
+static int bench_noise4d(int argc, char **argv, int has_gl) {
+  static const size_t default_sizes[] = {32, 64, 128};
+  static const size_t octave_counts[] = {1, 3, 5};
+
+  size_t size_count = argc > 0 ? (size_t)argc : 3;
+
+  printf("%6s %8s %-8s %14s %14s %8s\n", "size", "octaves", "backend",
+         "perlin4d ms", "simplex4d ms", "speedup");
+
+  for (size_t i = 0; i < size_count; i++) {
+    size_t size = argc > 0 ? strtoul(argv[i], NULL, 10) : default_sizes[i];
+
+    GLfloat *noise = malloc(sizeof(*noise)*size*size*size);
+    if (!noise) {
+      fprintf(stderr, "Failed to allocate a %zu^3 volume.\n", size);
+      return 1;
+    }
+
+    for (size_t j = 0; j < sizeof(octave_counts)/sizeof(*octave_counts);
+         j++) {
+      size_t octave_count = octave_counts[j];
+
+      if (has_gl) {
+        double perlin  = time_gpu(NoisePerlin4d, size, octave_count, noise);
+        double simplex = time_gpu(NoiseSimplex4d, size, octave_count, noise);
+        printf("%6zu %8zu %-8s %14.3f %14.3f %8.2f\n", size, octave_count,
+               "gpu", perlin*1e3, simplex*1e3, perlin/simplex);
+      }
+
+      double perlin  = time_cpu(NoisePerlin4d, size, octave_count, noise);
+      double simplex = time_cpu(NoiseSimplex4d, size, octave_count, noise);
+      printf("%6zu %8zu %-8s %14.3f %14.3f %8.2f\n", size, octave_count,
+             noise_cpu_isa_name(noise_cpu_current_isa()),
+             perlin*1e3, simplex*1e3, perlin/simplex);
+    }
+
+    free(noise);
+  }
+
+  return 0;
+}
+
+#define VariantMaxOctaves 5
+
+/* Generates a volume with every octave count, with Perlin and simplex noise,
+ * twice. Only the first pass compiles programs. */
+static int bench_variants(int argc, char **argv, int has_gl) {
+  if (!has_gl) {
+    fprintf(stderr, "Shader variants need a GL context.\n");
+    return 1;
+  }
+
+  size_t size = argc > 0 ? strtoul(argv[0], NULL, 10) : 32;
+
+  GLfloat *noise = malloc(sizeof(*noise)*size*size*size);
+  if (!noise) {
+    fprintf(stderr, "Failed to allocate a %zu^3 volume.\n", size);
+    return 1;
+  }
+
+  perlin3d_gen perlin, simplex;
+  perlin3d_init(&perlin, BenchSeed);
+  simplex3d_init(&simplex, BenchSeed);
+
+  vec3 start = {0, 0, 0}, scale = {1.0/30, 1.0/30, 1.0/30};
+
+  double times[2][2][VariantMaxOctaves];
+  size_t compiled[2];
+  for (size_t pass = 0; pass < 2; pass++) {
+    size_t before = noise_program_count();
+    for (size_t octaves = 1; octaves <= VariantMaxOctaves; octaves++) {
+      for (size_t i = 0; i < 2; i++) {
+        glFinish();
+        double t = timer_now();
+        perlin3d_generate(i == 0 ? &perlin : &simplex, size, size, size,
+                          noise, octaves, start, scale);
+        times[pass][i][octaves - 1] = timer_now() - t;
+      }
+    }
+    compiled[pass] = noise_program_count() - before;
+  }
+
+  perlin3d_release(&simplex);
+  perlin3d_release(&perlin);
+  free(noise);
+
+  printf("%-10s %8s %12s %12s\n", "generator", "octaves", "first ms",
+         "again ms");
+  for (size_t i = 0; i < 2; i++) {
+    for (size_t octaves = 1; octaves <= VariantMaxOctaves; octaves++) {
+      printf("%-10s %8zu %12.3f %12.3f\n", noise_kind_names[i], octaves,
+             times[0][i][octaves - 1]*1e3, times[1][i][octaves - 1]*1e3);
+    }
+  }
+
+  printf("programs compiled: %zu on the first pass, %zu on the second\n",
+         compiled[0], compiled[1]);
+  return compiled[1] == 0 ? 0 : 1;
+}
+
+/* Creates the renderer and one generator of each kind, with what the program
+ * needs at launch, so that every program it uses is compiled or loaded. */
+static double time_startup(void) {
+  glFinish();
+  double t = timer_now();
+
+  noise_renderer renderer;
+  noise_renderer_init(&renderer, NoiseAnimated, NoiseMesherCulled,
+                      NoiseVertexFloat, LevelWidth, LevelHeight, LevelDepth);
+
+  /* 3D programs are picked by the first generate call. */
+  GLfloat noise[8];
+  vec3 start = {0, 0, 0}, scale = {1.0/30, 1.0/30, 1.0/30};
+  perlin3d_gen perlin, simplex;
+  perlin3d_init(&perlin, BenchSeed);
+  simplex3d_init(&simplex, BenchSeed);
+  perlin3d_generate(&perlin, 2, 2, 2, noise, 3, start, scale);
+  simplex3d_generate(&simplex, 2, 2, 2, noise, 3, start, scale);
+
+  perlin4d_gen perlin4d, simplex4d;
+  perlin4d_init(&perlin4d, LevelWidth, LevelHeight, LevelDepth, 3,
+                BenchStart, BenchScale, BenchSeed);
+  simplex4d_init(&simplex4d, LevelWidth, LevelHeight, LevelDepth, 3,
+                 BenchStart, BenchScale, BenchSeed);
+
+  white_gen white;
+  white_init(&white);
+
+  glFinish();
+  t = timer_now() - t;
+
+  white_release(&white);
+  simplex4d_release(&simplex4d);
+  perlin4d_release(&perlin4d);
+  simplex3d_release(&simplex);
+  perlin3d_release(&perlin);
+  noise_renderer_release(&renderer);
+
+  noise_release_programs();
+  return t;
+}
+
+/* Times startup without the program cache, then with it twice: the first
+ * run saves whatever binaries are missing and the second one should load
+ * them all. The driver may have its own shader cache too, which makes cold
+ * starts look faster than they are. */
+static int bench_startup(int argc, char **argv, int has_gl) {
+  if (!has_gl) {
+    fprintf(stderr, "Compiling programs needs a GL context.\n");
+    return 1;
+  }
+
+  GLint formats;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+  /* Tunes workgroup sizes, if they aren't known yet, before any timing. */
+  program_cache_set_enabled(0);
+  time_startup();
+
+  static const char *names[] = {"cold", "populate", "warm"};
+  double times[3];
+  program_cache_stats stats[3];
+  for (size_t pass = 0; pass < 3; pass++) {
+    program_cache_set_enabled(pass > 0);
+    program_cache_stats before = program_cache_get_stats();
+    times[pass] = time_startup();
+
+    program_cache_stats after = program_cache_get_stats();
+    stats[pass].loaded   = after.loaded - before.loaded;
+    stats[pass].compiled = after.compiled - before.compiled;
+    stats[pass].rejected = after.rejected - before.rejected;
+  }
+
+  program_cache_set_enabled(1);
+
+  printf("binary formats: %d\n", formats);
+  printf("%-10s %10s %8s %10s %10s\n", "pass", "ms", "loaded", "compiled",
+         "rejected");
+  for (size_t pass = 0; pass < 3; pass++) {
+    printf("%-10s %10.3f %8zu %10zu %10zu\n", names[pass], times[pass]*1e3,
+           stats[pass].loaded, stats[pass].compiled, stats[pass].rejected);
+  }
+
+  if (formats > 0)
+    printf("speedup: %.2fx\n", times[0]/times[2]);
+
+  return formats > 0 && stats[2].compiled != 0 ? 1 : 0;
+}
+
+/* Voxels of a slice in the given format that the mesher would classify
+ * differently from the float slice. */
+static size_t count_misclassified(noise_output_format format, const void *data,
+                                  const GLfloat *reference, size_t n) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; i++) {
+    int solid = noise_output_sample(format, data, i) >= DensityThreshold;
+    count += solid != (reference[i] >= DensityThreshold);
+  }
+
+  return count;
+}
+
+#define ReadbackFormatCount (NoiseOutputOccupancy + 1)
+
+/* Reads a perlin4d slice back in each format and meshes it with the culled
+ * mesher. Quantized samples can only land on the wrong side of the threshold
+ * if the noise is within rounding error of it, so at most a handful of voxels
+ * may differ from the float slice. */
+static int bench_readback(int argc, char **argv, int has_gl) {
+  static const size_t default_sizes[] = {64, 128};
+
+  if (!has_gl) {
+    fprintf(stderr, "Reading slices back needs a GL context.\n");
+    return 1;
+  }
+
+  size_t size_count = argc > 0 ? (size_t)argc :
+    sizeof(default_sizes)/sizeof(*default_sizes);
+
+  int status = 0;
+
+  printf("%6s %-10s %12s %12s %10s %12s %10s\n", "size", "format",
+         "slice (ms)", "read (KiB)", "differ", "mesh (ms)", "triangles");
+
+  for (size_t i = 0; i < size_count; i++) {
+    size_t size = argc > 0 ? strtoul(argv[i], NULL, 10) : default_sizes[i];
+    size_t n = size*size*size;
+
+    GLfloat *reference = malloc(sizeof(*reference)*n);
+    void *data = malloc(noise_output_size(NoiseOutputFloat, n));
+
+    noise_renderer renderer;
+    if (!reference || !data ||
+        noise_renderer_init(&renderer, NoiseAnimated, NoiseMesherCulled,
+                            NoiseVertexFloat, size, size, size) != 0) {
+      fprintf(stderr, "Can't mesh a %zu^3 volume.\n", size);
+      free(data);
+      free(reference);
+      status = 1;
+      continue;
+    }
+
+    perlin4d_gen gen;
+    perlin4d_init(&gen, size, size, size, 3, BenchStart, BenchScale,
+                  BenchSeed);
+
+    for (noise_output_format format = NoiseOutputFloat;
+         format < ReadbackFormatCount; format++) {
+      perlin4d_set_output(&gen, format, DensityThreshold);
+      noise_renderer_set_input(&renderer, format);
+
+      double best = INFINITY;
+      for (size_t j = 0; j < BenchRepetitions; j++) {
+        glFinish();
+        double t = timer_now();
+        perlin4d_slice(&gen, BenchSliceW, data);
+        t = timer_now() - t;
+        if (t < best) best = t;
+      }
+
+      if (format == NoiseOutputFloat)
+        memcpy(reference, data, sizeof(*reference)*n);
+
+      size_t differ = count_misclassified(format, data, reference, n);
+      if (differ > n/100000) status = 1;
+
+      if (generate_geometry(&renderer, data) != 0)
+        status = 1;
+
+      printf("%6zu %-10s %12.3f %12.1f %10zu %12.3f %10zu\n", size,
+             noise_output_name(format), best*1e3,
+             noise_output_size(format, n)/1024.0, differ,
+             renderer.stats.mesh_time*1e3, renderer.index_count/3);
+    }
+
+    perlin4d_release(&gen);
+    noise_renderer_release(&renderer);
+    free(data);
+    free(reference);
+  }
+
+  return status;
+}
+
+static int bench_threads(int argc, char **argv, int has_gl) {
+  static const size_t default_sizes[] = {256, 512};
+
+  size_t size_count = argc > 0 ? (size_t)argc : 2;
+  size_t max_threads = thread_pool_default_size();
+
+  int status = 0;
+
+  printf("%-10s %6s %8s %14s %8s\n", "generator", "size", "threads",
+         "voxels/s", "speedup");
+
+  for (size_t i = 0; i < size_count; i++) {
+    size_t size = argc > 0 ? strtoul(argv[i], NULL, 10) : default_sizes[i];
+    size_t voxels = size*size*size;
+
+    GLfloat *reference = malloc(sizeof(*reference)*voxels);
+    GLfloat *noise     = malloc(sizeof(*noise)*voxels);
+    if (!reference || !noise) {
+      fprintf(stderr, "Failed to allocate %zu^3 volumes.\n", size);
+      free(reference);
+      free(noise);
+      return 1;
+    }
+
+    for (noise_kind kind = NoisePerlin3d; kind <= NoiseWhite; kind++) {
+      /* The GPU one-shot API is the baseline the CPU path is replacing. */
+      if (has_gl && kind == NoisePerlin3d) {
+        double t = timer_now();
+        perlin3d(size, size, size, noise, 3, (vec3){0, 0, 0},
+                 (vec3){1.0/30, 1.0/30, 1.0/30}, BenchSeed);
+        t = timer_now() - t;
+        printf("%-10s %6zu %8s %14.4g %8s\n", "perlin3d()", size, "gpu",
+               voxels/t, "-");
+      }
+
+      double single = 0;
+      /* 1, 2, 4, ... and finally the number of processors. */
+      for (size_t threads = 1; threads <= max_threads;
+           threads = threads < max_threads && threads*2 > max_threads ?
+             max_threads : threads*2) {
+        noise_cpu_set_thread_count(threads);
+        double t = time_cpu(kind, size, 3, threads == 1 ? reference : noise);
+        if (threads == 1) single = t;
+
+        const char *same = "";
+        if (threads != 1 &&
+            memcmp(reference, noise, sizeof(*noise)*voxels) != 0) {
+          same = " (output differs from 1 thread)";
+          status = 1;
+        }
+
+        printf("%-10s %6zu %8zu %14.4g %8.2f%s\n", noise_kind_names[kind],
+               size, threads, voxels/t, single/t, same);
+      }
+    }
+
+    free(noise);
+    free(reference);
+  }
+
+  noise_cpu_set_thread_count(0);
+
+  return status;
+}
+
+static int bench_workgroups(int argc, char **argv, int has_gl) {
+  if (!has_gl) {
+    fprintf(stderr, "Tuning workgroup sizes needs a GL context.\n");
+    return 1;
+  }
+
+  printf("%s\n", (const char*)glGetString(GL_RENDERER));
+
+  double *times = malloc(sizeof(*times)*workgroup_candidate_count);
+  if (!times) return 1;
+
+  for (noise_kind kind = NoisePerlin3d; kind <= NoiseSimplex4d; kind++) {
+    workgroup_size best = noise_tune_workgroup(kind, times);
+
+    for (size_t i = 0; i < workgroup_candidate_count; i++) {
+      workgroup_size size = workgroup_candidates[i];
+      printf("%-10s %2ux%2ux%2u %10.3f ms%s\n", noise_kind_names[kind],
+             size.x, size.y, size.z, times[i]*1e3,
+             size.x == best.x && size.y == best.y && size.z == best.z ?
+             " (best)" : "");
+    }
+  }
+
+  free(times);
+  return 0;
+}
+
+typedef struct frame_stats {
+  double total, worst;
+  size_t frames, slices;
+} frame_stats;
+
+static void add_frame(frame_stats *stats, double t) {
+  stats->total += t;
+  if (t > stats->worst) stats->worst = t;
+  stats->frames++;
+}
+
+static void print_frames(const char *name, const frame_stats *stats) {
+  printf("%-12s %10.3f %10.3f %8zu\n", name,
+         stats->total/stats->frames*1e3, stats->worst*1e3, stats->slices);
+}
+
+/* Simulates the animated loop of main.c: each frame renders the current mesh
+ * and updates it from the noise, without waiting for vsync. */
+static int bench_animate(int argc, char **argv, int has_gl) {
+  if (!has_gl) {
+    fprintf(stderr, "The animation benchmark needs a GL context.\n");
+    return 1;
+  }
+
+  size_t frames = argc > 0 ? strtoul(argv[0], NULL, 10) : 200;
+  size_t depth  = argc > 1 ? strtoul(argv[1], NULL, 10) :
+    DefaultPipelineDepth;
+
+  GLfloat *noise = malloc(sizeof(*noise)*LevelWidth*LevelHeight*LevelDepth);
+  if (!noise) return 1;
+
+  vec4 scale = {1.0/LevelWidth, 1.0/LevelHeight, 1.0/LevelDepth, 0.1};
+
+  perlin4d_gen gen;
+  perlin4d_init(&gen, LevelWidth, LevelHeight, LevelDepth, 3,
+                BenchStart, scale, BenchSeed);
+
+  noise_renderer renderer;
+  noise_renderer_init(&renderer, NoiseAnimated, NoiseMesherCulled,
+                      NoiseVertexFloat, LevelWidth, LevelHeight, LevelDepth);
+
+  int status = 0;
+
+  printf("%-12s %10s %10s %8s\n", "mode", "mean (ms)", "worst (ms)",
+         "slices");
+
+  frame_stats sync = {0, 0, 0, 0};
+  for (size_t i = 0; i < frames; i++) {
+    double t = timer_now();
+    render(&renderer);
+    perlin4d_slice(&gen, i*0.016, noise);
+    generate_geometry(&renderer, noise);
+    add_frame(&sync, timer_now() - t);
+    sync.slices++;
+  }
+  print_frames("sync", &sync);
+
+  perlin4d_async async;
+  if (perlin4d_async_init(&async, &gen, depth) == 0) {
+    frame_stats pipelined = {0, 0, 0, 0};
+    for (size_t i = 0; i < frames; i++) {
+      double t = timer_now();
+      render(&renderer);
+
+      const GLfloat *slice = perlin4d_async_try_acquire(&async, NULL);
+      if (slice) {
+        generate_geometry(&renderer, slice);
+        perlin4d_async_recycle(&async);
+        pipelined.slices++;
+      }
+
+      perlin4d_async_submit(&async, i*0.016);
+      add_frame(&pipelined, timer_now() - t);
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "async (%zu)", async.depth);
+    print_frames(name, &pipelined);
+
+    perlin4d_async_release(&async);
+  }
+  else {
+    fprintf(stderr, "ARB_buffer_storage is not supported.\n");
+    status = 1;
+  }
+
+  frame_stats gpu = {0, 0, 0, 0};
+  for (size_t i = 0; i < frames; i++) {
+    double t = timer_now();
+    render(&renderer);
+    perlin4d_dispatch(&gen, i*0.016);
+    generate_geometry_gpu(&renderer, gen.shader_output);
+    add_frame(&gpu, timer_now() - t);
+    gpu.slices++;
+  }
+  print_frames("gpu mesher", &gpu);
+
+  noise_renderer_release(&renderer);
+  perlin4d_release(&gen);
+  free(noise);
+
+  return status;
+}
+
+/* A triangle as the values of its three vertices, rotated so that the
+ * smallest vertex comes first. This keeps the winding while making triangles
+ * comparable regardless of where the mesher put them. */
+#define TriangleKeySize 27
+
+typedef struct triangle_key {
+  GLfloat data[TriangleKeySize];
+} triangle_key;
+
+static int compare_floats(const GLfloat *a, const GLfloat *b, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+  }
+
+  return 0;
+}
+
+static int compare_triangles(const void *a, const void *b) {
+  return compare_floats(((const triangle_key*)a)->data,
+                        ((const triangle_key*)b)->data, TriangleKeySize);
+}
+
+/* Reads the renderer's buffers back and returns the sorted triangles, or
+ * NULL on failure. Instanced cubes are expanded into the triangles drawn. */
+static triangle_key *read_triangles(const noise_renderer *renderer,
+                                    size_t *count) {
+  size_t index_count = noise_renderer_index_count(renderer);
+  int instanced = renderer->mesher == NoiseMesherInstanced;
+
+  int short_indices = renderer->index_type == GL_UNSIGNED_SHORT;
+
+  GLint vbo_size, ibo_size;
+  glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+  glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &vbo_size);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->ibo);
+  glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &ibo_size);
+
+  size_t vertex_count = renderer->format == NoiseVertexPacked ?
+    vbo_size/sizeof(packed_vertex) : vbo_size/sizeof(vertex);
+  size_t instance_count = instanced ? index_count/36 : 1;
+
+  GLuint *indices = malloc(ibo_size/(short_indices ? 2 : 4)*sizeof(GLuint));
+  vertex *vertices = malloc(vertex_count*sizeof(vertex));
+  GLuint *instances = malloc(instance_count*sizeof(GLuint));
+  triangle_key *keys = malloc(sizeof(*keys)*(index_count/3 + 1));
+  if (!indices || !vertices || !instances || !keys) {
+    free(keys);
+    keys = NULL;
+    goto done;
+  }
+
+  /* The instanced mesh holds a cube followed by the box. Instance 0, at the
+   * origin, only draws the box; the others draw the cube. */
+  instances[0] = 0;
+  if (instanced) {
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->instances);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, instance_count*sizeof(GLuint),
+                       instances);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+  glGetBufferSubData(GL_ARRAY_BUFFER, 0, vbo_size, vertices);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  if (renderer->format == NoiseVertexPacked) {
+    /* Unpacks from the back, where the packed vertices don't overlap the
+     * unpacked ones. */
+    const packed_vertex *packed = (const packed_vertex*)vertices;
+    for (size_t i = vertex_count; i-- > 0;)
+      vertices[i] = unpack_vertex(packed[i]);
+  }
+
+  glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, ibo_size, indices);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  if (short_indices) {
+    /* Expands from the back, making each index absolute again. */
+    const GLushort *packed = (const GLushort*)indices;
+    for (size_t i = ibo_size/sizeof(GLushort); i-- > 0;)
+      indices[i] = packed[i] + i/(6*SquaresPerDraw) * (4*SquaresPerDraw);
+  }
+
+  size_t triangle_count = 0;
+  for (size_t k = 0; k < instance_count; k++) {
+    vec3 offset = {
+      instances[k] & 1023, (instances[k] >> 10) & 1023,
+      (instances[k] >> 20) & 1023,
+    };
+
+    size_t first_index = instanced && k == 0 ? 36 : 0;
+    size_t triangles = instanced ? 12 : index_count/3;
+    for (size_t i = 0; i < triangles; i++) {
+      GLfloat corners[3][TriangleKeySize/3];
+      for (size_t j = 0; j < 3; j++) {
+        const vertex *v = &vertices[indices[first_index + 3*i + j]];
+        GLfloat values[TriangleKeySize/3] = {
+          v->pos.x + offset.x, v->pos.y + offset.y, v->pos.z + offset.z,
+          v->normal.x, v->normal.y, v->normal.z,
+          v->color.r, v->color.g, v->color.b,
+        };
+        memcpy(corners[j], values, sizeof(values));
+      }
+
+      size_t first = 0;
+      for (size_t j = 1; j < 3; j++) {
+        if (compare_floats(corners[j], corners[first],
+                           TriangleKeySize/3) < 0)
+          first = j;
+      }
+
+      triangle_key *key = &keys[triangle_count++];
+      for (size_t j = 0; j < 3; j++) {
+        memcpy(key->data + j*(TriangleKeySize/3), corners[(first + j) % 3],
+               sizeof(corners[0]));
+      }
+    }
+  }
+
+  *count = triangle_count;
+  qsort(keys, *count, sizeof(*keys), compare_triangles);
+
+done:
+  free(instances);
+  free(vertices);
+  free(indices);
+  return keys;
+}
+
+static const char *mesher_names[] = {
+  "naive", "culled", "greedy", "instanced",
+};
+
+#define MesherCount (sizeof(mesher_names)/sizeof(*mesher_names))
+
+static const char *format_names[] = {
+  "float", "packed",
+};
+
+#define FormatCount (sizeof(format_names)/sizeof(*format_names))
+
+static int check_mesher(noise_mesher mesher, noise_vertex_format format,
+                        size_t slices) {
+  GLfloat *noise = malloc(sizeof(*noise)*LevelWidth*LevelHeight*LevelDepth);
+  if (!noise) return 1;
+
+  vec4 scale = {1.0/LevelWidth, 1.0/LevelHeight, 1.0/LevelDepth, 0.1};
+
+  perlin4d_gen gen;
+  perlin4d_init(&gen, LevelWidth, LevelHeight, LevelDepth, 3,
+                BenchStart, scale, BenchSeed);
+
+  noise_renderer cpu, gpu;
+  noise_renderer_init(&cpu, NoiseAnimated, mesher, format,
+                      LevelWidth, LevelHeight, LevelDepth);
+  noise_renderer_init(&gpu, NoiseAnimated, mesher, format,
+                      LevelWidth, LevelHeight, LevelDepth);
+
+  int status = 0;
+
+  for (size_t i = 0; i < slices && status == 0; i++) {
+    GLfloat w = i*0.5;
+
+    glFinish();
+    double t = timer_now();
+    perlin4d_slice(&gen, w, noise);
+    if (generate_geometry(&cpu, noise) != 0) {
+      status = 1;
+      break;
+    }
+    glFinish();
+    double cpu_time = timer_now() - t;
+
+    t = timer_now();
+    perlin4d_dispatch(&gen, w);
+    generate_geometry_gpu(&gpu, gen.shader_output);
+    glFinish();
+    double gpu_time = timer_now() - t;
+
+    size_t cpu_count = 0, gpu_count = 0;
+    triangle_key *cpu_keys = read_triangles(&cpu, &cpu_count);
+    triangle_key *gpu_keys = read_triangles(&gpu, &gpu_count);
+
+    int same = cpu_keys && gpu_keys && cpu_count == gpu_count &&
+      memcmp(cpu_keys, gpu_keys, sizeof(*cpu_keys)*cpu_count) == 0;
+    if (!same) status = 1;
+
+    printf("%-9s %-8s %8.1f %10zu %10.3f %10.3f %10s\n",
+           mesher_names[mesher], format_names[format], w, gpu_count,
+           cpu_time*1e3, gpu_time*1e3, same ? "ok" : "MISMATCH");
+
+    free(gpu_keys);
+    free(cpu_keys);
+  }
+
+  noise_renderer_release(&gpu);
+  noise_renderer_release(&cpu);
+  perlin4d_release(&gen);
+  free(noise);
+
+  return status;
+}
+
+static int bench_mesher(int argc, char **argv, int has_gl) {
+  if (!has_gl) {
+    fprintf(stderr, "The mesher benchmark needs a GL context.\n");
+    return 1;
+  }
+
+  size_t slices = argc > 0 ? strtoul(argv[0], NULL, 10) : 4;
+
+  printf("%-9s %-8s %8s %10s %10s %10s %10s\n", "mesher", "format", "slice",
+         "triangles", "cpu (ms)", "gpu (ms)", "result");
+
+  /* The GPU has no greedy mesher. */
+  int status = 0;
+  for (size_t i = 0; i < MesherCount; i++) {
+    for (size_t j = 0; j < FormatCount; j++) {
+      if (i != NoiseMesherGreedy && check_mesher(i, j, slices) != 0)
+        status = 1;
+    }
+  }
+
+  return status;
+}
+
+#define ImageSize 256
+
+/* Draws the scene from outside of the volume into an offscreen framebuffer
+ * and reads it back as RGBA. */
+static void render_image(noise_renderer *renderer, GLubyte *pixels) {
+  GLuint fbo, color, depth;
+
+  glGenRenderbuffers(1, &color);
+  glBindRenderbuffer(GL_RENDERBUFFER, color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, ImageSize, ImageSize);
+
+  glGenRenderbuffers(1, &depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24,
+                        ImageSize, ImageSize);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, depth);
+
+  camera camera;
+  camera_init(&camera, 1);
+  camera.eye = (vec3){-LevelWidth/2.0, LevelHeight*1.5, -LevelDepth/2.0};
+  camera_reorient(&camera, -Pi/4, -0.6);
+
+  glViewport(0, 0, ImageSize, ImageSize);
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_CULL_FACE);
+
+  set_mvp(renderer, Mat4Identity, camera_view(&camera),
+          camera_projection(&camera));
+  render(renderer);
+  glReadPixels(0, 0, ImageSize, ImageSize, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+  glDisable(GL_CULL_FACE);
+  glDisable(GL_DEPTH_TEST);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glDeleteFramebuffers(1, &fbo);
+  glDeleteRenderbuffers(1, &depth);
+  glDeleteRenderbuffers(1, &color);
+}
+
+/* Renders the standard volume with every mesher and vertex format and counts
+ * the pixels that differ from the naive mesher's image. Hidden faces that end
+ * on a visible edge can win depth ties against the face in front of them, so
+ * the naive image has the odd stray pixel along such edges; anything beyond
+ * that means visible faces went missing. */
+#define MaxImageDifference (ImageSize*ImageSize/1000)
+
+static int compare_images(const GLfloat *noise) {
+  GLubyte *reference = malloc(4*ImageSize*ImageSize);
+  GLubyte *pixels    = malloc(4*ImageSize*ImageSize);
+  int status = 0;
+
+  if (!reference || !pixels) {
+    status = 1;
+    goto done;
+  }
+
+  for (size_t i = 0; i < MesherCount*FormatCount; i++) {
+    noise_mesher mesher = i % MesherCount;
+    noise_vertex_format format = i / MesherCount;
+
+    noise_renderer renderer;
+    noise_renderer_init(&renderer, NoiseConstant, mesher, format,
+                        LevelWidth, LevelHeight, LevelDepth);
+    if (generate_geometry(&renderer, noise) != 0) status = 1;
+    render_image(&renderer, i == 0 ? reference : pixels);
+    noise_renderer_release(&renderer);
+
+    if (i == 0) continue;
+
+    size_t differences = 0;
+    for (size_t j = 0; j < ImageSize*ImageSize; j++) {
+      if (memcmp(reference + 4*j, pixels + 4*j, 4) != 0)
+        differences++;
+    }
+
+    printf("%-9s %-8s %zu pixels differ from %s %s\n", mesher_names[mesher],
+           format_names[format], differences, mesher_names[0],
+           format_names[0]);
+    if (differences > MaxImageDifference) status = 1;
+  }
+
+done:
+  free(pixels);
+  free(reference);
+  return status;
+}
+
+static int bench_mesh(int argc, char **argv, int has_gl) {
+  static const size_t default_sizes[] = {30, 64};
+
+  size_t size_count = argc > 0 ? (size_t)argc :
+    sizeof(default_sizes)/sizeof(*default_sizes);
+
+  int status = 0;
+
+  printf("%6s %-9s %12s %12s %12s %12s %10s\n", "size", "mesher", "vertices",
+         "triangles", "float (KiB)", "packed (KiB)", "time (ms)");
+
+  for (size_t i = 0; i < size_count; i++) {
+    size_t size = argc > 0 ? strtoul(argv[i], NULL, 10) : default_sizes[i];
+    size_t n = size*size*size;
+
+    GLfloat *noise = malloc(sizeof(*noise)*n);
+    if (!noise) return 1;
+
+    /* Same features as the 30³ level, repeated over larger volumes. */
+    perlin3d_cpu(size, size, size, noise, 3, (vec3){0, 0, 0},
+                 (vec3){1.0/30, 1.0/30, 1.0/30}, BenchSeed);
+
+    occupancy_volume occupancy;
+    occupancy_init(&occupancy);
+
+    /* The naive mesher builds the most squares. */
+    size_t square_count = 0;
+    if (occupancy_from_noise(&occupancy, size, size, size, noise,
+                             DensityThreshold) == 0)
+      square_count = count_squares(NoiseMesherNaive, &occupancy);
+
+    vertex *vertices = malloc(sizeof(*vertices)*4*square_count);
+    GLuint *indices  = malloc(sizeof(*indices)*6*square_count);
+    if (square_count == 0 || !vertices || !indices) {
+      fprintf(stderr, "Not enough memory to mesh a %zu³ volume.\n", size);
+      free(indices);
+      free(vertices);
+      occupancy_release(&occupancy);
+      free(noise);
+      return 1;
+    }
+
+    scratch_buffer mask;
+    scratch_init(&mask);
+
+    for (size_t mesher = 0; mesher <= NoiseMesherGreedy; mesher++) {
+      size_t vertex_count, index_count;
+      double best = INFINITY;
+
+      for (size_t rep = 0; rep < BenchRepetitions; rep++) {
+        double t = timer_now();
+        if (mesh_volume(mesher, &occupancy, &mask, vertices, indices,
+                        &vertex_count, &index_count) != 0) {
+          status = 1;
+          break;
+        }
+        t = timer_now() - t;
+        if (t < best) best = t;
+      }
+
+      if (best == INFINITY) continue;
+
+      size_t index_bytes = index_count*sizeof(GLushort);
+      size_t float_bytes = vertex_count*sizeof(vertex) + index_bytes;
+      size_t packed_bytes = vertex_count*sizeof(packed_vertex) + index_bytes;
+      printf("%6zu %-9s %12zu %12zu %12.1f %12.1f %10.3f\n", size,
+             mesher_names[mesher], vertex_count, index_count/3,
+             float_bytes/1024.0, packed_bytes/1024.0, best*1e3);
+    }
+
+    scratch_release(&mask);
+
+    if (has_gl && size == LevelWidth && size == LevelHeight &&
+        size == LevelDepth) {
+      if (compare_images(noise) != 0)
+        status = 1;
+    }
+
+    free(indices);
+    free(vertices);
+    occupancy_release(&occupancy);
+    free(noise);
+  }
+
+  return status;
+}
+
+/* Visible faces of a float volume, checked one voxel and one neighbour at a
+ * time, as the meshers did before working on occupancy volumes. */
+static size_t count_faces_per_voxel(size_t size, const GLfloat *noise) {
+  static const int offsets[6][3] = {
+    {-1, 0, 0}, {+1, 0, 0}, {0, -1, 0}, {0, +1, 0}, {0, 0, -1}, {0, 0, +1},
+  };
+
+  size_t count = 0;
+  for (size_t z = 0; z < size; z++) {
+    for (size_t y = 0; y < size; y++) {
+      for (size_t x = 0; x < size; x++) {
+        if (noise[x + (y + z*size)*size] < DensityThreshold)
+          continue;
+
+        for (size_t f = 0; f < 6; f++) {
+          size_t nx = x + offsets[f][0], ny = y + offsets[f][1];
+          size_t nz = z + offsets[f][2];
+          count += nx >= size || ny >= size || nz >= size ||
+            noise[nx + (ny + nz*size)*size] < DensityThreshold;
+        }
+      }
+    }
+  }
+
+  return count;
+}
+
+/* Thresholds Perlin volumes into occupancy volumes, with the scalar and the
+ * best kernels, and counts their visible faces word by word, against the
+ * same count done voxel by voxel on the floats. */
+static int bench_occupancy(int argc, char **argv, int has_gl) {
+  static const size_t default_sizes[] = {64, 256};
+
+  size_t size_count = argc > 0 ? (size_t)argc :
+    sizeof(default_sizes)/sizeof(*default_sizes);
+
+  noise_cpu_isa best_isa = noise_cpu_best_isa();
+  int status = 0;
+
+  printf("%6s %12s %12s %12s %12s %12s %12s %8s\n", "size", "float (KiB)",
+         "bits (KiB)", "scalar (ms)", "simd (ms)", "voxels (ms)",
+         "words (ms)", "speedup");
+
+  for (size_t i = 0; i < size_count; i++) {
+    size_t size = argc > 0 ? strtoul(argv[i], NULL, 10) : default_sizes[i];
+    size_t n = size*size*size;
+
+    GLfloat *noise = malloc(sizeof(*noise)*n);
+    if (!noise) {
+      fprintf(stderr, "Not enough memory for a %zu³ volume.\n", size);
+      status = 1;
+      continue;
+    }
+
+    /* Same features as the 30³ level, repeated over larger volumes. */
+    perlin3d_cpu(size, size, size, noise, 3, (vec3){0, 0, 0},
+                 (vec3){1.0/30, 1.0/30, 1.0/30}, BenchSeed);
+
+    occupancy_volume occupancy;
+    occupancy_init(&occupancy);
+
+    double threshold_time[2] = {INFINITY, INFINITY};
+    for (size_t pass = 0; pass < 2; pass++) {
+      noise_cpu_set_isa(pass == 0 ? NoiseCpuScalar : best_isa);
+      for (size_t rep = 0; rep < BenchRepetitions; rep++) {
+        double t = timer_now();
+        if (occupancy_from_noise(&occupancy, size, size, size, noise,
+                                 DensityThreshold) != 0)
+          status = 1;
+        t = timer_now() - t;
+        if (t < threshold_time[pass]) threshold_time[pass] = t;
+      }
+    }
+
+    noise_cpu_set_isa(best_isa);
+
+    size_t voxel_count = 0, word_count = 0;
+    double voxel_time = INFINITY, word_time = INFINITY;
+    for (size_t rep = 0; rep < BenchRepetitions; rep++) {
+      double t = timer_now();
+      voxel_count = count_faces_per_voxel(size, noise);
+      t = timer_now() - t;
+      if (t < voxel_time) voxel_time = t;
+
+      /* Without the box. */
+      t = timer_now();
+      word_count = count_squares(NoiseMesherCulled, &occupancy) - 6;
+      t = timer_now() - t;
+      if (t < word_time) word_time = t;
+    }
+
+    size_t solid = 0;
+    for (size_t j = 0; j < n; j++)
+      solid += noise[j] >= DensityThreshold;
+
+    if (voxel_count != word_count || solid != occupancy_count(&occupancy)) {
+      fprintf(stderr, "%zu³: %zu faces and %zu solid voxels expected, "
+              "%zu and %zu found.\n", size, voxel_count, solid, word_count,
+              occupancy_count(&occupancy));
+      status = 1;
+    }
+
+    printf("%6zu %12.1f %12.1f %12.3f %12.3f %12.3f %12.3f %7.1fx\n", size,
+           n*sizeof(*noise)/1024.0, occupancy_size(&occupancy)/1024.0,
+           threshold_time[0]*1e3, threshold_time[1]*1e3, voxel_time*1e3,
+           word_time*1e3, voxel_time/word_time);
+
+    occupancy_release(&occupancy);
+    free(noise);
+  }
+
+  return status;
+}
+
+/* Fills a size³ occupancy mask with the GPU generator of kind in octave mode
+ * mode, BenchRepetitions times, and returns the best time. */
+static double time_gpu_octaves(noise_kind kind, size_t size, vec4 scale,
+                               size_t octave_count, noise_octave_mode mode,
+                               void *mask) {
+  vec4 start = BenchStart;
+  vec3 start3 = {start.x, start.y, start.z};
+  vec3 scale3 = {scale.x, scale.y, scale.z};
+
+  noise_set_octave_mode(mode);
+
+  double best = INFINITY;
+  for (size_t i = 0; i < BenchRepetitions; i++) {
+    double t;
+    if (kind == NoisePerlin4d || kind == NoiseSimplex4d) {
+      perlin4d_gen gen;
+      if (kind == NoisePerlin4d)
+        perlin4d_init(&gen, size, size, size, octave_count, start, scale,
+                      BenchSeed);
+      else
+        simplex4d_init(&gen, size, size, size, octave_count, start, scale,
+                       BenchSeed);
+      perlin4d_set_output(&gen, NoiseOutputOccupancy, DensityThreshold);
+      glFinish();
+      t = timer_now();
+      perlin4d_slice(&gen, BenchSliceW, mask);
+      t = timer_now() - t;
+      perlin4d_release(&gen);
+    }
+    else {
+      perlin3d_gen gen;
+      if (kind == NoisePerlin3d) perlin3d_init(&gen, BenchSeed);
+      else simplex3d_init(&gen, BenchSeed);
+      perlin3d_set_output(&gen, NoiseOutputOccupancy, DensityThreshold);
+
+      glFinish();
+      t = timer_now();
+      perlin3d_generate(&gen, size, size, size, mask,
+                        octave_count, start3, scale3);
+      t = timer_now() - t;
+      perlin3d_release(&gen);
+    }
+
+    if (t < best) best = t;
+  }
+
+  return best;
+}
+
+/* Same as time_cpu, with or without lazy octaves, thresholded into
+ * occupancy. */
+static double time_cpu_octaves(noise_kind kind, size_t size, vec4 scale,
+                               size_t octave_count, int lazy,
+                               GLfloat *noise, occupancy_volume *occupancy) {
+  vec4 start = BenchStart;
+  vec3 start3 = {start.x, start.y, start.z};
+  vec3 scale3 = {scale.x, scale.y, scale.z};
+
+  double best = INFINITY;
+  for (size_t i = 0; i < BenchRepetitions; i++) {
+    double t;
+    if (kind == NoisePerlin4d || kind == NoiseSimplex4d) {
+      perlin4d_cpu_gen gen;
+      if (kind == NoisePerlin4d)
+        perlin4d_cpu_init(&gen, size, size, size, octave_count, start, scale,
+                          BenchSeed);
+      else
+        simplex4d_cpu_init(&gen, size, size, size, octave_count, start,
+                           scale, BenchSeed);
+      perlin4d_cpu_set_lazy(&gen, lazy, DensityThreshold);
+      t = timer_now();
+      perlin4d_cpu_slice(&gen, BenchSliceW, noise);
+      t = timer_now() - t;
+      perlin4d_cpu_release(&gen);
+    }
+    else {
+      noise3d_cpu_gen gen;
+      noise3d_cpu_init(&gen, kind, octave_count, scale3, BenchSeed);
+      noise3d_cpu_set_lazy(&gen, lazy, DensityThreshold);
+      t = timer_now();
+      noise3d_cpu_fill(&gen, size, size, size, noise, start3);
+      t = timer_now() - t;
+      noise3d_cpu_release(&gen);
+    }
+
+    if (t < best) best = t;
+  }
+
+  occupancy_from_noise(occupancy, size, size, size, noise, DensityThreshold);
+  return best;
+}
+
+static void print_octaves(size_t size, noise_kind kind, size_t octave_count,
+                          const char *backend, double all, double lazy,
+                          noise_octave_stats stats, int same) {
+  double voxels = stats.voxels ? stats.voxels : 1;
+  printf("%6zu %-10s %8zu %-8s %10.3f %10.3f %8.2f %10.2f %8.1f%% %8s\n",
+         size, noise_kind_names[kind], octave_count, backend, all*1e3,
+         lazy*1e3, all/lazy, stats.octaves/voxels,
+         100*stats.skipped/voxels, same ? "same" : "DIFFERENT");
+}
+
+/* Generates occupancy masks with every octave and with early exits, on the
+ * CPU and the GPU, checks that they are the same and reports the average
+ * number of octaves evaluated per voxel, and the share of voxels in boxes
+ * that noise_bounds.h decided without evaluating any. Those get more common
+ * as lattice cells span more voxels. */
+static int bench_octaves(int argc, char **argv, int has_gl) {
+  static const size_t octave_counts[] = {3, 5};
+
+  size_t size = argc > 0 ? strtoul(argv[0], NULL, 10) : 128;
+  double cell = argc > 1 ? strtod(argv[1], NULL) : 1/BenchScale.x;
+  if (!(cell > 0)) {
+    fprintf(stderr, "Lattice cells must span a positive number of "
+            "voxels.\n");
+    return 1;
+  }
+
+  vec4 scale = BenchScale;
+  scale.x = scale.y = scale.z = 1/cell;
+  size_t n = size*size*size;
+  size_t mask_size = noise_output_size(NoiseOutputOccupancy, n);
+
+  GLfloat *noise = malloc(sizeof(*noise)*n);
+  void *all_mask = malloc(mask_size), *lazy_mask = malloc(mask_size);
+  if (!noise || !all_mask || !lazy_mask) {
+    fprintf(stderr, "Failed to allocate a %zu^3 volume.\n", size);
+    free(lazy_mask);
+    free(all_mask);
+    free(noise);
+    return 1;
+  }
+
+  occupancy_volume all, lazy;
+  occupancy_init(&all);
+  occupancy_init(&lazy);
+
+  int status = 0;
+
+  printf("%6s %-10s %8s %-8s %10s %10s %8s %10s %9s %8s\n", "size",
+         "generator", "octaves", "backend", "all (ms)", "lazy (ms)",
+         "speedup", "evaluated", "skipped", "masks");
+
+  for (noise_kind kind = NoisePerlin3d; kind < NoiseWhite; kind++) {
+    for (size_t i = 0; i < sizeof(octave_counts)/sizeof(*octave_counts);
+         i++) {
+      size_t octave_count = octave_counts[i];
+
+      if (has_gl) {
+        double t_all = time_gpu_octaves(kind, size, scale, octave_count,
+                                        NoiseOctavesAll, all_mask);
+        double t_lazy = time_gpu_octaves(kind, size, scale, octave_count,
+                                         NoiseOctavesLazy, lazy_mask);
+        int same = memcmp(all_mask, lazy_mask, mask_size) == 0;
+
+        /* Counting slows the shaders down, so it gets a pass of its own. */
+        noise_take_octave_stats();
+        time_gpu_octaves(kind, size, scale, octave_count,
+                         NoiseOctavesCounted, lazy_mask);
+        noise_octave_stats stats = noise_take_octave_stats();
+        same = same && memcmp(all_mask, lazy_mask, mask_size) == 0;
+
+        print_octaves(size, kind, octave_count, "gpu", t_all, t_lazy, stats,
+                      same);
+        if (!same) status = 1;
+      }
+
+      double t_all = time_cpu_octaves(kind, size, scale, octave_count, 0,
+                                      noise, &all);
+      noise_cpu_take_octave_stats();
+      double t_lazy = time_cpu_octaves(kind, size, scale, octave_count, 1,
+                                       noise, &lazy);
+      noise_octave_stats stats = noise_cpu_take_octave_stats();
+      int same = memcmp(all.words, lazy.words, occupancy_size(&all)) == 0;
+
+      print_octaves(size, kind, octave_count,
+                    noise_cpu_isa_name(noise_cpu_current_isa()),
+                    t_all, t_lazy, stats, same);
+      if (!same) status = 1;
+    }
+  }
+
+  noise_set_octave_mode(NoiseOctavesLazy);
+
+  occupancy_release(&lazy);
+  occupancy_release(&all);
+  free(lazy_mask);
+  free(all_mask);
+  free(noise);
+
+  return status;
+}
+
+/* One octave of Perlin noise at the frequency given by scale, with or
+ * without cell tables, on the GPU or the CPU. */
+static double time_cells(noise_kind kind, size_t size, vec4 scale, int gpu,
+                         int cells, GLfloat *noise) {
+  vec4 start = BenchStart;
+  vec3 start3 = {start.x, start.y, start.z};
+  vec3 scale3 = {scale.x, scale.y, scale.z};
+
+  noise_set_cell_tables(cells);
+  noise_cpu_set_cell_tables(cells);
+
+  double best = INFINITY;
+  for (size_t i = 0; i < BenchRepetitions; i++) {
+    double t;
+    if (kind == NoisePerlin4d && gpu) {
+      perlin4d_gen gen;
+      perlin4d_init(&gen, size, size, size, 1, start, scale, BenchSeed);
+      glFinish();
+      t = timer_now();
+      perlin4d_slice(&gen, BenchSliceW, noise);
+      t = timer_now() - t;
+      perlin4d_release(&gen);
+    }
+    else if (kind == NoisePerlin4d) {
+      perlin4d_cpu_gen gen;
+      perlin4d_cpu_init(&gen, size, size, size, 1, start, scale, BenchSeed);
+      t = timer_now();
+      perlin4d_cpu_slice(&gen, BenchSliceW, noise);
+      t = timer_now() - t;
+      perlin4d_cpu_release(&gen);
+    }
+    else if (gpu) {
+      perlin3d_gen gen;
+      perlin3d_init(&gen, BenchSeed);
+      glFinish();
+      t = timer_now();
+      perlin3d_generate(&gen, size, size, size, noise, 1, start3, scale3);
+      t = timer_now() - t;
+      perlin3d_release(&gen);
+    }
+    else {
+      t = timer_now();
+      perlin3d_cpu(size, size, size, noise, 1, start3, scale3, BenchSeed);
+      t = timer_now() - t;
+    }
+
+    if (t < best) best = t;
+  }
+
+  return best;
+}
+
+/* Times single octaves of Perlin noise at the frequencies of a sum's first
+ * octaves, with and without cell tables (see noise_set_cell_tables), and
+ * checks that both give the same values. Lattice cells span half as many
+ * voxels with each octave, until the tables no longer fit and both run the
+ * same code. */
+static int bench_cells(int argc, char **argv, int has_gl) {
+  static const noise_kind kinds[] = {NoisePerlin3d, NoisePerlin4d};
+  static const size_t frequency_count = 6;
+
+  size_t size = argc > 0 ? strtoul(argv[0], NULL, 10) : 128;
+  size_t n = size*size*size;
+
+  GLfloat *hashed = malloc(sizeof(*hashed)*n);
+  GLfloat *tables = malloc(sizeof(*tables)*n);
+  if (!hashed || !tables) {
+    fprintf(stderr, "Failed to allocate a %zu^3 volume.\n", size);
+    free(tables);
+    free(hashed);
+    return 1;
+  }
+
+  int gpu_cells = noise_cell_tables();
+  int cpu_cells = noise_cpu_cell_tables();
+  int status = 0;
+
+  printf("%6s %-10s %9s %8s %-8s %11s %10s %8s %9s\n", "size", "generator",
+         "frequency", "cell", "backend", "hashed (ms)", "cells (ms)",
+         "speedup", "values");
+
+  for (size_t i = 0; i < sizeof(kinds)/sizeof(*kinds); i++) {
+    for (size_t octave = 0; octave < frequency_count; octave++) {
+      double frequency = 1 << octave;
+      vec4 scale = BenchScale;
+      scale.x *= frequency;
+      scale.y *= frequency;
+      scale.z *= frequency;
+      scale.w *= frequency;
+
+      for (int gpu = has_gl; gpu >= 0; gpu--) {
+        double t_hashed = time_cells(kinds[i], size, scale, gpu, 0, hashed);
+        double t_cells = time_cells(kinds[i], size, scale, gpu, 1, tables);
+        int same = memcmp(hashed, tables, sizeof(*hashed)*n) == 0;
+
+        printf("%6zu %-10s %9.0f %8.2f %-8s %11.3f %10.3f %8.2f %9s\n",
+               size, noise_kind_names[kinds[i]], frequency, 1/scale.x,
+               gpu ? "gpu" : noise_cpu_isa_name(noise_cpu_current_isa()),
+               t_hashed*1e3, t_cells*1e3, t_hashed/t_cells,
+               same ? "same" : "DIFFERENT");
+        if (!same) status = 1;
+      }
+    }
+  }
+
+  noise_set_cell_tables(gpu_cells);
+  noise_cpu_set_cell_tables(cpu_cells);
+
+  free(tables);
+  free(hashed);
+
+  return status;
+}
+
+/* Animates the level like --perlin4d --cpu-mesher, with the noise computed
+ * ahead of time so that frames only build, upload and draw the geometry. */
+static int bench_render(int argc, char **argv, int has_gl) {
+  if (!has_gl) {
+    fprintf(stderr, "The render benchmark needs a GL context.\n");
+    return 1;
+  }
+
+  size_t frames = argc > 0 ? strtoul(argv[0], NULL, 10) : 60;
+  size_t size   = argc > 1 ? strtoul(argv[1], NULL, 10) : LevelWidth;
+  if (frames == 0 || size == 0) return 0;
+
+  size_t n = size*size*size;
+  GLfloat *noise = malloc(sizeof(*noise)*n*frames);
+  if (!noise) {
+    fprintf(stderr, "Not enough memory for %zu slices.\n", frames);
+    return 1;
+  }
+
+  /* Same features as the 30³ level, repeated over larger volumes. */
+  perlin4d_cpu_gen gen;
+  perlin4d_cpu_init(&gen, size, size, size, 3, BenchStart, BenchScale,
+                    BenchSeed);
+  for (size_t i = 0; i < frames; i++)
+    perlin4d_cpu_slice(&gen, i*0.016, noise + i*n);
+  perlin4d_cpu_release(&gen);
+
+  int status = 0;
+
+  printf("%-9s %-8s %12s %14s %12s %12s %8s %10s\n", "mode", "format",
+         "build (ms)", "upload (KiB)", "frame (ms)", "worst (ms)", "allocs",
+         "GPU (KiB)");
+
+  for (size_t i = 0; i < MesherCount*FormatCount; i++) {
+    noise_mesher mesher = i % MesherCount;
+    noise_vertex_format format = i / MesherCount;
+
+    noise_renderer renderer;
+    if (noise_renderer_init(&renderer, NoiseAnimated, mesher, format,
+                            size, size, size) != 0) {
+      printf("%-9s %-8s %12s\n", mesher_names[mesher], format_names[format],
+             "too large");
+      continue;
+    }
+
+    double build = 0, upload = 0;
+    frame_stats stats = {0, 0, 0, 0};
+    size_t allocations = scratch_allocation_count();
+
+    glFinish();
+    for (size_t j = 0; j < frames; j++) {
+      double t = timer_now();
+      render(&renderer);
+      if (generate_geometry(&renderer, noise + j*n) != 0) status = 1;
+      glFinish();
+      add_frame(&stats, timer_now() - t);
+
+      build  += renderer.stats.mesh_time;
+      upload += renderer.stats.upload_bytes;
+    }
+
+    printf("%-9s %-8s %12.3f %14.1f %12.3f %12.3f %8zu %10.1f\n",
+           mesher_names[mesher], format_names[format], build/frames*1e3,
+           upload/frames/1024, stats.total/frames*1e3, stats.worst*1e3,
+           scratch_allocation_count() - allocations,
+           noise_renderer_gpu_bytes(&renderer)/1024.0);
+
+    noise_renderer_release(&renderer);
+  }
+
+  printf("peak RSS: %.1f MiB\n", peak_rss()/(1024.0*1024.0));
+
+  free(noise);
+  return status;
+}
+
+/* Flies through the world like --chunks, speed times faster than the camera
+ * moves in main.c. Frames are paced at 60 per second, as with vsync, so that
+ * the workers have as much time to keep up as they would in the program. */
+static int bench_chunks(int argc, char **argv, int has_gl) {
+  if (!has_gl) {
+    fprintf(stderr, "The chunk benchmark needs a GL context.\n");
+    return 1;
+  }
+
+  size_t frames = argc > 0 ? strtoul(argv[0], NULL, 10) : 600;
+  double speed  = argc > 1 ? strtod(argv[1], NULL) : 4;
+  if (frames == 0) return 0;
+
+  int status = 0;
+
+  printf("%-9s %10s %10s %8s %8s %8s %8s %10s\n", "mode", "mean (ms)",
+         "worst (ms)", "pending", "meshed", "evicted", "resident", "MiB");
+
+  static const noise_mesher meshers[] = {NoiseMesherCulled, NoiseMesherGreedy};
+  for (size_t i = 0; i < sizeof(meshers)/sizeof(*meshers); i++) {
+    noise_renderer renderer;
+    noise_renderer_init(&renderer, NoiseConstant, meshers[i], NoiseVertexFloat,
+                        ChunkSize, ChunkSize, ChunkSize);
+
+    chunk_manager manager;
+    if (chunk_manager_init(&manager, NoisePerlin3d, 3, BenchSeed, meshers[i],
+                           NoiseVertexFloat, DefaultChunkRadius,
+                           DefaultChunkBudget, 0) != 0) {
+      fprintf(stderr, "Failed to start the chunk manager.\n");
+      noise_renderer_release(&renderer);
+      status = 1;
+      continue;
+    }
+
+    camera camera;
+    camera_init(&camera, 1);
+
+    frame_stats stats = {0, 0, 0, 0};
+    size_t pending = 0;
+    glFinish();
+    for (size_t j = 0; j < frames; j++) {
+      double t = timer_now();
+      chunk_manager_update(&manager, camera.eye);
+      chunk_manager_render(&manager, &renderer, camera_view(&camera),
+                           camera_projection(&camera));
+      glFinish();
+
+      double frame_time = timer_now() - t;
+      add_frame(&stats, frame_time);
+      pending += chunk_manager_stats(&manager).pending;
+
+      camera_move(&camera, speed*CameraMoveSpeed/60, 0, 0);
+      timer_sleep(1.0/60 - frame_time);
+    }
+
+    chunk_stats chunks = chunk_manager_stats(&manager);
+    printf("%-9s %10.3f %10.3f %8.1f %8zu %8zu %8zu %10.1f\n",
+           mesher_names[meshers[i]], stats.total/frames*1e3, stats.worst*1e3,
+           (double)pending/frames, chunks.meshed, chunks.evicted,
+           chunks.resident, chunks.bytes/(1024.0*1024.0));
+
+    chunk_manager_release(&manager);
+    noise_renderer_release(&renderer);
+  }
+
+  return status;
+}
+
+static const char *volume_format_names[] = {"float", "unorm16"};
+
+/* Generates a volume on the CPU, then writes it to the cache in each format
+ * and loads it back, touching every sample so that the whole mapping is read
+ * from disk. */
+static int bench_cache(int argc, char **argv, int has_gl) {
+  size_t size = argc > 0 ? strtoul(argv[0], NULL, 10) : 256;
+  size_t n = size*size*size;
+
+  GLfloat *noise  = malloc(sizeof(*noise)*n);
+  GLfloat *loaded = malloc(sizeof(*loaded)*n);
+  if (!noise || !loaded) {
+    fprintf(stderr, "Failed to allocate %zu^3 volumes.\n", size);
+    free(loaded);
+    free(noise);
+    return 1;
+  }
+
+  int status = 0;
+
+  printf("%-10s %-8s %14s %10s %10s %10s %10s\n", "generator", "format",
+         "generate (ms)", "write (ms)", "load (ms)", "MiB", "max error");
+
+  static const noise_kind kinds[] = {NoisePerlin3d, NoisePerlin4d};
+  for (size_t i = 0; i < sizeof(kinds)/sizeof(*kinds); i++) {
+    noise_kind kind = kinds[i];
+    vec4 start = BenchStart, scale = BenchScale;
+    if (kind != NoisePerlin4d) start.w = scale.w = 0;
+
+    volume_key key;
+    volume_key_init(&key, kind, BenchSeed, size, size, size, 3, start, scale,
+                    kind == NoisePerlin4d ? BenchSliceW : 0);
+
+    char path[4096];
+    if (volume_cache_path(&key, path, sizeof(path)) != 0) {
+      fprintf(stderr, "No cache directory.\n");
+      status = 1;
+      break;
+    }
+
+    double generate = time_cpu(kind, size, 3, noise);
+
+    /* VolumeUnorm16 rounds samples to the nearest of 65536 steps over the
+     * volume's range; this allows for a whole step. */
+    GLfloat min = noise[0], max = noise[0];
+    for (size_t j = 1; j < n; j++) {
+      if (noise[j] < min) min = noise[j];
+      if (noise[j] > max) max = noise[j];
+    }
+    double tolerance = (max - min)/UINT16_MAX;
+
+    for (volume_format format = VolumeFloat; format <= VolumeUnorm16;
+         format++) {
+      double write = timer_now();
+      if (volume_file_write(path, &key, format, noise) != 0) {
+        fprintf(stderr, "Failed to write %s.\n", path);
+        status = 1;
+        continue;
+      }
+      write = timer_now() - write;
+
+      double load = timer_now();
+      volume_file file;
+      if (volume_file_open(&file, path, &key) != 0) {
+        fprintf(stderr, "Failed to load %s.\n", path);
+        status = 1;
+        continue;
+      }
+
+      /* The mapping is what would be handed to the mesher; the copy only
+       * makes sure every page is read. */
+      volume_file_read(&file, loaded);
+      load = timer_now() - load;
+
+      double error = max_difference(noise, loaded, n);
+      if (error > (format == VolumeFloat ? 0 : tolerance))
+        status = 1;
+
+      printf("%-10s %-8s %14.3f %10.3f %10.3f %10.1f %10.3g\n",
+             noise_kind_names[kind], volume_format_names[format],
+             generate*1e3, write*1e3, load*1e3,
+             file.map_size/(1024.0*1024.0), error);
+
+      volume_file_close(&file);
+    }
+
+    /* Any other parameter must miss. */
+    volume_key other = key;
+    other.seed++;
+    volume_file file;
+    if (volume_file_open(&file, path, &other) == 0) {
+      fprintf(stderr, "A volume was loaded for the wrong key.\n");
+      volume_file_close(&file);
+      status = 1;
+    }
+
+    remove(path);
+  }
+
+  free(loaded);
+  free(noise);
+
+  return status;
+}
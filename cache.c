@@ -0,0 +1,50 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+static int append(char *path, size_t size, size_t *length,
+                  const char *prefix, const char *str) {
+  int n = snprintf(path + *length, size - *length, "%s%s", prefix, str);
+  if (n < 0 || (size_t)n >= size - *length)
+    return -1;
+
+  *length += n;
+  return 0;
+}
+
+static int make_dir(const char *path) {
+  return mkdir(path, 0755) == 0 || errno == EEXIST ? 0 : -1;
+}
+
+int cache_path(const char *name, char *path, size_t size) {
+  const char *xdg  = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+
+  size_t length = 0;
+  if (size == 0) return -1;
+  path[0] = '\0';
+
+  if (xdg && *xdg) {
+    if (append(path, size, &length, "", xdg) != 0)
+      return -1;
+  }
+  else if (home && *home) {
+    if (append(path, size, &length, "", home) != 0 ||
+        append(path, size, &length, "/", ".cache") != 0 ||
+        make_dir(path) != 0)
+      return -1;
+  }
+  else
+    return -1;
+
+  if (append(path, size, &length, "/", "gl_noise") != 0 ||
+      make_dir(path) != 0)
+    return -1;
+
+  return append(path, size, &length, "/", name);
+}
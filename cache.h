@@ -0,0 +1,13 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include <stddef.h>
+
+/**
+ * Writes the path of a file called name in the program's cache directory
+ * ($XDG_CACHE_HOME/gl_noise, or ~/.cache/gl_noise) to path, creating the
+ * directory if needed. Returns 0 on success.
+ */
+int cache_path(const char *name, char *path, size_t size);
+
+#endif
@@ -0,0 +1,532 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "chunk_manager.h"
+#include "scratch.h"
+#include "thread_pool.h"
+
+static void *chunk_worker(void *data);
+
+static int compare_offsets(const void *a, const void *b) {
+  const int *u = a, *v = b;
+  int du = u[0]*u[0] + u[1]*u[1] + u[2]*u[2];
+  int dv = v[0]*v[0] + v[1]*v[1] + v[2]*v[2];
+  if (du != dv) return du < dv ? -1 : 1;
+
+  /* Keeps the order the same on every platform. */
+  for (size_t i = 0; i < 3; i++) {
+    if (u[i] != v[i]) return u[i] < v[i] ? -1 : 1;
+  }
+
+  return 0;
+}
+
+int chunk_manager_init(chunk_manager *manager, noise_kind kind,
+                       size_t octave_count, uint64_t seed, noise_mesher mesher,
+                       noise_vertex_format format, int radius, size_t budget,
+                       size_t worker_count) {
+  if (mesher == NoiseMesherInstanced || radius < 0)
+    goto fail_args;
+
+  manager->mesher = mesher;
+  manager->format = format;
+  manager->radius = radius;
+  manager->budget = budget;
+  manager->frame  = 0;
+  manager->quit   = 0;
+  memset(&manager->stats, 0, sizeof(manager->stats));
+
+  size_t side = 2*radius + 1;
+  manager->offsets = malloc(sizeof(*manager->offsets)*side*side*side);
+  if (!manager->offsets)
+    goto fail_alloc_offsets;
+
+  manager->offset_count = 0;
+  for (int z = -radius; z <= radius; z++) {
+    for (int y = -radius; y <= radius; y++) {
+      for (int x = -radius; x <= radius; x++) {
+        if (x*x + y*y + z*z > radius*radius)
+          continue;
+
+        int *offset = manager->offsets[manager->offset_count++];
+        offset[0] = x;
+        offset[1] = y;
+        offset[2] = z;
+      }
+    }
+  }
+
+  qsort(manager->offsets, manager->offset_count, sizeof(*manager->offsets),
+        compare_offsets);
+
+  /* Room to keep as many chunks out of range as in range, budget
+   * permitting. */
+  manager->chunk_count = 2*manager->offset_count;
+  manager->chunks = calloc(manager->chunk_count, sizeof(*manager->chunks));
+  if (!manager->chunks)
+    goto fail_alloc_chunks;
+
+  manager->visible = malloc(sizeof(*manager->visible)*manager->chunk_count);
+  if (!manager->visible)
+    goto fail_alloc_visible;
+  manager->visible_count = 0;
+
+  manager->table_size = 1;
+  while (manager->table_size < 2*manager->chunk_count)
+    manager->table_size *= 2;
+  manager->table = calloc(manager->table_size, sizeof(*manager->table));
+  if (!manager->table)
+    goto fail_alloc_table;
+
+  noise3d_cpu_init(&manager->gen, kind, octave_count,
+                   (vec3){ChunkNoiseScale, ChunkNoiseScale, ChunkNoiseScale},
+                   seed);
+  /* Chunks only keep which voxels are above the threshold. */
+  noise3d_cpu_set_lazy(&manager->gen, 1, DensityThreshold);
+
+  if (worker_count == 0) {
+    worker_count = thread_pool_default_size();
+    if (worker_count > 1) worker_count--;
+  }
+
+  manager->workers = malloc(sizeof(*manager->workers)*worker_count);
+  if (!manager->workers)
+    goto fail_alloc_workers;
+
+  pthread_mutex_init(&manager->lock, NULL);
+  pthread_cond_init(&manager->work, NULL);
+
+  for (manager->worker_count = 0; manager->worker_count < worker_count;
+       manager->worker_count++) {
+    if (pthread_create(&manager->workers[manager->worker_count], NULL,
+                       chunk_worker, manager) != 0)
+      goto fail_create_workers;
+  }
+
+  return 0;
+
+fail_create_workers:
+  pthread_mutex_lock(&manager->lock);
+  manager->quit = 1;
+  pthread_cond_broadcast(&manager->work);
+  pthread_mutex_unlock(&manager->lock);
+  for (size_t i = 0; i < manager->worker_count; i++)
+    pthread_join(manager->workers[i], NULL);
+
+  pthread_cond_destroy(&manager->work);
+  pthread_mutex_destroy(&manager->lock);
+  free(manager->workers);
+fail_alloc_workers:  noise3d_cpu_release(&manager->gen);
+                     free(manager->table);
+fail_alloc_table:    free(manager->visible);
+fail_alloc_visible:  free(manager->chunks);
+fail_alloc_chunks:   free(manager->offsets);
+fail_alloc_offsets:
+fail_args:           return -1;
+}
+
+static void free_chunk(chunk_manager *manager, chunk *c);
+
+void chunk_manager_release(chunk_manager *manager) {
+  pthread_mutex_lock(&manager->lock);
+  manager->quit = 1;
+  pthread_cond_broadcast(&manager->work);
+  pthread_mutex_unlock(&manager->lock);
+
+  for (size_t i = 0; i < manager->worker_count; i++)
+    pthread_join(manager->workers[i], NULL);
+
+  for (size_t i = 0; i < manager->chunk_count; i++) {
+    if (manager->chunks[i].state != ChunkFree)
+      free_chunk(manager, &manager->chunks[i]);
+  }
+
+  pthread_cond_destroy(&manager->work);
+  pthread_mutex_destroy(&manager->lock);
+
+  free(manager->workers);
+  noise3d_cpu_release(&manager->gen);
+  free(manager->table);
+  free(manager->visible);
+  free(manager->chunks);
+  free(manager->offsets);
+}
+
+static size_t hash_position(const chunk_manager *manager, int x, int y, int z) {
+  unsigned hash = (unsigned)x*73856093u ^ (unsigned)y*19349663u ^
+    (unsigned)z*83492791u;
+  return hash & (manager->table_size - 1);
+}
+
+static chunk *find_chunk(chunk_manager *manager, int x, int y, int z) {
+  size_t i = hash_position(manager, x, y, z);
+  for (; manager->table[i] != 0; i = (i + 1) & (manager->table_size - 1)) {
+    chunk *c = &manager->chunks[manager->table[i] - 1];
+    if (c->x == x && c->y == y && c->z == z)
+      return c;
+  }
+
+  return NULL;
+}
+
+static void insert_chunk(chunk_manager *manager, chunk *c) {
+  size_t i = hash_position(manager, c->x, c->y, c->z);
+  while (manager->table[i] != 0)
+    i = (i + 1) & (manager->table_size - 1);
+
+  manager->table[i] = c - manager->chunks + 1;
+}
+
+/* Moves the entries that follow the removed one back, so that lookups never
+ * stop at a hole before reaching their chunk. */
+static void remove_chunk(chunk_manager *manager, chunk *c) {
+  size_t mask = manager->table_size - 1;
+  size_t index = c - manager->chunks + 1;
+
+  size_t i = hash_position(manager, c->x, c->y, c->z);
+  while (manager->table[i] != index)
+    i = (i + 1) & mask;
+  manager->table[i] = 0;
+
+  for (size_t j = (i + 1) & mask; manager->table[j] != 0; j = (j + 1) & mask) {
+    const chunk *other = &manager->chunks[manager->table[j] - 1];
+    size_t home = hash_position(manager, other->x, other->y, other->z);
+
+    /* Entries whose home is cyclically in (i, j] are already reachable. */
+    int reachable = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+    if (!reachable) {
+      manager->table[i] = manager->table[j];
+      manager->table[j] = 0;
+      i = j;
+    }
+  }
+}
+
+static size_t chunk_bytes(const chunk *c) {
+  return c->vertex_bytes + c->index_count*sizeof(GLushort);
+}
+
+static void free_chunk(chunk_manager *manager, chunk *c) {
+  if (c->state == ChunkMeshed || c->state == ChunkUploaded)
+    manager->stats.bytes -= chunk_bytes(c);
+
+  if (c->has_mesh)
+    noise_mesh_release(&c->mesh);
+  free(c->indices);
+  free(c->vertices);
+
+  remove_chunk(manager, c);
+
+  c->state = ChunkFree;
+  c->has_mesh = 0;
+  c->vertices = NULL;
+  c->indices  = NULL;
+  c->vertex_bytes = c->index_count = 0;
+}
+
+/* The chunk out of range used least recently that no worker is building. */
+static chunk *least_recently_used(chunk_manager *manager) {
+  chunk *best = NULL;
+  for (size_t i = 0; i < manager->chunk_count; i++) {
+    chunk *c = &manager->chunks[i];
+    if ((c->state == ChunkMeshed || c->state == ChunkUploaded) &&
+        c->last_used != manager->frame &&
+        (!best || c->last_used < best->last_used))
+      best = c;
+  }
+
+  return best;
+}
+
+static chunk *new_chunk(chunk_manager *manager) {
+  for (size_t i = 0; i < manager->chunk_count; i++) {
+    if (manager->chunks[i].state == ChunkFree)
+      return &manager->chunks[i];
+  }
+
+  chunk *c = least_recently_used(manager);
+  if (c) {
+    free_chunk(manager, c);
+    manager->stats.evicted++;
+  }
+
+  return c;
+}
+
+static void upload_chunk(chunk *c, noise_vertex_format format) {
+  if (c->index_count != 0) {
+    if (!c->has_mesh) {
+      noise_mesh_init(&c->mesh, format);
+      c->has_mesh = 1;
+    }
+
+    noise_mesh_upload(&c->mesh, c->vertices, c->vertex_bytes,
+                      c->indices, c->index_count);
+  }
+
+  free(c->indices);
+  free(c->vertices);
+  c->vertices = NULL;
+  c->indices  = NULL;
+
+  c->state = ChunkUploaded;
+}
+
+void chunk_manager_update(chunk_manager *manager, vec3 eye) {
+  int cx = floorf(eye.x / ChunkSize);
+  int cy = floorf(eye.y / ChunkSize);
+  int cz = floorf(eye.z / ChunkSize);
+
+  pthread_mutex_lock(&manager->lock);
+  manager->frame++;
+
+  /* Marks the chunks in range first, so that none of them gets evicted to
+   * make room for the others. */
+  for (size_t i = 0; i < manager->offset_count; i++) {
+    const int *offset = manager->offsets[i];
+    chunk *c = find_chunk(manager, cx + offset[0], cy + offset[1],
+                          cz + offset[2]);
+    if (c) {
+      c->last_used = manager->frame;
+      c->priority  = i;
+    }
+  }
+
+  /* Chunks that went out of range before a worker got to them aren't needed
+   * anymore. */
+  for (size_t i = 0; i < manager->chunk_count; i++) {
+    chunk *c = &manager->chunks[i];
+    if (c->state == ChunkQueued && c->last_used != manager->frame)
+      free_chunk(manager, c);
+  }
+
+  int queued = 0;
+  for (size_t i = 0; i < manager->offset_count; i++) {
+    const int *offset = manager->offsets[i];
+    int x = cx + offset[0], y = cy + offset[1], z = cz + offset[2];
+    if (find_chunk(manager, x, y, z))
+      continue;
+
+    chunk *c = new_chunk(manager);
+    if (!c)
+      break;
+
+    c->x = x;
+    c->y = y;
+    c->z = z;
+    c->state = ChunkQueued;
+    c->last_used = manager->frame;
+    c->priority  = i;
+    insert_chunk(manager, c);
+    queued = 1;
+  }
+
+  if (queued)
+    pthread_cond_broadcast(&manager->work);
+
+  size_t uploaded_bytes = 0;
+  for (size_t i = 0; i < manager->offset_count &&
+         uploaded_bytes < ChunkUploadBudget; i++) {
+    const int *offset = manager->offsets[i];
+    chunk *c = find_chunk(manager, cx + offset[0], cy + offset[1],
+                          cz + offset[2]);
+    if (c && c->state == ChunkMeshed) {
+      upload_chunk(c, manager->format);
+      uploaded_bytes += chunk_bytes(c);
+      manager->stats.uploaded++;
+    }
+  }
+
+  while (manager->stats.bytes > manager->budget) {
+    chunk *c = least_recently_used(manager);
+    if (!c) break;
+
+    free_chunk(manager, c);
+    manager->stats.evicted++;
+  }
+
+  manager->stats.resident = manager->stats.pending = 0;
+  manager->visible_count = 0;
+  for (size_t i = 0; i < manager->chunk_count; i++) {
+    const chunk *c = &manager->chunks[i];
+    if (c->state == ChunkQueued || c->state == ChunkMeshing)
+      manager->stats.pending++;
+    else if (c->state != ChunkFree)
+      manager->stats.resident++;
+
+    if (c->state == ChunkUploaded && c->has_mesh &&
+        c->last_used == manager->frame)
+      manager->visible[manager->visible_count++] = i;
+  }
+
+  pthread_mutex_unlock(&manager->lock);
+}
+
+chunk_stats chunk_manager_stats(chunk_manager *manager) {
+  pthread_mutex_lock(&manager->lock);
+  chunk_stats stats = manager->stats;
+  pthread_mutex_unlock(&manager->lock);
+
+  return stats;
+}
+
+void chunk_manager_render(chunk_manager *manager, noise_renderer *renderer,
+                          mat4 view, mat4 projection) {
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  /* Workers never touch uploaded chunks, so this doesn't need the lock. */
+  for (size_t i = 0; i < manager->visible_count; i++) {
+    const chunk *c = &manager->chunks[manager->visible[i]];
+    vec3 origin = {
+      (GLfloat)c->x*ChunkSize, (GLfloat)c->y*ChunkSize,
+      (GLfloat)c->z*ChunkSize,
+    };
+
+    /* Skips chunks entirely behind the camera, which looks down -z. */
+    vec3 center = mat4_apply(view, vec3_add(origin, (vec3){
+          ChunkSize/2.0, ChunkSize/2.0, ChunkSize/2.0}));
+    if (center.z > ChunkSize)
+      continue;
+
+    set_mvp(renderer, mat4_translation(origin), view, projection);
+    render_mesh(renderer, &c->mesh);
+  }
+}
+
+typedef struct chunk_scratch {
+  scratch_buffer noise, vertices, indices, mask;
+  occupancy_volume occupancy;
+} chunk_scratch;
+
+/* Fills the chunk and a layer of its neighbours with noise and meshes it into
+ * newly allocated arrays, which are left NULL if the mesh is empty. Returns
+ * -1 if memory runs out. */
+static int build_chunk(const chunk_manager *manager, chunk_scratch *scratch,
+                       int x, int y, int z,
+                       void **vertices, GLushort **indices,
+                       size_t *vertex_bytes, size_t *index_count) {
+  const size_t n = ChunkSize + 2;
+
+  GLfloat *noise = scratch_reserve(&scratch->noise, sizeof(*noise)*n*n*n);
+  if (!noise)
+    return -1;
+
+  vec3 start = {
+    ((GLfloat)x*ChunkSize - 1)*ChunkNoiseScale,
+    ((GLfloat)y*ChunkSize - 1)*ChunkNoiseScale,
+    ((GLfloat)z*ChunkSize - 1)*ChunkNoiseScale,
+  };
+  noise3d_cpu_fill(&manager->gen, n, n, n, noise, start);
+
+  if (occupancy_from_noise(&scratch->occupancy, n, n, n, noise,
+                           DensityThreshold) != 0)
+    return -1;
+
+  size_t square_count = count_chunk_squares(manager->mesher,
+                                            &scratch->occupancy);
+  if (square_count == 0)
+    return 0;
+
+  vertex *mesh_vertices = scratch_reserve(&scratch->vertices,
+                                          4*square_count*sizeof(vertex));
+  GLuint *mesh_indices = scratch_reserve(&scratch->indices,
+                                         6*square_count*sizeof(GLuint));
+  if (!mesh_vertices || !mesh_indices)
+    return -1;
+
+  size_t vertex_count;
+  if (mesh_chunk(manager->mesher, &scratch->occupancy,
+                 &scratch->mask, mesh_vertices, mesh_indices,
+                 &vertex_count, index_count) != 0)
+    return -1;
+
+  size_t vertex_size = sizeof(vertex);
+  if (manager->format == NoiseVertexPacked) {
+    pack_vertices(vertex_count, mesh_vertices);
+    vertex_size = sizeof(packed_vertex);
+  }
+
+  pack_indices(*index_count, mesh_indices);
+
+  /* Copied out at their final size, since the mesh is kept around. */
+  *vertex_bytes = vertex_count*vertex_size;
+  *vertices = malloc(*vertex_bytes);
+  *indices  = malloc(*index_count*sizeof(GLushort));
+  if (!*vertices || !*indices) {
+    free(*indices);
+    free(*vertices);
+    *vertices = NULL;
+    *indices  = NULL;
+    return -1;
+  }
+
+  memcpy(*vertices, mesh_vertices, *vertex_bytes);
+  memcpy(*indices, mesh_indices, *index_count*sizeof(GLushort));
+
+  return 0;
+}
+
+/* The queued chunk nearest to the camera. */
+static chunk *next_chunk(chunk_manager *manager) {
+  chunk *best = NULL;
+  for (size_t i = 0; i < manager->chunk_count; i++) {
+    chunk *c = &manager->chunks[i];
+    if (c->state == ChunkQueued && (!best || c->priority < best->priority))
+      best = c;
+  }
+
+  return best;
+}
+
+static void *chunk_worker(void *data) {
+  chunk_manager *manager = data;
+
+  chunk_scratch scratch;
+  scratch_init(&scratch.noise);
+  scratch_init(&scratch.vertices);
+  scratch_init(&scratch.indices);
+  scratch_init(&scratch.mask);
+  occupancy_init(&scratch.occupancy);
+
+  pthread_mutex_lock(&manager->lock);
+  while (!manager->quit) {
+    chunk *c = next_chunk(manager);
+    if (!c) {
+      pthread_cond_wait(&manager->work, &manager->lock);
+      continue;
+    }
+
+    c->state = ChunkMeshing;
+    int x = c->x, y = c->y, z = c->z;
+    pthread_mutex_unlock(&manager->lock);
+
+    void *vertices = NULL;
+    GLushort *indices = NULL;
+    size_t vertex_bytes = 0, index_count = 0;
+
+    /* A chunk that can't be built is left empty rather than retried. */
+    if (build_chunk(manager, &scratch, x, y, z, &vertices, &indices,
+                    &vertex_bytes, &index_count) != 0)
+      vertex_bytes = index_count = 0;
+
+    pthread_mutex_lock(&manager->lock);
+    c->vertices = vertices;
+    c->indices  = indices;
+    c->vertex_bytes = vertex_bytes;
+    c->index_count  = index_count;
+    c->state = ChunkMeshed;
+
+    manager->stats.bytes += chunk_bytes(c);
+    manager->stats.meshed++;
+  }
+  pthread_mutex_unlock(&manager->lock);
+
+  occupancy_release(&scratch.occupancy);
+  scratch_release(&scratch.mask);
+  scratch_release(&scratch.indices);
+  scratch_release(&scratch.vertices);
+  scratch_release(&scratch.noise);
+
+  return NULL;
+}
@@ -0,0 +1,130 @@
+#ifndef CHUNK_MANAGER_H_
+#define CHUNK_MANAGER_H_
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "noise_cpu.h"
+#include "noise_gen.h"
+#include "noise_renderer.h"
+#include "vector_math.h"
+
+/* Chunks are cubes of ChunkSize³ voxels, the chunk at x, y, z starting at the
+ * voxel x*ChunkSize, y*ChunkSize, z*ChunkSize. */
+#define ChunkSize 32
+
+/* Noise coordinates per voxel. A power of two, so that the samples shared by
+ * neighbouring chunks come out exactly the same in each of them. */
+#define ChunkNoiseScale (1.0/32)
+
+#define DefaultChunkRadius 4                /* chunks */
+#define DefaultChunkBudget (256*1024*1024)  /* bytes */
+
+/* Meshes uploaded each frame, beyond the first one, stop at this many bytes so
+ * that crossing into new chunks doesn't make a frame take longer. */
+#define ChunkUploadBudget (2*1024*1024)
+
+typedef enum chunk_state {
+  ChunkFree,
+  ChunkQueued,   /* waiting for a worker */
+  ChunkMeshing,  /* owned by a worker */
+  ChunkMeshed,   /* mesh built, waiting to be uploaded */
+  ChunkUploaded,
+} chunk_state;
+
+typedef struct chunk {
+  int x, y, z;
+  chunk_state state;
+
+  size_t priority;          /* lower is nearer the camera */
+  unsigned long last_used;  /* last frame the chunk was in range */
+
+  /* Built by a worker in the renderer's format, freed once uploaded. */
+  void *vertices;
+  GLushort *indices;
+  size_t vertex_bytes, index_count;
+
+  noise_mesh mesh;
+  int has_mesh;
+} chunk;
+
+typedef struct chunk_stats {
+  size_t meshed;    /* chunks built by the workers */
+  size_t uploaded;
+  size_t evicted;
+  size_t resident;  /* chunks with a mesh, on the CPU or the GPU */
+  size_t pending;   /* chunks queued or being built */
+  size_t bytes;     /* size of the resident meshes */
+} chunk_stats;
+
+/**
+ * Streams an endless world around the camera: every chunk within a radius of
+ * it is filled with noise and meshed on background threads, then uploaded by
+ * chunk_manager_update, nearest first. Meshes of chunks that fall out of range
+ * are kept until the memory budget is exceeded, and the ones used least
+ * recently are evicted first.
+ */
+typedef struct chunk_manager {
+  noise3d_cpu_gen gen;
+  noise_mesher mesher;
+  noise_vertex_format format;
+
+  int radius;
+  size_t budget;
+
+  chunk *chunks;
+  size_t chunk_count;
+
+  /* Open addressing table of chunk indices plus one, 0 marking free cells. */
+  size_t *table;
+  size_t table_size;
+
+  /* Positions of the chunks in range relative to the camera's, nearest
+   * first. */
+  int (*offsets)[3];
+  size_t offset_count;
+
+  unsigned long frame;
+  chunk_stats stats;
+
+  /* Chunks chunk_manager_render draws, picked by the last update. */
+  size_t *visible;
+  size_t visible_count;
+
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_t *workers;
+  size_t worker_count;
+  int quit;
+} chunk_manager;
+
+/**
+ * Creates worker_count threads meshing chunks of kind noise (NoisePerlin3d or
+ * NoiseSimplex3d), seeded with seed, with the given mesher, which can't be
+ * NoiseMesherInstanced. If worker_count is 0, uses one thread per processor
+ * but one. Returns -1 on failure.
+ */
+int chunk_manager_init(chunk_manager *manager, noise_kind kind,
+                       size_t octave_count, uint64_t seed, noise_mesher mesher,
+                       noise_vertex_format format, int radius, size_t budget,
+                       size_t worker_count);
+void chunk_manager_release(chunk_manager *manager);
+
+/**
+ * Queues the chunks around eye that aren't built yet, uploads the meshes
+ * finished since the last call and evicts meshes to stay within the budget.
+ * Called once per frame; it never waits for the workers.
+ */
+void chunk_manager_update(chunk_manager *manager, vec3 eye);
+
+/** A copy of the manager's statistics, which the workers keep updating. */
+chunk_stats chunk_manager_stats(chunk_manager *manager);
+
+/**
+ * Clears the framebuffer and draws the uploaded chunks in range with
+ * renderer's program, which must use the manager's vertex format.
+ */
+void chunk_manager_render(chunk_manager *manager, noise_renderer *renderer,
+                          mat4 view, mat4 projection);
+
+#endif
@@ -1,11 +1,15 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <time.h>
 #include <string.h>
 
 #include "noise_renderer.h"
 #include "noise_gen.h"
+#include "noise_cpu.h"
+#include "chunk_manager.h"
+#include "volume_cache.h"
 #include "camera.h"
 #include "vector_math.h"
 
@@ -14,15 +18,19 @@
 #define ScreenWidth  640
 #define ScreenHeight 480
 
+/* Features are about as large as the default level, whatever its size. */
 #define NoiseStart (vec3){0, 0, 0}
-#define NoiseScale (vec3){1.0/LevelWidth, 1.0/LevelHeight, 1.0/LevelDepth}
+#define NoiseScale (vec3){1.0/DefaultLevelWidth, 1.0/DefaultLevelHeight, \
+                          1.0/DefaultLevelDepth}
 #define OctaveCount 3
 
 #define AnimatedNoiseStart (vec4){0, 0, 0, 0}
-#define AnimatedNoiseScale (vec4){1.0/LevelWidth, 1.0/LevelHeight, \
-                                  1.0/LevelDepth, 0.1}
+#define AnimatedNoiseScale (vec4){1.0/DefaultLevelWidth,  \
+                                  1.0/DefaultLevelHeight, \
+                                  1.0/DefaultLevelDepth, 0.1}
 
 static int has_option(int argc, char **argv, char *opt);
+static const char *option_value(int argc, char **argv, char *opt);
 
 void gl_debug(GLenum source, GLenum type, GLuint id,
               GLenum severity, GLsizei length,
@@ -33,7 +41,31 @@ void gl_debug(GLenum source, GLenum type, GLuint id,
 int main(int argc, char **argv) {
   int status = 0;
 
-  srand(time(NULL));
+  uint64_t seed = time(NULL);
+  const char *seed_option = option_value(argc, argv, "--seed");
+  if (seed_option) {
+    char *end;
+    seed = strtoull(seed_option, &end, 10);
+    if (*end != '\0') {
+      fprintf(stderr, "Expected --seed N.\n");
+      status = 1;
+      goto fail_init_glfw;
+    }
+  }
+
+  const char *hash_option = option_value(argc, argv, "--hash");
+  if (hash_option) {
+    if (strcmp(hash_option, "table") == 0)
+      noise_set_hash_mode(NoiseHashTable);
+    else if (strcmp(hash_option, "integer") == 0)
+      noise_set_hash_mode(NoiseHashInteger);
+    else {
+      fprintf(stderr, "Expected --hash table or --hash integer.\n");
+      status = 1;
+      goto fail_init_glfw;
+    }
+  }
+
 
   if (!glfwInit()) {
     fprintf(stderr, "Failed to initialize GLFW.\n");
@@ -84,7 +116,25 @@ int main(int argc, char **argv) {
     glDebugMessageCallback(gl_debug, NULL);
   }
 
-  GLfloat *noise = malloc(sizeof(*noise)*LevelWidth*LevelHeight*LevelDepth);
+  size_t level_width  = DefaultLevelWidth;
+  size_t level_height = DefaultLevelHeight;
+  size_t level_depth  = DefaultLevelDepth;
+
+  const char *size = option_value(argc, argv, "--size");
+  if (size) {
+    int n = sscanf(size, "%zux%zux%zu", &level_width, &level_height,
+                   &level_depth);
+    if (n == 1)
+      level_height = level_depth = level_width;
+    else if (n != 3) {
+      fprintf(stderr, "Expected --size N or --size WxHxD.\n");
+      status = 1;
+      goto fail_alloc_noise;
+    }
+  }
+
+  GLfloat *noise = malloc(sizeof(*noise)*level_width*level_height*
+                          level_depth);
   if (!noise) {
     fprintf(stderr, "Failed to create noise buffer.\n");
     status = 1;
@@ -92,29 +142,174 @@ int main(int argc, char **argv) {
   }
 
   perlin4d_gen gen;
+  perlin4d_cpu_gen cpu_gen;
+  perlin4d_async async;
   int animated = 0;
+  int use_async = 0;
+  int use_cpu = has_option(argc, argv, "--cpu");
+  int use_greedy = has_option(argc, argv, "--greedy");
+  int use_gpu_mesher = !use_cpu && !use_greedy &&
+    !has_option(argc, argv, "--cpu-mesher");
+  int use_chunks = has_option(argc, argv, "--chunks");
+  int use_simplex4d = has_option(argc, argv, "--simplex4d");
+
+  volume_file volume;
+  int cached = 0;
+
+  int chunk_radius = DefaultChunkRadius;
+  const char *radius = option_value(argc, argv, "--radius");
+  if (radius && sscanf(radius, "%d", &chunk_radius) != 1) {
+    fprintf(stderr, "Expected --radius N.\n");
+    status = 1;
+    goto fail_init_renderer;
+  }
 
-  if (has_option(argc, argv, "--test"))
-    single_cell(LevelWidth, LevelHeight, LevelDepth, noise, 5, 5, 5);
+  /* Only the 4D generators read slices back more than once. */
+  noise_output_format output = NoiseOutputFloat;
+  const char *output_option = option_value(argc, argv, "--output");
+  if (output_option) {
+    while (output <= NoiseOutputOccupancy &&
+           strcmp(output_option, noise_output_name(output)) != 0)
+      output++;
+
+    if (output > NoiseOutputOccupancy) {
+      fprintf(stderr, "Expected --output float, unorm16, unorm8 or "
+              "occupancy.\n");
+      status = 1;
+      goto fail_init_renderer;
+    }
+
+    /* The GPU mesher reads floats. */
+    use_gpu_mesher = 0;
+  }
+
+  /* Only volumes generated from a known seed can be found again. */
+  int is_3d = !use_chunks && !has_option(argc, argv, "--test") &&
+    !has_option(argc, argv, "--white") &&
+    !has_option(argc, argv, "--perlin4d") && !use_simplex4d;
+  int use_cache = seed_option && is_3d && has_option(argc, argv, "--cache");
+
+  volume_key key;
+  char volume_path[4096];
+  if (use_cache) {
+    vec3 start = NoiseStart, scale = NoiseScale;
+    volume_key_init(&key, has_option(argc, argv, "--simplex") ?
+                    NoiseSimplex3d : NoisePerlin3d, seed,
+                    level_width, level_height, level_depth, OctaveCount,
+                    (vec4){start.x, start.y, start.z, 0},
+                    (vec4){scale.x, scale.y, scale.z, 0}, 0);
+    if (volume_cache_path(&key, volume_path, sizeof(volume_path)) != 0)
+      use_cache = 0;
+    else
+      cached = volume_file_open(&volume, volume_path, &key) == 0;
+  }
+
+  const GLfloat *level = cached ? volume.noise : noise;
+
+  if (use_chunks) {
+    /* The chunk manager fills each chunk as it streams it in. */
+  }
+  else if (has_option(argc, argv, "--test"))
+    single_cell(level_width, level_height, level_depth, noise, 5, 5, 5);
   else if (has_option(argc, argv, "--white"))
-    white_noise(LevelWidth, LevelHeight, LevelDepth, noise);
-  else if (has_option(argc, argv, "--simplex"))
-    simplex3d(LevelWidth, LevelHeight, LevelDepth, noise,
-              OctaveCount, NoiseStart, NoiseScale);
-  else if (has_option(argc, argv, "--perlin4d")) {
-    perlin4d_init(&gen, LevelWidth, LevelHeight, LevelDepth, OctaveCount,
-                  AnimatedNoiseStart, AnimatedNoiseScale);
-    perlin4d_slice(&gen, 0, noise);
+    white_noise(level_width, level_height, level_depth, noise, seed);
+  else if (cached) {
+    /* Mapped from the cache, and used without being copied. */
+  }
+  else if (has_option(argc, argv, "--simplex")) {
+    if (use_cpu)
+      simplex3d_cpu(level_width, level_height, level_depth, noise,
+                    OctaveCount, NoiseStart, NoiseScale, seed);
+    else
+      simplex3d(level_width, level_height, level_depth, noise,
+                OctaveCount, NoiseStart, NoiseScale, seed);
+  }
+  else if (has_option(argc, argv, "--perlin4d") || use_simplex4d) {
+    /* Both 4D generators have the same type, so the rest of the program
+     * doesn't need to know which one is used. */
+    if (use_cpu) {
+      if (use_simplex4d)
+        simplex4d_cpu_init(&cpu_gen, level_width, level_height, level_depth,
+                           OctaveCount, AnimatedNoiseStart,
+                           AnimatedNoiseScale, seed);
+      else
+        perlin4d_cpu_init(&cpu_gen, level_width, level_height, level_depth,
+                          OctaveCount, AnimatedNoiseStart,
+                          AnimatedNoiseScale, seed);
+      /* Slices are only ever thresholded by generate_geometry. */
+      perlin4d_cpu_set_lazy(&cpu_gen, 1, DensityThreshold);
+      perlin4d_cpu_slice(&cpu_gen, 0, noise);
+    }
+    else {
+      if (use_simplex4d)
+        simplex4d_init(&gen, level_width, level_height, level_depth,
+                       OctaveCount, AnimatedNoiseStart, AnimatedNoiseScale,
+                       seed);
+      else
+        perlin4d_init(&gen, level_width, level_height, level_depth,
+                      OctaveCount, AnimatedNoiseStart, AnimatedNoiseScale,
+                      seed);
+      perlin4d_set_output(&gen, output, DensityThreshold);
+      perlin4d_slice(&gen, 0, noise);
+
+      if (!use_gpu_mesher && !has_option(argc, argv, "--sync")) {
+        use_async = perlin4d_async_init(&async, &gen,
+                                        DefaultPipelineDepth) == 0;
+      }
+    }
     animated = 1;
   }
+  else if (use_cpu)
+    perlin3d_cpu(level_width, level_height, level_depth, noise,
+                 OctaveCount, NoiseStart, NoiseScale, seed);
   else
-    perlin3d(LevelWidth, LevelHeight, LevelDepth, noise,
-             OctaveCount, NoiseStart, NoiseScale);
+    perlin3d(level_width, level_height, level_depth, noise,
+             OctaveCount, NoiseStart, NoiseScale, seed);
+
+  if (use_cache && !cached &&
+      volume_file_write(volume_path, &key, VolumeFloat, noise) != 0)
+    fprintf(stderr, "Failed to write %s.\n", volume_path);
+
+  noise_mesher mesher = NoiseMesherCulled;
+  if (use_greedy)
+    mesher = NoiseMesherGreedy;
+  else if (has_option(argc, argv, "--instanced") && !use_chunks)
+    mesher = NoiseMesherInstanced;
+  else if (has_option(argc, argv, "--all-faces"))
+    mesher = NoiseMesherNaive;
+
+  noise_vertex_format format = has_option(argc, argv, "--packed") ?
+    NoiseVertexPacked : NoiseVertexFloat;
+
+  /* Chunks are drawn one by one with the renderer's program. */
+  if (use_chunks)
+    level_width = level_height = level_depth = ChunkSize;
 
   noise_renderer prog;
-  noise_renderer_init(&prog, animated ? NoiseAnimated : NoiseConstant);
+  if (noise_renderer_init(&prog, animated ? NoiseAnimated : NoiseConstant,
+                          mesher, format,
+                          level_width, level_height, level_depth) != 0) {
+    fprintf(stderr, "Levels can't be larger than %d cubes across, or %d "
+            "with --instanced.\n", MaxLevelSize, MaxInstancedLevelSize);
+    status = 1;
+    goto fail_init_renderer;
+  }
 
-  if (generate_geometry(&prog, noise) != 0) {
+  if (animated && !use_cpu)
+    noise_renderer_set_input(&prog, output);
+
+  chunk_manager chunks;
+  if (use_chunks) {
+    noise_kind kind = has_option(argc, argv, "--simplex") ?
+      NoiseSimplex3d : NoisePerlin3d;
+    if (chunk_manager_init(&chunks, kind, OctaveCount, seed, mesher, format,
+                           chunk_radius, DefaultChunkBudget, 0) != 0) {
+      fprintf(stderr, "Failed to start streaming chunks.\n");
+      status = 1;
+      goto fail_generate_geometry;
+    }
+  }
+  else if (generate_geometry(&prog, level) != 0) {
     fprintf(stderr, "An error occured while generating noise.\n");
     status = 1;
     goto fail_generate_geometry;
@@ -134,14 +329,45 @@ int main(int argc, char **argv) {
   float old_time = glfwGetTime();
   float start_time = old_time;
   while (!glfwWindowShouldClose(window)) {
-    set_mvp(&prog,
-            Mat4Identity,
-            camera_view(&camera),
-            camera_projection(&camera));
-    render(&prog);
-
-    if (animated) {
-      perlin4d_slice(&gen, glfwGetTime() - start_time, noise);
+    if (use_chunks) {
+      chunk_manager_update(&chunks, camera.eye);
+      chunk_manager_render(&chunks, &prog, camera_view(&camera),
+                           camera_projection(&camera));
+    }
+    else {
+      set_mvp(&prog,
+              Mat4Identity,
+              camera_view(&camera),
+              camera_projection(&camera));
+      render(&prog);
+    }
+
+    if (animated && use_gpu_mesher) {
+      /* The noise and the mesh stay on the GPU. */
+      perlin4d_dispatch(&gen, glfwGetTime() - start_time);
+      generate_geometry_gpu(&prog, gen.shader_output);
+    }
+    else if (animated && use_async) {
+      /* Uses whichever slice the GPU finished since the last frame, if any,
+       * and keeps the pipeline full. Neither call waits for the GPU. */
+      const void *slice = perlin4d_async_try_acquire(&async, NULL);
+      if (slice) {
+        int ret = generate_geometry(&prog, slice);
+        perlin4d_async_recycle(&async);
+        if (ret != 0) {
+          fprintf(stderr, "An error occured while generating noise.\n");
+          status = 1;
+          goto fail_generate_mid_loop;
+        }
+      }
+
+      perlin4d_async_submit(&async, glfwGetTime() - start_time);
+    }
+    else if (animated) {
+      if (use_cpu)
+        perlin4d_cpu_slice(&cpu_gen, glfwGetTime() - start_time, noise);
+      else
+        perlin4d_slice(&gen, glfwGetTime() - start_time, noise);
       if (generate_geometry(&prog, noise) != 0) {
         fprintf(stderr, "An error occured while generating noise.\n");
         status = 1;
@@ -178,9 +404,13 @@ int main(int argc, char **argv) {
     glfwPollEvents();
   }
 
-fail_generate_mid_loop: noise_renderer_release(&prog);
-fail_generate_geometry: free(noise);
-fail_alloc_noise:       glfwDestroyWindow(window);
+fail_generate_mid_loop: if (use_async) perlin4d_async_release(&async);
+                        if (use_chunks) chunk_manager_release(&chunks);
+fail_generate_geometry: noise_renderer_release(&prog);
+fail_init_renderer:     if (cached) volume_file_close(&volume);
+                        free(noise);
+fail_alloc_noise:       noise_release_programs();
+                        glfwDestroyWindow(window);
 fail_create_window:     glfwTerminate();
 fail_init_glfw:         return status;
 }
@@ -193,3 +423,12 @@ static int has_option(int argc, char **argv, char *opt) {
 
   return 0;
 }
+
+static const char *option_value(int argc, char **argv, char *opt) {
+  for (int i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i], opt) == 0)
+      return argv[i + 1];
+  }
+
+  return NULL;
+}
@@ -0,0 +1,579 @@
+#include <float.h>
+#include <math.h>
+
+#include "noise_bounds.h"
+
+/* Relative error allowed on the positions, which the generators compute with
+ * a multiply and an add in single precision. */
+#define BoxPadding (16*FLT_EPSILON)
+
+/* Squared radius of a simplex corner's falloff, and the factors the kernels
+ * scale the sum of the corners by. */
+#define SimplexRadius2 0.6
+#define Simplex3dScale (8*16)
+#define Simplex4dScale 370
+
+typedef struct interval {
+  double min, max;
+} interval;
+
+static interval interval_add(interval a, interval b) {
+  interval ret = {a.min + b.min, a.max + b.max};
+  return ret;
+}
+
+static interval interval_scale(interval a, double k) {
+  interval ret = {k*a.min, k*a.max};
+  if (k < 0) {
+    ret.min = k*a.max;
+    ret.max = k*a.min;
+  }
+  return ret;
+}
+
+static interval interval_hull(interval a, interval b) {
+  interval ret = {fmin(a.min, b.min), fmax(a.max, b.max)};
+  return ret;
+}
+
+static interval interval_mul(interval a, interval b) {
+  double p[4] = {a.min*b.min, a.min*b.max, a.max*b.min, a.max*b.max};
+  interval ret = {p[0], p[0]};
+  for (int i = 1; i < 4; i++) {
+    ret.min = fmin(ret.min, p[i]);
+    ret.max = fmax(ret.max, p[i]);
+  }
+  return ret;
+}
+
+static interval interval_square(interval a) {
+  double lo = a.min*a.min, hi = a.max*a.max;
+  interval ret = {fmin(lo, hi), fmax(lo, hi)};
+  if (a.min <= 0 && a.max >= 0)
+    ret.min = 0;
+  return ret;
+}
+
+/* mix(a, b, t) = a*(1 - t) + b*t is linear in t and, with t between 0 and 1,
+ * grows with a and b, so its extremes are reached at the ends of each
+ * interval. */
+static interval interval_mix(interval a, interval b, interval t) {
+  interval ret = {
+    fmin(a.min*(1 - t.min) + b.min*t.min, a.min*(1 - t.max) + b.min*t.max),
+    fmax(a.max*(1 - t.min) + b.max*t.min, a.max*(1 - t.max) + b.max*t.max),
+  };
+  return ret;
+}
+
+static double perlin_smoothstep(double t) {
+  return t*t*t*(t*(t*6 - 15) + 10);
+}
+
+static int is_4d(noise_kind kind) {
+  return kind == NoisePerlin4d || kind == NoiseSimplex4d;
+}
+
+/* dot(pos - corner, g) for every pos of the box, corner being the unskewed
+ * position of lattice point p. */
+static interval corner_dot(const noise_cpu_tables *tables, int dims,
+                           const long p[4], const double corner[4],
+                           const double min[4], const double max[4]) {
+  GLuint g = noise_cpu_gradient_index(tables, dims, p);
+
+  interval ret = {0, 0};
+  for (int a = 0; a < dims; a++) {
+    double component = dims == 4 ? tables->gradients4d[a][g] :
+      tables->gradients3d[a][g];
+    interval d = {min[a] - corner[a], max[a] - corner[a]};
+    ret = interval_add(ret, interval_scale(d, component));
+  }
+
+  return ret;
+}
+
+/* Derivative of perlin_smoothstep, 30t²(1 - t)², which grows up to t = 1/2
+ * and shrinks past it. */
+static interval smoothstep_slope(interval t) {
+  double a = 30*t.min*t.min*(1 - t.min)*(1 - t.min);
+  double b = 30*t.max*t.max*(1 - t.max)*(1 - t.max);
+
+  interval ret = {fmin(a, b), fmax(a, b)};
+  if (t.min <= 0.5 && t.max >= 0.5)
+    ret.max = 30.0/16;
+  return ret;
+}
+
+/* Perlin noise over the part of the box inside a lattice cell, where it is a
+ * polynomial. Mixing the intervals of the corners' dot products, one axis at a
+ * time as the kernels do, treats them as independent, which makes the bounds
+ * wider than the noise. For small boxes, the mean value theorem gives tighter
+ * ones: the noise at the box's center, plus the bounds of its derivative times
+ * the distance to the center. Both hold, so the result is their
+ * intersection. */
+static interval perlin_cell(const noise_cpu_tables *tables, int dims,
+                            const long cell[4],
+                            const double min[4], const double max[4]) {
+  /* A corner's weight is the product of t along the axes it is on the far
+   * side of, and of 1 - t along the others, all of them between 0 and 1. */
+  double mid[4], half[4], mid_weights[4][2];
+  interval weights[4][2], slope[4];
+  for (int a = 0; a < dims; a++) {
+    mid[a]  = (min[a] + max[a])/2;
+    half[a] = (max[a] - min[a])/2;
+
+    double t0 = perlin_smoothstep(min[a] - cell[a]);
+    double t1 = perlin_smoothstep(max[a] - cell[a]);
+    weights[a][0] = (interval){1 - t1, 1 - t0};
+    weights[a][1] = (interval){t0, t1};
+
+    mid_weights[a][1] = perlin_smoothstep(mid[a] - cell[a]);
+    mid_weights[a][0] = 1 - mid_weights[a][1];
+
+    slope[a] = smoothstep_slope((interval){min[a] - cell[a],
+                                           max[a] - cell[a]});
+  }
+
+  interval values[16];
+  double value = 0;
+  interval derivative[4] = {{0, 0}, {0, 0}, {0, 0}, {0, 0}};
+
+  for (int i = 0; i < 1 << dims; i++) {
+    long p[4];
+    double g[4];
+    GLuint index;
+    for (int a = 0; a < dims; a++)
+      p[a] = cell[a] + (i >> a & 1);
+    index = noise_cpu_gradient_index(tables, dims, p);
+
+    interval dot = {0, 0};
+    double mid_dot = 0, mid_weight = 1;
+    interval weight = {1, 1};
+    for (int a = 0; a < dims; a++) {
+      g[a] = dims == 4 ? tables->gradients4d[a][index] :
+        tables->gradients3d[a][index];
+
+      interval d = {min[a] - p[a], max[a] - p[a]};
+      dot = interval_add(dot, interval_scale(d, g[a]));
+      mid_dot += g[a]*(mid[a] - p[a]);
+
+      interval w = weights[a][i >> a & 1];
+      mid_weight *= mid_weights[a][i >> a & 1];
+      weight.min *= w.min;
+      weight.max *= w.max;
+    }
+
+    values[i] = dot;
+    value += mid_weight*mid_dot;
+
+    /* The derivative of weight*dot along a. */
+    for (int a = 0; a < dims; a++) {
+      interval others = slope[a];
+      for (int b = 0; b < dims; b++) {
+        if (b != a) {
+          others.min *= weights[b][i >> b & 1].min;
+          others.max *= weights[b][i >> b & 1].max;
+        }
+      }
+
+      interval term = interval_mul(interval_scale(others,
+                                                  i >> a & 1 ? 1 : -1),
+                                   dot);
+      term = interval_add(term, interval_scale(weight, g[a]));
+      derivative[a] = interval_add(derivative[a], term);
+    }
+  }
+
+  for (int a = dims - 1; a >= 0; a--) {
+    for (int i = 0; i < 1 << a; i++)
+      values[i] = interval_mix(values[i], values[i + (1 << a)],
+                               weights[a][1]);
+  }
+
+  double spread = 0;
+  for (int a = 0; a < dims; a++)
+    spread += fmax(fabs(derivative[a].min), fabs(derivative[a].max))*half[a];
+
+  interval ret = {fmax(values[0].min, value - spread),
+                  fmin(values[0].max, value + spread)};
+  return interval_scale(ret, 16);
+}
+
+/* Steps through the lattice points between first and last, inclusive, x
+ * fastest. Returns 0 past the last one. */
+static int next_point(int dims, const long first[4], const long last[4],
+                      long p[4]) {
+  for (int a = 0; a < dims; a++) {
+    if (p[a] < last[a]) {
+      p[a]++;
+      return 1;
+    }
+    p[a] = first[a];
+  }
+
+  return 0;
+}
+
+/* Returns 0 if the box covers more than NoiseBoundMaxCorners corners. */
+static int perlin_octave(const noise_cpu_tables *tables, int dims,
+                         const double min[4], const double max[4],
+                         interval *ret) {
+  long first[4], last[4];
+  size_t corners = (size_t)1 << dims;
+  for (int a = 0; a < dims; a++) {
+    first[a] = floor(min[a]);
+    last[a]  = floor(max[a]);
+    corners *= last[a] - first[a] + 1;
+    if (corners > NoiseBoundMaxCorners)
+      return 0;
+  }
+
+  long cell[4] = {first[0], first[1], first[2], first[3]};
+  int found = 0;
+  do {
+    double cell_min[4], cell_max[4];
+    for (int a = 0; a < dims; a++) {
+      cell_min[a] = fmax(min[a], cell[a]);
+      cell_max[a] = fmin(max[a], cell[a] + 1);
+    }
+
+    interval value = perlin_cell(tables, dims, cell, cell_min, cell_max);
+    *ret = found ? interval_hull(*ret, value) : value;
+    found = 1;
+  } while (next_point(dims, first, last, cell));
+
+  return 1;
+}
+
+/* The lattice cell, in skewed coordinates, holding the simplex around pos,
+ * and the order of the axes its corners step along after cell, as the kernels
+ * find them. Returns 0 when pos is close enough to the edge of a simplex for
+ * the kernels' rounding to put it in the next one. */
+static int find_simplex(int dims, double skew, const double pos[4],
+                        long cell[4], int order[4]) {
+  double sum = 0;
+  for (int a = 0; a < dims; a++)
+    sum += pos[a];
+
+  double frac[4], edge = 0;
+  for (int a = 0; a < dims; a++) {
+    double p = pos[a] + skew*sum;
+    edge = fmax(edge, 4*BoxPadding*(1 + fabs(p)));
+    cell[a] = floor(p);
+    frac[a] = p - cell[a];
+  }
+
+  for (int a = 0; a < dims; a++) {
+    if (frac[a] < edge || frac[a] > 1 - edge)
+      return 0;
+
+    int i = a;
+    for (; i > 0 && frac[order[i - 1]] < frac[a]; i--)
+      order[i] = order[i - 1];
+    order[i] = a;
+  }
+
+  for (int a = 1; a < dims; a++) {
+    if (frac[order[a - 1]] - frac[order[a]] < edge)
+      return 0;
+  }
+
+  return 1;
+}
+
+/* Simplices are convex, so the box is inside one when all of its corners
+ * are. */
+static int box_simplex(int dims, double skew,
+                       const double min[4], const double max[4],
+                       long cell[4], int order[4]) {
+  for (int i = 0; i < 1 << dims; i++) {
+    double pos[4];
+    long corner_cell[4];
+    int corner_order[4];
+    for (int a = 0; a < dims; a++)
+      pos[a] = i >> a & 1 ? max[a] : min[a];
+
+    if (!find_simplex(dims, skew, pos, i == 0 ? cell : corner_cell,
+                      i == 0 ? order : corner_order))
+      return 0;
+
+    for (int a = 0; i != 0 && a < dims; a++) {
+      if (corner_cell[a] != cell[a] || corner_order[a] != order[a])
+        return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* falloff*dot over the box for lattice point p, or between 0 and that if p
+ * may not be a corner of the simplex around every position. */
+static interval simplex_term(const noise_cpu_tables *tables, int dims,
+                             double unskew, const long p[4], int corner,
+                             const double min[4], const double max[4]) {
+  double offset = 0;
+  for (int a = 0; a < dims; a++)
+    offset += p[a];
+  offset *= unskew;
+
+  double position[4];
+  interval dist2 = {0, 0};
+  for (int a = 0; a < dims; a++) {
+    position[a] = p[a] - offset;
+    interval d = {min[a] - position[a], max[a] - position[a]};
+    dist2 = interval_add(dist2, interval_square(d));
+  }
+
+  if (dist2.min >= SimplexRadius2)
+    return (interval){0, 0};
+
+  interval t = {fmax(SimplexRadius2 - dist2.max, 0),
+                SimplexRadius2 - dist2.min};
+  interval falloff = interval_square(interval_square(t));
+  interval term = interval_mul(falloff, corner_dot(tables, dims, p, position,
+                                                   min, max));
+
+  if (!corner || dist2.max >= SimplexRadius2)
+    term = interval_hull(term, (interval){0, 0});
+  return term;
+}
+
+/* Simplex noise adds falloff*dot for the corners of the simplex holding each
+ * position, a falloff that is 0 past SimplexRadius2. When the box spans more
+ * than one simplex, every lattice point within that distance of it may be one
+ * of those corners, or not, so each adds between 0 and the bounds of its own
+ * term. Returns 0 if there are more than NoiseBoundMaxCorners points to look
+ * at. */
+static int simplex_octave(const noise_cpu_tables *tables, int dims,
+                          const double min[4], const double max[4],
+                          interval *ret) {
+  double skew   = dims == 4 ? 0.309016994374947 : 1.0/3;
+  double unskew = dims == 4 ? 0.138196601125011 : 1.0/6;
+  double radius = sqrt(SimplexRadius2);
+  double scale  = dims == 4 ? Simplex4dScale : Simplex3dScale;
+
+  interval sum = {0, 0};
+  long p[4];
+  int order[4];
+  if (box_simplex(dims, skew, min, max, p, order)) {
+    for (int i = 0; i <= dims; i++) {
+      if (i > 0)
+        p[order[i - 1]]++;
+      sum = interval_add(sum, simplex_term(tables, dims, unskew, p, 1,
+                                           min, max));
+    }
+
+    *ret = interval_scale(sum, scale);
+    return 1;
+  }
+
+  /* Skewing grows with every coordinate, so the lattice points whose
+   * unskewed position is in the box grown by the radius are within the
+   * skewed corners of that box. */
+  double sum_min = 0, sum_max = 0;
+  for (int a = 0; a < dims; a++) {
+    sum_min += min[a] - radius;
+    sum_max += max[a] + radius;
+  }
+
+  long first[4], last[4];
+  size_t points = 1;
+  for (int a = 0; a < dims; a++) {
+    first[a] = ceil(min[a] - radius + skew*sum_min);
+    last[a]  = floor(max[a] + radius + skew*sum_max);
+    if (last[a] < first[a])
+      last[a] = first[a];
+    points *= last[a] - first[a] + 1;
+    if (points > NoiseBoundMaxCorners)
+      return 0;
+  }
+
+  for (int a = 0; a < dims; a++)
+    p[a] = first[a];
+  do {
+    sum = interval_add(sum, simplex_term(tables, dims, unskew, p, 0,
+                                         min, max));
+  } while (next_point(dims, first, last, p));
+
+  *ret = interval_scale(sum, scale);
+  return 1;
+}
+
+/* Bounds of octave i of kind over the box, before its amplitude is
+ * applied. */
+static interval octave_bounds(const noise_cpu_tables *tables, noise_kind kind,
+                              const double min[4], const double max[4],
+                              size_t i) {
+  int dims = is_4d(kind) ? 4 : 3;
+  double factor = ldexp(1, (int)i);
+
+  double octave_min[4], octave_max[4];
+  for (int a = 0; a < dims; a++) {
+    octave_min[a] = min[a]*factor;
+    octave_max[a] = max[a]*factor;
+  }
+
+  double bound = noise_octave_bound(kind);
+  interval ret = {-bound, bound};
+
+  interval tight = ret;
+  int found = kind == NoisePerlin3d || kind == NoisePerlin4d ?
+    perlin_octave(tables, dims, octave_min, octave_max, &tight) :
+    simplex_octave(tables, dims, octave_min, octave_max, &tight);
+  if (found) {
+    ret.min = fmax(ret.min, tight.min);
+    ret.max = fmin(ret.max, tight.max);
+  }
+
+  return ret;
+}
+
+static void box_bounds(noise_box box, double min[4], double max[4]) {
+  min[0] = box.min.x; min[1] = box.min.y;
+  min[2] = box.min.z; min[3] = box.min.w;
+  max[0] = box.max.x; max[1] = box.max.y;
+  max[2] = box.max.z; max[3] = box.max.w;
+}
+
+/* Sum of the amplitudes of the octaves from the done-th on. */
+static double octave_amplitudes(size_t octave_count, size_t done) {
+  return ldexp(1, 1 - (int)done) - ldexp(1, 1 - (int)octave_count);
+}
+
+void noise_bound_box(const noise_cpu_tables *tables, noise_kind kind,
+                     size_t octave_count, noise_box box,
+                     GLfloat *min, GLfloat *max) {
+  double box_min[4], box_max[4];
+  box_bounds(box, box_min, box_max);
+
+  interval sum = {0, 0};
+  for (size_t i = 0; i < octave_count; i++) {
+    interval octave = octave_bounds(tables, kind, box_min, box_max, i);
+    sum = interval_add(sum, interval_scale(octave, ldexp(1, -(int)i)));
+  }
+
+  double norm = octave_amplitudes(octave_count, 0);
+  *min = norm > 0 ? sum.min/norm : 0;
+  *max = norm > 0 ? sum.max/norm : 0;
+}
+
+/* Boxes near the surface, which are most of those that can't be decided,
+ * are told apart much faster than they are bounded: some of their corners, or
+ * their center, are on either side of the threshold, or too close to it.
+ * Corners come in pairs along x, opposite edges first; the center is last,
+ * and its value is kept in *center_value. */
+static int samples_straddle(const noise_cpu_tables *tables, noise_kind kind,
+                            size_t octave_count, noise_box box,
+                            GLfloat threshold, vec4 center,
+                            GLfloat *center_value) {
+  static const int edges[4][2] = {{0, 0}, {1, 1}, {0, 1}, {1, 0}};
+
+  int above = 0, below = 0;
+  for (int i = 0; i <= 4; i++) {
+    vec4 pos = center;
+    GLfloat values[2], step = 0;
+    size_t count = 1;
+    if (i < 4) {
+      pos.x = box.min.x;
+      pos.y = edges[i][0] ? box.max.y : box.min.y;
+      pos.z = edges[i][1] ? box.max.z : box.min.z;
+      step  = box.max.x - box.min.x;
+      count = 2;
+    }
+
+    noise_cpu_sample(tables, kind, octave_count, pos, step, count, values);
+    *center_value = values[0];
+    for (size_t j = 0; j < count; j++) {
+      above |= values[j] > threshold + NoiseOctaveMargin;
+      below |= values[j] < threshold - NoiseOctaveMargin;
+      if (above == below)
+        return 1;
+    }
+  }
+
+  return 0;
+}
+
+noise_box_side noise_box_classify(const noise_cpu_tables *tables,
+                                  noise_kind kind, size_t octave_count,
+                                  noise_box box, GLfloat threshold,
+                                  GLfloat *value) {
+  if (kind == NoiseWhite || octave_count == 0)
+    return NoiseBoxMixed;
+
+  vec4 center = {
+    (box.min.x + box.max.x)/2, (box.min.y + box.max.y)/2,
+    (box.min.z + box.max.z)/2, (box.min.w + box.max.w)/2,
+  };
+  GLfloat sample;
+  if (samples_straddle(tables, kind, octave_count, box, threshold, center,
+                       &sample))
+    return NoiseBoxMixed;
+
+  double box_min[4], box_max[4];
+  box_bounds(box, box_min, box_max);
+
+  double norm  = octave_amplitudes(octave_count, 0);
+  double bound = noise_octave_bound(kind);
+
+  double target = threshold*norm, margin = NoiseOctaveMargin*norm;
+
+  /* Every bound holds the noise at the box's center, so the octaves left
+   * can't move the sum's bounds past what they add up to there: once that
+   * isn't enough on either side, the box is left to the kernels. */
+  double rest = sample*norm;
+
+  interval sum = {0, 0};
+  for (size_t done = 0; done <= octave_count; done++) {
+    double left = octave_amplitudes(octave_count, done)*bound;
+
+    if (sum.min - left > target + margin) {
+      *value = (sum.min - left)/norm;
+      return NoiseBoxSolid;
+    }
+    else if (sum.max + left < target - margin) {
+      *value = (sum.max + left)/norm;
+      return NoiseBoxEmpty;
+    }
+    else if (done == octave_count)
+      break;
+
+    double amplitude = ldexp(1, -(int)done);
+    interval octave = octave_bounds(tables, kind, box_min, box_max, done);
+    sum = interval_add(sum, interval_scale(octave, amplitude));
+
+    double factor = ldexp(1, (int)done);
+    vec4 pos = {
+      center.x*factor, center.y*factor, center.z*factor, center.w*factor,
+    };
+    noise_cpu_sample(tables, kind, 1, pos, 0, 1, &sample);
+    rest -= amplitude*sample;
+
+    if (sum.min + rest <= target + margin &&
+        sum.max + rest >= target - margin)
+      break;
+  }
+
+  return NoiseBoxMixed;
+}
+
+/* The positions start + i*scale for i from i0 to i1. */
+static void axis_range(GLfloat start, GLfloat scale, size_t i0, size_t i1,
+                       GLfloat *min, GLfloat *max) {
+  double a = start + (double)i0*scale, b = start + (double)i1*scale;
+  double pad = BoxPadding*(1 + fmax(fabs(a), fabs(b)));
+
+  *min = fmin(a, b) - pad;
+  *max = fmax(a, b) + pad;
+}
+
+noise_box noise_voxel_box(vec4 start, vec4 scale,
+                          size_t x0, size_t y0, size_t z0,
+                          size_t x1, size_t y1, size_t z1) {
+  noise_box box;
+  axis_range(start.x, scale.x, x0, x1, &box.min.x, &box.max.x);
+  axis_range(start.y, scale.y, y0, y1, &box.min.y, &box.max.y);
+  axis_range(start.z, scale.z, z0, z1, &box.min.z, &box.max.z);
+  axis_range(start.w, 0, 0, 0, &box.min.w, &box.max.w);
+
+  return box;
+}
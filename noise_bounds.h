@@ -0,0 +1,71 @@
+#ifndef NOISE_BOUNDS_H_
+#define NOISE_BOUNDS_H_
+
+#include <stddef.h>
+#include <GL/glew.h>
+
+#include "noise_gen.h"
+#include "noise_cpu.h"
+#include "vector_math.h"
+
+/**
+ * Lattice cells (times their corners) or simplex lattice points examined per
+ * octave when bounding a box. Higher octaves spread the same box over more of
+ * them, and past this many are bounded by noise_octave_bound instead, which
+ * their small amplitude makes up for.
+ */
+#define NoiseBoundMaxCorners 256
+
+/**
+ * A box of noise coordinates, before the frequency of any octave is applied.
+ * 3D generators ignore w.
+ */
+typedef struct noise_box {
+  vec4 min, max;
+} noise_box;
+
+typedef enum noise_box_side {
+  NoiseBoxMixed, /* may hold voxels on both sides of the threshold */
+  NoiseBoxEmpty, /* every voxel below the threshold */
+  NoiseBoxSolid, /* every voxel at or above it */
+} noise_box_side;
+
+/**
+ * Bounds the normalized sum of octave_count octaves of kind, as written by the
+ * generators, over box. Each octave is bounded with interval arithmetic on the
+ * gradients of the lattice points around the box, taken from tables: the
+ * corners' dot products are linear over the box, and Perlin noise mixes them
+ * with weights between 0 and 1 (tightened by its value and derivative at the
+ * center of each cell's part of the box), while each simplex corner adds its
+ * falloff times its dot product, or nothing unless the whole box is in one
+ * simplex. Bounds get wider, relative to the noise, with each octave.
+ */
+void noise_bound_box(const noise_cpu_tables *tables, noise_kind kind,
+                     size_t octave_count, noise_box box,
+                     GLfloat *min, GLfloat *max);
+
+/**
+ * Tells whether every voxel of box is on the same side of threshold, by more
+ * than NoiseOctaveMargin, stopping as soon as the octaves bounded so far and
+ * noise_octave_bound for the others decide it. Boxes whose corners or center
+ * are on both sides, or whose bounds can no longer decide it, are
+ * NoiseBoxMixed without bounding the other octaves. For NoiseBoxEmpty and
+ * NoiseBoxSolid, *value is set to a bound of the noise over the box, on the
+ * same side of the threshold as its voxels.
+ */
+noise_box_side noise_box_classify(const noise_cpu_tables *tables,
+                                  noise_kind kind, size_t octave_count,
+                                  noise_box box, GLfloat threshold,
+                                  GLfloat *value);
+
+/**
+ * The box holding the voxels x0 to x1, y0 to y1 and z0 to z1, inclusive, of a
+ * volume sampled at start + i*scale, as the generators compute positions,
+ * grown by a few units in the last place of the largest coordinate so that it
+ * still holds them once rounded to floats.
+ */
+noise_box noise_voxel_box(vec4 start, vec4 scale,
+                          size_t x0, size_t y0, size_t z0,
+                          size_t x1, size_t y1, size_t z1);
+
+#endif
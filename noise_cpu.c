@@ -0,0 +1,631 @@
+#include <stddef.h>
+#include <math.h>
+
+#include "noise_cpu.h"
+#include "noise_cpu_kernel.h"
+#include "noise_bounds.h"
+#include "thread_pool.h"
+
+static const noise_cpu_kernels *kernels_for(noise_cpu_isa isa);
+static const noise_cpu_kernels *current_kernels(void);
+
+static int selected_isa = -1;
+static int cell_tables = 1;
+
+/* The pool is shared by every generator. Callers that find it busy, e.g.
+ * generators running on several threads of their own, fill their bricks on the
+ * calling thread instead. */
+static size_t selected_thread_count = 0;
+static thread_pool pool;
+static int pool_ready = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Added to once per brick filled by a lazy generator. */
+static noise_octave_stats octave_stats;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+noise_cpu_isa noise_cpu_best_isa(void) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && kernels_for(NoiseCpuAVX512))
+    return NoiseCpuAVX512;
+  else if (__builtin_cpu_supports("avx2") && kernels_for(NoiseCpuAVX2))
+    return NoiseCpuAVX2;
+  else if (__builtin_cpu_supports("sse4.1") && kernels_for(NoiseCpuSSE41))
+    return NoiseCpuSSE41;
+#endif
+  return NoiseCpuScalar;
+}
+
+void noise_cpu_set_isa(noise_cpu_isa isa) {
+  noise_cpu_isa best = noise_cpu_best_isa();
+  selected_isa = isa > best ? best : isa;
+}
+
+noise_cpu_isa noise_cpu_current_isa(void) {
+  if (selected_isa < 0)
+    selected_isa = noise_cpu_best_isa();
+  return selected_isa;
+}
+
+const char *noise_cpu_isa_name(noise_cpu_isa isa) {
+  switch (isa) {
+  case NoiseCpuScalar: return "scalar";
+  case NoiseCpuSSE41:  return "sse4.1";
+  case NoiseCpuAVX2:   return "avx2";
+  case NoiseCpuAVX512: return "avx512";
+  }
+
+  return "unknown";
+}
+
+void noise_cpu_set_thread_count(size_t count) {
+  pthread_mutex_lock(&pool_lock);
+  if (pool_ready && count != selected_thread_count) {
+    thread_pool_release(&pool);
+    pool_ready = 0;
+  }
+
+  selected_thread_count = count;
+  pthread_mutex_unlock(&pool_lock);
+}
+
+size_t noise_cpu_thread_count(void) {
+  return selected_thread_count == 0 ? thread_pool_default_size() :
+    selected_thread_count;
+}
+
+void noise_cpu_set_cell_tables(int enabled) {
+  cell_tables = enabled;
+}
+
+int noise_cpu_cell_tables(void) {
+  return cell_tables;
+}
+
+typedef struct brick_job {
+  size_t count_x, count_y;
+  size_t width, height, depth;
+
+  noise_brick_fn fn;
+  void *data;
+} brick_job;
+
+static void run_brick(void *data, size_t index) {
+  const brick_job *job = data;
+
+  noise_brick brick;
+  brick.index = index;
+  brick.x = (index % job->count_x) * NoiseBrickWidth;
+  brick.y = (index / job->count_x % job->count_y) * NoiseBrickHeight;
+  brick.z = (index / job->count_x / job->count_y) * NoiseBrickDepth;
+
+  brick.width  = job->width  - brick.x;
+  brick.height = job->height - brick.y;
+  brick.depth  = job->depth  - brick.z;
+  if (brick.width  > NoiseBrickWidth)  brick.width  = NoiseBrickWidth;
+  if (brick.height > NoiseBrickHeight) brick.height = NoiseBrickHeight;
+  if (brick.depth  > NoiseBrickDepth)  brick.depth  = NoiseBrickDepth;
+
+  job->fn(job->data, &brick);
+}
+
+void noise_cpu_for_each_brick(size_t width, size_t height, size_t depth,
+                              noise_brick_fn fn, void *data) {
+  brick_job job;
+  job.count_x = (width  + NoiseBrickWidth  - 1) / NoiseBrickWidth;
+  job.count_y = (height + NoiseBrickHeight - 1) / NoiseBrickHeight;
+  job.width  = width;
+  job.height = height;
+  job.depth  = depth;
+  job.fn   = fn;
+  job.data = data;
+
+  size_t count_z = (depth + NoiseBrickDepth - 1) / NoiseBrickDepth;
+  size_t brick_count = job.count_x * job.count_y * count_z;
+
+  if (pthread_mutex_trylock(&pool_lock) == 0) {
+    if (!pool_ready && noise_cpu_thread_count() > 1)
+      pool_ready = thread_pool_init(&pool, selected_thread_count) == 0;
+
+    if (pool_ready) {
+      thread_pool_run(&pool, brick_count, run_brick, &job);
+      pthread_mutex_unlock(&pool_lock);
+      return;
+    }
+
+    pthread_mutex_unlock(&pool_lock);
+  }
+
+  for (size_t i = 0; i < brick_count; i++)
+    run_brick(&job, i);
+}
+
+void noise_cpu_tables_init(noise_cpu_tables *tables, uint64_t seed) {
+  tables->hash_mode = noise_current_hash_mode();
+  tables->key = white_noise_key(seed);
+
+  GLint permutations[PermutationTableSize];
+  make_permutation_table(permutations, PermutationTableSize, seed);
+  for (size_t i = 0; i < PermutationTableSize; i++) {
+    tables->permutations[i] = permutations[i];
+    tables->permutations[i + PermutationTableSize] = permutations[i];
+  }
+
+  /* The shaders select gradients[hash % count]; do the modulo up front. */
+  for (size_t hash = 0; hash < PermutationTableSize; hash++) {
+    const GLfloat *g3 = gradients3d + 4*(hash % Gradient3dCount);
+    const GLfloat *g4 = gradients4d + 4*(hash % Gradient4dCount);
+
+    for (size_t i = 0; i < 3; i++)
+      tables->gradients3d[i][hash] = g3[i];
+    for (size_t i = 0; i < 4; i++)
+      tables->gradients4d[i][hash] = g4[i];
+  }
+}
+
+GLuint noise_cpu_gradient_index(const noise_cpu_tables *tables, int dims,
+                                const long p[4]) {
+  int integer = tables->hash_mode == NoiseHashInteger;
+
+  GLuint hash = integer ? tables->key : 0;
+  for (int a = dims - 1; a >= 0; a--) {
+    if (integer)
+      hash = white_noise_hash((GLuint)p[a] + hash);
+    else
+      hash = tables->permutations[(p[a] & (PermutationTableSize - 1)) + hash];
+  }
+
+  if (!integer)
+    return hash;
+  return dims == 4 ? hash >> 27 : ((hash >> 8)*Gradient3dCount) >> 24;
+}
+
+static noise_cpu_row_fn kernel_for(noise_kind kind) {
+  const noise_cpu_kernels *kernels = current_kernels();
+  switch (kind) {
+  case NoiseSimplex3d: return kernels->simplex3d;
+  case NoisePerlin4d:  return kernels->perlin4d;
+  case NoiseSimplex4d: return kernels->simplex4d;
+  default:             return kernels->perlin3d;
+  }
+}
+
+/* Early exits requested by a generator, see noise3d_cpu_set_lazy. */
+typedef struct lazy_octaves {
+  int enabled;
+  GLfloat threshold, bound;
+} lazy_octaves;
+
+static const lazy_octaves every_octave = {0, 0, 0};
+
+/* Lazy generators split their bricks into octants, down to this size, while
+ * noise_box_classify can't tell which side of the threshold they are on. */
+#define BoundedMinWidth  16
+#define BoundedMinHeight 8
+#define BoundedMinDepth  8
+
+typedef struct volume_job {
+  noise_kind kind;
+  noise_cpu_row_fn fn;
+  const noise_cpu_tables *tables;
+
+  size_t width, height;
+  GLfloat *noise;
+
+  size_t octave_count;
+  vec4 start, scale;
+  lazy_octaves lazy;
+} volume_job;
+
+/* First lattice coordinate of the cells that an axis of a region spans at
+ * factor, and the number of lattice points they have along it. The positions
+ * are computed as the kernels do, from a and b, the region's first and last
+ * voxel. */
+static GLint cell_span(GLfloat start, GLfloat scale, GLfloat factor,
+                       size_t a, size_t b, GLint *size) {
+  GLint first = (GLint)floorf((start + (GLfloat)(GLint)a*scale)*factor);
+  GLint last  = (GLint)floorf((start + (GLfloat)(GLint)b*scale)*factor);
+
+  *size = (first < last ? last - first : first - last) + 2;
+  return first < last ? first : last;
+}
+
+/* The noise_cpu_cells of region for the octave at factor. */
+static void cells_init(noise_cpu_cells *cells, const volume_job *job,
+                       const noise_brick *region, GLfloat factor) {
+  int dims = job->kind == NoisePerlin4d ? 4 : 3;
+
+  cells->origin[0] = cell_span(job->start.x, job->scale.x, factor, region->x,
+                               region->x + region->width - 1,
+                               &cells->size[0]);
+  cells->origin[1] = cell_span(job->start.y, job->scale.y, factor, region->y,
+                               region->y + region->height - 1,
+                               &cells->size[1]);
+  cells->origin[2] = cell_span(job->start.z, job->scale.z, factor, region->z,
+                               region->z + region->depth - 1,
+                               &cells->size[2]);
+  cells->origin[3] = (GLint)floorf(job->start.w*factor);
+  cells->size[3] = 2;
+  cells->dims = dims;
+
+  size_t count = 1;
+  for (int a = 0; a < dims; a++)
+    count *= cells->size[a];
+  if (count > NoiseCpuCellPoints) {
+    cells->size[0] = 0;
+    return;
+  }
+
+  for (int i = 0; i < 1 << dims; i++) {
+    GLint stride = 1;
+    cells->corner[i] = 0;
+    for (int a = 0; a < dims; a++) {
+      cells->corner[i] += (i >> a & 1)*stride;
+      stride *= cells->size[a];
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    long p[4];
+    size_t rest = i;
+    for (int a = 0; a < dims; a++) {
+      p[a] = cells->origin[a] + (long)(rest % cells->size[a]);
+      rest /= cells->size[a];
+    }
+
+    cells->index[i] = noise_cpu_gradient_index(job->tables, dims, p);
+  }
+}
+
+/* Evaluates every voxel of region with the kernels, returning the number of
+ * octaves evaluated. */
+static size_t fill_rows(const volume_job *job, const noise_brick *region) {
+  noise_cpu_cells cells[NoiseCpuCellOctaves];
+
+  noise_cpu_row row;
+  row.octave_count = job->octave_count;
+  row.start_x = job->start.x;
+  row.scale_x = job->scale.x;
+  row.x       = region->x;
+  row.count   = region->width;
+  row.w       = job->start.w;
+
+  row.lazy      = job->lazy.enabled;
+  row.threshold = job->lazy.threshold;
+  row.bound     = job->lazy.bound;
+
+  row.cells = cells;
+  row.cell_octaves = 0;
+  if (cell_tables &&
+      (job->kind == NoisePerlin3d || job->kind == NoisePerlin4d)) {
+    row.cell_octaves = job->octave_count < NoiseCpuCellOctaves ?
+      job->octave_count : NoiseCpuCellOctaves;
+
+    GLfloat factor = 1.0;
+    for (size_t i = 0; i < row.cell_octaves; i++) {
+      cells_init(&cells[i], job, region, factor);
+      factor *= 2.0;
+    }
+  }
+
+  size_t octaves = 0;
+  for (size_t z = region->z; z < region->z + region->depth; z++) {
+    row.z = job->start.z + (GLfloat)z*job->scale.z;
+    for (size_t y = region->y; y < region->y + region->height; y++) {
+      row.y = job->start.y + (GLfloat)y*job->scale.y;
+      octaves += job->fn(job->tables, &row,
+                         job->noise + region->x + job->width*y +
+                         job->width*job->height*z);
+    }
+  }
+
+  return octaves;
+}
+
+static void fill_constant(const volume_job *job, const noise_brick *region,
+                          GLfloat value) {
+  for (size_t z = region->z; z < region->z + region->depth; z++) {
+    for (size_t y = region->y; y < region->y + region->height; y++) {
+      GLfloat *row = job->noise + region->x + job->width*y +
+        job->width*job->height*z;
+      for (size_t x = 0; x < region->width; x++)
+        row[x] = value;
+    }
+  }
+}
+
+/* Halves along x, y and z, or the whole region along axes that are already
+ * small enough. */
+static size_t split_axis(size_t begin, size_t size, size_t min_size,
+                         size_t part, size_t *part_size) {
+  if (size <= min_size) {
+    *part_size = part == 0 ? size : 0;
+    return begin;
+  }
+
+  *part_size = part == 0 ? size/2 : size - size/2;
+  return part == 0 ? begin : begin + size/2;
+}
+
+/* Fills the regions noise_box_classify decides with the bound it returns,
+ * which is on the right side of the threshold, and the others with the
+ * kernels once they can't be split any further. */
+static void fill_bounded(const volume_job *job, const noise_brick *region,
+                         size_t *octaves, size_t *skipped) {
+  noise_box box = noise_voxel_box(job->start, job->scale,
+                                  region->x, region->y, region->z,
+                                  region->x + region->width - 1,
+                                  region->y + region->height - 1,
+                                  region->z + region->depth - 1);
+
+  GLfloat value;
+  if (noise_box_classify(job->tables, job->kind, job->octave_count, box,
+                         job->lazy.threshold, &value) != NoiseBoxMixed) {
+    fill_constant(job, region, value);
+    *skipped += region->width*region->height*region->depth;
+    return;
+  }
+
+  if (region->width <= BoundedMinWidth &&
+      region->height <= BoundedMinHeight &&
+      region->depth <= BoundedMinDepth) {
+    *octaves += fill_rows(job, region);
+    return;
+  }
+
+  for (size_t i = 0; i < 8; i++) {
+    noise_brick part = *region;
+    part.x = split_axis(region->x, region->width, BoundedMinWidth,
+                        i & 1, &part.width);
+    part.y = split_axis(region->y, region->height, BoundedMinHeight,
+                        i >> 1 & 1, &part.height);
+    part.z = split_axis(region->z, region->depth, BoundedMinDepth,
+                        i >> 2 & 1, &part.depth);
+
+    if (part.width && part.height && part.depth)
+      fill_bounded(job, &part, octaves, skipped);
+  }
+}
+
+static void fill_brick(void *data, const noise_brick *brick) {
+  const volume_job *job = data;
+
+  if (!job->lazy.enabled) {
+    fill_rows(job, brick);
+    return;
+  }
+
+  size_t octaves = 0, skipped = 0;
+  fill_bounded(job, brick, &octaves, &skipped);
+
+  pthread_mutex_lock(&stats_lock);
+  octave_stats.voxels  += brick->width*brick->height*brick->depth;
+  octave_stats.octaves += octaves;
+  octave_stats.skipped += skipped;
+  pthread_mutex_unlock(&stats_lock);
+}
+
+static
+void fill_volume(noise_kind kind, const noise_cpu_tables *tables,
+                 size_t width, size_t height, size_t depth, GLfloat *noise,
+                 size_t octave_count, vec4 start, vec4 scale,
+                 lazy_octaves lazy) {
+  volume_job job = {kind, kernel_for(kind), tables, width, height, noise,
+                    octave_count, start, scale, lazy};
+  noise_cpu_for_each_brick(width, height, depth, fill_brick, &job);
+}
+
+static lazy_octaves lazy_for(int enabled, GLfloat threshold,
+                             noise_kind kind) {
+  lazy_octaves lazy = {enabled, threshold, noise_octave_bound(kind)};
+  return lazy;
+}
+
+noise_octave_stats noise_cpu_take_octave_stats(void) {
+  pthread_mutex_lock(&stats_lock);
+  noise_octave_stats stats = octave_stats;
+  octave_stats.voxels  = 0;
+  octave_stats.octaves = 0;
+  octave_stats.skipped = 0;
+  pthread_mutex_unlock(&stats_lock);
+
+  return stats;
+}
+
+static
+void perlin3d_like_cpu(size_t width, size_t height, size_t depth,
+                       GLfloat *noise,
+                       size_t octave_count, vec3 start, vec3 scale,
+                       uint64_t seed, noise_kind kind) {
+  noise_cpu_tables tables;
+  noise_cpu_tables_init(&tables, seed);
+
+  fill_volume(kind, &tables, width, height, depth, noise, octave_count,
+              (vec4){start.x, start.y, start.z, 0},
+              (vec4){scale.x, scale.y, scale.z, 0}, every_octave);
+}
+
+void perlin3d_cpu(size_t width, size_t height, size_t depth, GLfloat *noise,
+                  size_t octave_count, vec3 start, vec3 scale, uint64_t seed) {
+  perlin3d_like_cpu(width, height, depth, noise, octave_count, start, scale,
+                    seed, NoisePerlin3d);
+}
+
+void simplex3d_cpu(size_t width, size_t height, size_t depth, GLfloat *noise,
+                   size_t octave_count, vec3 start, vec3 scale,
+                   uint64_t seed) {
+  perlin3d_like_cpu(width, height, depth, noise, octave_count, start, scale,
+                    seed, NoiseSimplex3d);
+}
+
+void noise3d_cpu_init(noise3d_cpu_gen *gen, noise_kind kind,
+                      size_t octave_count, vec3 scale, uint64_t seed) {
+  gen->kind = kind;
+  gen->octave_count = octave_count;
+  gen->scale = scale;
+
+  gen->lazy = 0;
+  gen->threshold = 0;
+
+  noise_cpu_tables_init(&gen->tables, seed);
+
+  /* Picks the instruction set now rather than from several threads. */
+  noise_cpu_current_isa();
+}
+
+void noise3d_cpu_release(noise3d_cpu_gen *gen) {
+}
+
+void noise3d_cpu_set_lazy(noise3d_cpu_gen *gen, int lazy, GLfloat threshold) {
+  gen->lazy = lazy;
+  gen->threshold = threshold;
+}
+
+void noise3d_cpu_fill(const noise3d_cpu_gen *gen,
+                      size_t width, size_t height, size_t depth,
+                      GLfloat *noise, vec3 start) {
+  fill_volume(gen->kind, &gen->tables, width, height, depth, noise,
+              gen->octave_count, (vec4){start.x, start.y, start.z, 0},
+              (vec4){gen->scale.x, gen->scale.y, gen->scale.z, 0},
+              lazy_for(gen->lazy, gen->threshold, gen->kind));
+}
+
+void perlin4d_cpu_init(perlin4d_cpu_gen *gen,
+                       size_t width, size_t height, size_t depth,
+                       size_t octave_count, vec4 start, vec4 scale,
+                       uint64_t seed) {
+  gen->kind = NoisePerlin4d;
+
+  gen->width  = width;
+  gen->height = height;
+  gen->depth  = depth;
+
+  gen->octave_count = octave_count;
+  gen->start = start;
+  gen->scale = scale;
+
+  gen->lazy = 0;
+  gen->threshold = 0;
+
+  noise_cpu_tables_init(&gen->tables, seed);
+}
+
+void perlin4d_cpu_release(perlin4d_cpu_gen *gen) {
+}
+
+void perlin4d_cpu_set_lazy(perlin4d_cpu_gen *gen, int lazy,
+                           GLfloat threshold) {
+  gen->lazy = lazy;
+  gen->threshold = threshold;
+}
+
+void perlin4d_cpu_slice(perlin4d_cpu_gen *gen, GLfloat w, GLfloat *noise) {
+  vec4 start = gen->start;
+  start.w = start.w + w*gen->scale.w;
+
+  fill_volume(gen->kind, &gen->tables, gen->width, gen->height, gen->depth,
+              noise, gen->octave_count, start, gen->scale,
+              lazy_for(gen->lazy, gen->threshold, gen->kind));
+}
+
+void simplex4d_cpu_init(simplex4d_cpu_gen *gen,
+                        size_t width, size_t height, size_t depth,
+                        size_t octave_count, vec4 start, vec4 scale,
+                        uint64_t seed) {
+  perlin4d_cpu_init(gen, width, height, depth, octave_count, start, scale,
+                    seed);
+  gen->kind = NoiseSimplex4d;
+}
+
+void simplex4d_cpu_release(simplex4d_cpu_gen *gen) {
+  perlin4d_cpu_release(gen);
+}
+
+void simplex4d_cpu_set_lazy(simplex4d_cpu_gen *gen, int lazy,
+                            GLfloat threshold) {
+  perlin4d_cpu_set_lazy(gen, lazy, threshold);
+}
+
+void simplex4d_cpu_slice(simplex4d_cpu_gen *gen, GLfloat w, GLfloat *noise) {
+  perlin4d_cpu_slice(gen, w, noise);
+}
+
+typedef struct white_job {
+  noise_cpu_white_fn fn;
+  GLuint key;
+  GLuint x, y, z;
+
+  size_t width, height;
+  GLfloat *noise;
+} white_job;
+
+static void fill_white_brick(void *data, const noise_brick *brick) {
+  const white_job *job = data;
+
+  noise_cpu_white_row row;
+  row.key   = job->key;
+  row.x     = job->x + (GLuint)brick->x;
+  row.count = brick->width;
+
+  for (size_t z = brick->z; z < brick->z + brick->depth; z++) {
+    row.z = job->z + (GLuint)z;
+    for (size_t y = brick->y; y < brick->y + brick->height; y++) {
+      row.y = job->y + (GLuint)y;
+      job->fn(&row, job->noise + brick->x + job->width*y +
+              job->width*job->height*z);
+    }
+  }
+}
+
+void white_noise_cpu(size_t width, size_t height, size_t depth,
+                     GLfloat *noise, GLint x, GLint y, GLint z,
+                     uint64_t seed) {
+  white_job job;
+  job.fn  = current_kernels()->white;
+  job.key = white_noise_key(seed);
+  job.x = x;
+  job.y = y;
+  job.z = z;
+  job.width  = width;
+  job.height = height;
+  job.noise  = noise;
+
+  noise_cpu_for_each_brick(width, height, depth, fill_white_brick, &job);
+}
+
+void noise_cpu_sample(const noise_cpu_tables *tables, noise_kind kind,
+                      size_t octave_count, vec4 pos, GLfloat step,
+                      size_t count, GLfloat *out) {
+  noise_cpu_row row = {0};
+  row.octave_count = octave_count;
+  row.start_x = pos.x;
+  row.scale_x = step;
+  row.count   = count;
+  row.y = pos.y;
+  row.z = pos.z;
+  row.w = pos.w;
+
+  kernel_for(kind)(tables, &row, out);
+}
+
+void noise_cpu_threshold(const GLfloat *noise, size_t count,
+                         GLfloat threshold, uint64_t *bits) {
+  current_kernels()->threshold(noise, count, threshold, bits);
+}
+
+static const noise_cpu_kernels *kernels_for(noise_cpu_isa isa) {
+  const noise_cpu_kernels *ret = NULL;
+  switch (isa) {
+  case NoiseCpuScalar: ret = &noise_cpu_kernels_scalar; break;
+  case NoiseCpuSSE41:  ret = &noise_cpu_kernels_sse41;  break;
+  case NoiseCpuAVX2:   ret = &noise_cpu_kernels_avx2;   break;
+  case NoiseCpuAVX512: ret = &noise_cpu_kernels_avx512; break;
+  }
+
+  return ret && ret->perlin3d ? ret : NULL;
+}
+
+static const noise_cpu_kernels *current_kernels(void) {
+  return kernels_for(noise_cpu_current_isa());
+}
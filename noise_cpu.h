@@ -0,0 +1,224 @@
+#ifndef NOISE_CPU_H_
+#define NOISE_CPU_H_
+
+#include <stddef.h>
+#include <GL/glew.h>
+
+#include "noise_gen.h"
+#include "vector_math.h"
+
+/**
+ * CPU implementations of the generators in noise_gen.h. They use the same
+ * gradient tables, permutation scheme and evaluation order as the compute
+ * shaders and fill the noise buffer with the same layout (x fastest, then y,
+ * then z). Given the same seed, and therefore the same permutation table,
+ * every value agrees with the GPU within NoiseCpuTolerance; differences come
+ * from the GPU's own rounding of mix, dot and fused multiply-adds.
+ */
+#define NoiseCpuTolerance 1e-4
+
+typedef enum noise_cpu_isa {
+  NoiseCpuScalar,
+  NoiseCpuSSE41,
+  NoiseCpuAVX2,
+  NoiseCpuAVX512,
+} noise_cpu_isa;
+
+/**
+ * The widest instruction set supported by this CPU, as reported by cpuid.
+ */
+noise_cpu_isa noise_cpu_best_isa(void);
+
+/**
+ * Selects the kernels used by the generators below. Requests for an
+ * instruction set the CPU doesn't support fall back to the best supported one.
+ * By default, noise_cpu_best_isa() is used.
+ */
+void noise_cpu_set_isa(noise_cpu_isa isa);
+noise_cpu_isa noise_cpu_current_isa(void);
+
+const char *noise_cpu_isa_name(noise_cpu_isa isa);
+
+/**
+ * Volumes are split into bricks of at most this many voxels, which are filled
+ * in parallel. A brick's floats fit in a typical L2 cache.
+ */
+#define NoiseBrickWidth  32
+#define NoiseBrickHeight 16
+#define NoiseBrickDepth  16
+
+/**
+ * Sets the number of threads used to fill volumes, including the calling
+ * thread. 0, the default, uses one thread per online processor. The output
+ * doesn't depend on the thread count.
+ */
+void noise_cpu_set_thread_count(size_t count);
+size_t noise_cpu_thread_count(void);
+
+/**
+ * Whether the Perlin generators hash the corners of each lattice cell once per
+ * region of a brick, for the octaves whose cells are large enough, rather than
+ * once per voxel. Either way gives the same values. On by default.
+ */
+void noise_cpu_set_cell_tables(int enabled);
+int noise_cpu_cell_tables(void);
+
+typedef struct noise_brick {
+  size_t index;
+  size_t x, y, z;
+  size_t width, height, depth;
+} noise_brick;
+
+typedef void (*noise_brick_fn)(void *data, const noise_brick *brick);
+
+/**
+ * Splits a volume into bricks and calls fn once for each of them, from the
+ * worker threads. Bricks are numbered x fastest, then y, then z, so index
+ * only depends on the volume's dimensions.
+ */
+void noise_cpu_for_each_brick(size_t width, size_t height, size_t depth,
+                              noise_brick_fn fn, void *data);
+
+/**
+ * Tables in the layout used by the kernels: the doubled permutation table, and
+ * the components of the gradient selected by each hash value. Gradient indices
+ * computed by NoiseHashInteger are below 256, and select the same gradients
+ * from these tables.
+ */
+typedef struct noise_cpu_tables {
+  noise_hash_mode hash_mode;
+  GLuint key; /* white_noise_key(seed), for NoiseHashInteger */
+
+  GLint permutations[2*PermutationTableSize];
+
+  GLfloat gradients3d[3][PermutationTableSize];
+  GLfloat gradients4d[4][PermutationTableSize];
+} noise_cpu_tables;
+
+/**
+ * Derives the tables for seed in the current hash mode.
+ */
+void noise_cpu_tables_init(noise_cpu_tables *tables, uint64_t seed);
+
+/**
+ * gradient_index from the shaders, for lattice point p of a dims-dimensional
+ * grid. Table lookups only depend on each coordinate modulo the table's size,
+ * and integer hashes on it modulo 2^32, however p was reached.
+ */
+GLuint noise_cpu_gradient_index(const noise_cpu_tables *tables, int dims,
+                                const long p[4]);
+
+void perlin3d_cpu(size_t width, size_t height, size_t depth, GLfloat *noise,
+                  size_t octave_count, vec3 start, vec3 scale, uint64_t seed);
+void simplex3d_cpu(size_t width, size_t height, size_t depth, GLfloat *noise,
+                   size_t octave_count, vec3 start, vec3 scale,
+                   uint64_t seed);
+
+/**
+ * Like perlin3d_cpu and simplex3d_cpu, but keeps the same permutation table
+ * from one volume to the next, so that volumes filled from different starting
+ * points line up, as the chunks of a larger world do. noise3d_cpu_fill can be
+ * called from several threads at once.
+ */
+typedef struct noise3d_cpu_gen {
+  noise_cpu_tables tables;
+
+  noise_kind kind; /* NoisePerlin3d or NoiseSimplex3d */
+  size_t octave_count;
+  vec3 scale;
+
+  int lazy;
+  GLfloat threshold;
+} noise3d_cpu_gen;
+
+void noise3d_cpu_init(noise3d_cpu_gen *gen, noise_kind kind,
+                      size_t octave_count, vec3 scale, uint64_t seed);
+void noise3d_cpu_release(noise3d_cpu_gen *gen);
+
+/**
+ * Lets the generator skip the octaves that can no longer move a voxel across
+ * threshold, as NoiseOctavesLazy does on the GPU, for callers that only
+ * compare the noise with it, such as occupancy_from_noise. Skipped voxels
+ * hold a partial sum on the right side of threshold instead of the noise.
+ * Off by default. Vectors of voxels stop together, so the values, but not
+ * their side of the threshold, depend on the instruction set.
+ */
+void noise3d_cpu_set_lazy(noise3d_cpu_gen *gen, int lazy, GLfloat threshold);
+
+void noise3d_cpu_fill(const noise3d_cpu_gen *gen,
+                      size_t width, size_t height, size_t depth,
+                      GLfloat *noise, vec3 start);
+
+/**
+ * Fills noise with the white noise described in noise_gen.h, for a volume
+ * whose first voxel is at x, y, z. Filling a larger volume, or its pieces
+ * at the matching origins, gives the same values as white_generate.
+ */
+void white_noise_cpu(size_t width, size_t height, size_t depth,
+                     GLfloat *noise, GLint x, GLint y, GLint z,
+                     uint64_t seed);
+
+/**
+ * Octaves evaluated by lazy generators since the last call, as
+ * noise_take_octave_stats reports for the GPU. Voxels stop in vectors of the
+ * current instruction set's width, so every voxel of a vector counts the
+ * octaves evaluated for the whole vector.
+ */
+noise_octave_stats noise_cpu_take_octave_stats(void);
+
+/**
+ * The noise of octave_count octaves of kind, other than NoiseWhite, at the
+ * count points pos + i*(step, 0, 0, 0), as the generators would write it for
+ * voxels there. 3D kinds ignore w. A vector of the current instruction set's
+ * width costs as much as a single point.
+ */
+void noise_cpu_sample(const noise_cpu_tables *tables, noise_kind kind,
+                      size_t octave_count, vec4 pos, GLfloat step,
+                      size_t count, GLfloat *out);
+
+/**
+ * Sets bit i%64 of bits[i/64] when noise[i] >= threshold, for count values,
+ * with the current instruction set. Bits of the last word past count are
+ * cleared; (count+63)/64 words are written.
+ */
+void noise_cpu_threshold(const GLfloat *noise, size_t count,
+                         GLfloat threshold, uint64_t *bits);
+
+typedef struct perlin4d_cpu_gen {
+  noise_cpu_tables tables;
+
+  noise_kind kind; /* NoisePerlin4d or NoiseSimplex4d */
+
+  size_t width, height, depth;
+  size_t octave_count;
+  vec4 start, scale;
+
+  int lazy;
+  GLfloat threshold;
+} perlin4d_cpu_gen;
+
+void perlin4d_cpu_init(perlin4d_cpu_gen *gen,
+                       size_t width, size_t height, size_t depth,
+                       size_t octave_count, vec4 start, vec4 scale,
+                       uint64_t seed);
+void perlin4d_cpu_release(perlin4d_cpu_gen *gen);
+
+/** Same as noise3d_cpu_set_lazy. */
+void perlin4d_cpu_set_lazy(perlin4d_cpu_gen *gen, int lazy,
+                           GLfloat threshold);
+
+void perlin4d_cpu_slice(perlin4d_cpu_gen *gen, GLfloat w, GLfloat *noise);
+
+typedef perlin4d_cpu_gen simplex4d_cpu_gen;
+
+void simplex4d_cpu_init(simplex4d_cpu_gen *gen,
+                        size_t width, size_t height, size_t depth,
+                        size_t octave_count, vec4 start, vec4 scale,
+                        uint64_t seed);
+void simplex4d_cpu_release(simplex4d_cpu_gen *gen);
+void simplex4d_cpu_set_lazy(simplex4d_cpu_gen *gen, int lazy,
+                            GLfloat threshold);
+
+void simplex4d_cpu_slice(simplex4d_cpu_gen *gen, GLfloat w, GLfloat *noise);
+
+#endif
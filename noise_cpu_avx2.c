@@ -0,0 +1,56 @@
+#include "noise_cpu_kernel.h"
+
+#ifdef __AVX2__
+
+#include <immintrin.h>
+
+#define NoiseCpuSuffix avx2
+
+#define VF __m256
+#define VI __m256i
+#define VM __m256
+#define VW 8
+
+#define vf_set1(x)        _mm256_set1_ps(x)
+#define vi_set1(x)        _mm256_set1_epi32(x)
+#define vf_loadu(p)       _mm256_loadu_ps(p)
+#define vf_storeu(p, v)   _mm256_storeu_ps(p, v)
+
+#define vf_add(a, b)      _mm256_add_ps(a, b)
+#define vf_sub(a, b)      _mm256_sub_ps(a, b)
+#define vf_mul(a, b)      _mm256_mul_ps(a, b)
+#define vf_div(a, b)      _mm256_div_ps(a, b)
+#define vf_floor(a)       _mm256_floor_ps(a)
+
+#define vf_to_vi(a)       _mm256_cvttps_epi32(a)
+#define vi_to_vf(a)       _mm256_cvtepi32_ps(a)
+
+#define vi_add(a, b)      _mm256_add_epi32(a, b)
+#define vi_and(a, b)      _mm256_and_si256(a, b)
+#define vi_xor(a, b)      _mm256_xor_si256(a, b)
+#define vi_mul(a, b)      _mm256_mullo_epi32(a, b)
+#define vi_srli(a, n)     _mm256_srli_epi32(a, n)
+
+#define vi_gather(t, i)   _mm256_i32gather_epi32((const int *)(t), i, 4)
+#define vf_gather(t, i)   _mm256_i32gather_ps(t, i, 4)
+
+#define vm_ge(a, b)       _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#define vm_gt(a, b)       _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define vm_and(a, b)      _mm256_and_ps(a, b)
+#define vm_or(a, b)       _mm256_or_ps(a, b)
+#define vm_not(a)         _mm256_xor_ps(a, _mm256_castsi256_ps( \
+                                              _mm256_set1_epi32(-1)))
+#define vm_bits(m)        ((unsigned)_mm256_movemask_ps(m))
+
+#define vf_select(m, a, b) _mm256_blendv_ps(b, a, m)
+
+#define vi_ramp _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)
+
+#include "noise_cpu_template.h"
+
+#else
+
+/* Not built for this instruction set; noise_cpu.c skips empty tables. */
+const noise_cpu_kernels noise_cpu_kernels_avx2 = {0};
+
+#endif
@@ -0,0 +1,57 @@
+#include "noise_cpu_kernel.h"
+
+#ifdef __AVX512F__
+
+#include <immintrin.h>
+
+#define NoiseCpuSuffix avx512
+
+#define VF __m512
+#define VI __m512i
+#define VM __mmask16
+#define VW 16
+
+#define vf_set1(x)        _mm512_set1_ps(x)
+#define vi_set1(x)        _mm512_set1_epi32(x)
+#define vf_loadu(p)       _mm512_loadu_ps(p)
+#define vf_storeu(p, v)   _mm512_storeu_ps(p, v)
+
+#define vf_add(a, b)      _mm512_add_ps(a, b)
+#define vf_sub(a, b)      _mm512_sub_ps(a, b)
+#define vf_mul(a, b)      _mm512_mul_ps(a, b)
+#define vf_div(a, b)      _mm512_div_ps(a, b)
+#define vf_floor(a)       _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | \
+                                                  _MM_FROUND_NO_EXC)
+
+#define vf_to_vi(a)       _mm512_cvttps_epi32(a)
+#define vi_to_vf(a)       _mm512_cvtepi32_ps(a)
+
+#define vi_add(a, b)      _mm512_add_epi32(a, b)
+#define vi_and(a, b)      _mm512_and_si512(a, b)
+#define vi_xor(a, b)      _mm512_xor_si512(a, b)
+#define vi_mul(a, b)      _mm512_mullo_epi32(a, b)
+#define vi_srli(a, n)     _mm512_srli_epi32(a, n)
+
+#define vi_gather(t, i)   _mm512_i32gather_epi32(i, (const int *)(t), 4)
+#define vf_gather(t, i)   _mm512_i32gather_ps(i, t, 4)
+
+#define vm_ge(a, b)       _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ)
+#define vm_gt(a, b)       _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ)
+#define vm_and(a, b)      ((__mmask16)((a) & (b)))
+#define vm_or(a, b)       ((__mmask16)((a) | (b)))
+#define vm_not(a)         ((__mmask16)~(a))
+#define vm_bits(m)        ((unsigned)(m))
+
+#define vf_select(m, a, b) _mm512_mask_blend_ps(m, b, a)
+
+#define vi_ramp _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, \
+                                  7,  6,  5,  4,  3,  2, 1, 0)
+
+#include "noise_cpu_template.h"
+
+#else
+
+/* Not built for this instruction set; noise_cpu.c skips empty tables. */
+const noise_cpu_kernels noise_cpu_kernels_avx512 = {0};
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef NOISE_CPU_KERNEL_H_
+#define NOISE_CPU_KERNEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <GL/glew.h>
+
+#include "noise_cpu.h"
+
+/** Lattice points a noise_cpu_cells can hold. */
+#define NoiseCpuCellPoints 256
+
+/** Octaves, from the first one, that regions build noise_cpu_cells for. */
+#define NoiseCpuCellOctaves 8
+
+/**
+ * Gradient indices of the lattice points around the cells one octave of a
+ * region falls in, so that the Perlin kernels look the corners of a cell up
+ * instead of hashing them again for each of its voxels. Point p is at
+ * index[(p.x-origin[0]) + size[0]*((p.y-origin[1]) + size[1]*(...))], and
+ * size[0] is 0 when the points don't fit. The i-th corner of the cell whose
+ * first corner is at index[j], x fastest, is at index[j + corner[i]].
+ */
+typedef struct noise_cpu_cells {
+  int dims;
+  GLint origin[4], size[4];
+  GLint corner[16];
+  GLint index[NoiseCpuCellPoints];
+} noise_cpu_cells;
+
+/**
+ * A run of voxels along the x axis. The i-th voxel is sampled at
+ * (start_x + (x+i)*scale_x, y, z, w), matching how the shaders compute
+ * positions from gl_GlobalInvocationID.
+ *
+ * When lazy is set, a vector of voxels stops evaluating octaves once every
+ * lane is decided with respect to threshold, as described with
+ * noise_octave_mode, bound being noise_octave_bound for the kernel's kind.
+ *
+ * The Perlin kernels use cells[i], for i below cell_octaves, to find the
+ * gradients of octave i for vectors whose lanes fall in a few cells along x.
+ * Other vectors hash their corners, as do the other kernels.
+ */
+typedef struct noise_cpu_row {
+  size_t octave_count;
+
+  GLfloat start_x, scale_x;
+  size_t x, count;
+
+  GLfloat y, z, w;
+
+  int lazy;
+  GLfloat threshold, bound;
+
+  const noise_cpu_cells *cells;
+  size_t cell_octaves;
+} noise_cpu_row;
+
+/* Returns the number of octaves evaluated, summed over the row's voxels. */
+typedef size_t (*noise_cpu_row_fn)(const noise_cpu_tables *tables,
+                                   const noise_cpu_row *row, GLfloat *out);
+
+/**
+ * A run of white noise voxels along the x axis, at integer coordinates
+ * (x+i, y, z) that wrap around at 2^32 like the shader's uints.
+ */
+typedef struct noise_cpu_white_row {
+  GLuint key;
+  GLuint x, y, z;
+  size_t count;
+} noise_cpu_white_row;
+
+typedef void (*noise_cpu_white_fn)(const noise_cpu_white_row *row,
+                                   GLfloat *out);
+
+/**
+ * Sets bit i%64 of bits[i/64] when noise[i] >= threshold, for a run of count
+ * values, and clears the bits of the last word past count.
+ */
+typedef void (*noise_cpu_threshold_fn)(const GLfloat *noise, size_t count,
+                                       GLfloat threshold, uint64_t *bits);
+
+typedef struct noise_cpu_kernels {
+  noise_cpu_row_fn perlin3d;
+  noise_cpu_row_fn simplex3d;
+  noise_cpu_row_fn perlin4d;
+  noise_cpu_row_fn simplex4d;
+  noise_cpu_white_fn white;
+  noise_cpu_threshold_fn threshold;
+} noise_cpu_kernels;
+
+/* Defined by noise_cpu_template.h, once for each instruction set. */
+extern const noise_cpu_kernels noise_cpu_kernels_scalar;
+extern const noise_cpu_kernels noise_cpu_kernels_sse41;
+extern const noise_cpu_kernels noise_cpu_kernels_avx2;
+extern const noise_cpu_kernels noise_cpu_kernels_avx512;
+
+#endif
@@ -0,0 +1,45 @@
+#include <math.h>
+#include <stdint.h>
+
+#define NoiseCpuSuffix scalar
+
+#define VF GLfloat
+#define VI GLint
+#define VM int
+#define VW 1
+
+#define vf_set1(x)        ((GLfloat)(x))
+#define vi_set1(x)        ((GLint)(x))
+#define vf_loadu(p)       (*(p))
+#define vf_storeu(p, v)   (*(p) = (v))
+
+#define vf_add(a, b)      ((a) + (b))
+#define vf_sub(a, b)      ((a) - (b))
+#define vf_mul(a, b)      ((a) * (b))
+#define vf_div(a, b)      ((a) / (b))
+#define vf_floor(a)       floorf(a)
+
+#define vf_to_vi(a)       ((GLint)(a))
+#define vi_to_vf(a)       ((GLfloat)(a))
+
+#define vi_add(a, b)      ((GLint)((uint32_t)(a) + (uint32_t)(b)))
+#define vi_and(a, b)      ((a) & (b))
+#define vi_xor(a, b)      ((a) ^ (b))
+#define vi_mul(a, b)      ((GLint)((uint32_t)(a) * (uint32_t)(b)))
+#define vi_srli(a, n)     ((GLint)((uint32_t)(a) >> (n)))
+
+#define vi_gather(t, i)   ((t)[i])
+#define vf_gather(t, i)   ((t)[i])
+
+#define vm_ge(a, b)       ((a) >= (b))
+#define vm_gt(a, b)       ((a) > (b))
+#define vm_and(a, b)      ((a) && (b))
+#define vm_or(a, b)       ((a) || (b))
+#define vm_not(a)         (!(a))
+#define vm_bits(m)        ((unsigned)(m))
+
+#define vf_select(m, a, b) ((m) ? (a) : (b))
+
+#define vi_ramp 0
+
+#include "noise_cpu_template.h"
@@ -0,0 +1,64 @@
+#include "noise_cpu_kernel.h"
+
+#ifdef __SSE4_1__
+
+#include <smmintrin.h>
+
+#define NoiseCpuSuffix sse41
+
+#define VF __m128
+#define VI __m128i
+#define VM __m128
+#define VW 4
+
+#define vf_set1(x)        _mm_set1_ps(x)
+#define vi_set1(x)        _mm_set1_epi32(x)
+#define vf_loadu(p)       _mm_loadu_ps(p)
+#define vf_storeu(p, v)   _mm_storeu_ps(p, v)
+
+#define vf_add(a, b)      _mm_add_ps(a, b)
+#define vf_sub(a, b)      _mm_sub_ps(a, b)
+#define vf_mul(a, b)      _mm_mul_ps(a, b)
+#define vf_div(a, b)      _mm_div_ps(a, b)
+#define vf_floor(a)       _mm_floor_ps(a)
+
+#define vf_to_vi(a)       _mm_cvttps_epi32(a)
+#define vi_to_vf(a)       _mm_cvtepi32_ps(a)
+
+#define vi_add(a, b)      _mm_add_epi32(a, b)
+#define vi_and(a, b)      _mm_and_si128(a, b)
+#define vi_xor(a, b)      _mm_xor_si128(a, b)
+#define vi_mul(a, b)      _mm_mullo_epi32(a, b)
+#define vi_srli(a, n)     _mm_srli_epi32(a, n)
+
+/* SSE has no gather instruction, so look each lane up separately. */
+#define vi_gather(t, i)                                   \
+  _mm_setr_epi32((t)[_mm_extract_epi32(i, 0)],            \
+                 (t)[_mm_extract_epi32(i, 1)],            \
+                 (t)[_mm_extract_epi32(i, 2)],            \
+                 (t)[_mm_extract_epi32(i, 3)])
+#define vf_gather(t, i)                                   \
+  _mm_setr_ps((t)[_mm_extract_epi32(i, 0)],               \
+              (t)[_mm_extract_epi32(i, 1)],               \
+              (t)[_mm_extract_epi32(i, 2)],               \
+              (t)[_mm_extract_epi32(i, 3)])
+
+#define vm_ge(a, b)       _mm_cmpge_ps(a, b)
+#define vm_gt(a, b)       _mm_cmpgt_ps(a, b)
+#define vm_and(a, b)      _mm_and_ps(a, b)
+#define vm_or(a, b)       _mm_or_ps(a, b)
+#define vm_not(a)         _mm_xor_ps(a, _mm_castsi128_ps(_mm_set1_epi32(-1)))
+#define vm_bits(m)        ((unsigned)_mm_movemask_ps(m))
+
+#define vf_select(m, a, b) _mm_blendv_ps(b, a, m)
+
+#define vi_ramp _mm_setr_epi32(0, 1, 2, 3)
+
+#include "noise_cpu_template.h"
+
+#else
+
+/* Not built for this instruction set; noise_cpu.c skips empty tables. */
+const noise_cpu_kernels noise_cpu_kernels_sse41 = {0};
+
+#endif
@@ -0,0 +1,637 @@
+/*
+ * Noise kernels written against a small set of vector macros. This file has
+ * no include guard: each noise_cpu_<isa>.c defines the macros below for its
+ * instruction set, then includes it to get a noise_cpu_kernels_<isa> table.
+ *
+ *   NoiseCpuSuffix          suffix of the generated names
+ *   VF, VI, VM, VW          float vector, int vector, mask, lane count
+ *   vf_set1, vi_set1        broadcast
+ *   vf_loadu, vf_storeu     unaligned load and store of VW floats
+ *   vf_add, vf_sub, vf_mul, vf_div, vf_floor
+ *   vf_to_vi, vi_to_vf      conversions (truncating)
+ *   vi_add, vi_and, vi_xor
+ *   vi_mul                  low 32 bits of the product
+ *   vi_srli(a, n)           logical shift right by a constant
+ *   vi_gather, vf_gather    table[index] in each lane
+ *   vm_ge, vm_gt            comparisons
+ *   vm_and, vm_or, vm_not
+ *   vm_bits                 one bit per lane, lane 0 lowest, as an unsigned
+ *   vf_select(m, a, b)      m ? a : b in each lane
+ *   vi_ramp                 0, 1, ..., VW-1
+ *
+ * Every operation mirrors the GLSL in noise_gen.c, in the same order, so that
+ * the results only differ by the GPU's rounding. VW must divide 64.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "noise_cpu_kernel.h"
+
+#define NoiseCpuCat_(a, b) a##_##b
+#define NoiseCpuCat(a, b)  NoiseCpuCat_(a, b)
+#define kernel(name)       NoiseCpuCat(name, NoiseCpuSuffix)
+
+static VF kernel(perlin_smoothstep)(VF t) {
+  VF inner = vf_add(vf_mul(t, vf_sub(vf_mul(t, vf_set1(6)), vf_set1(15))),
+                    vf_set1(10));
+  return vf_mul(vf_mul(vf_mul(t, t), t), inner);
+}
+
+/* GLSL defines mix(a, b, t) as a*(1-t) + b*t. */
+static VF kernel(mix)(VF a, VF b, VF t) {
+  return vf_add(vf_mul(a, vf_sub(vf_set1(1), t)), vf_mul(b, t));
+}
+
+/* white_noise_hash from noise_gen.c, in each lane. */
+static VI kernel(white_hash)(VI x) {
+  x = vi_xor(x, vi_srli(x, 16));
+  x = vi_mul(x, vi_set1((GLint)0x7feb352dU));
+  x = vi_xor(x, vi_srli(x, 15));
+  x = vi_mul(x, vi_set1((GLint)0x846ca68bU));
+  return vi_xor(x, vi_srli(x, 16));
+}
+
+/*
+ * gradient_index from the shaders, split so that the hashes shared by several
+ * corners are only computed once: the cell's lattice coordinates, then one
+ * hash per axis from the outermost one in, starting from hash_start, and
+ * finally the gradient index. The mode is the same for every call, so the
+ * branches are always predicted.
+ */
+static VI kernel(lattice)(const noise_cpu_tables *tables, VF floored) {
+  VI c = vf_to_vi(floored);
+  if (tables->hash_mode == NoiseHashTable)
+    c = vi_and(c, vi_set1(PermutationTableSize - 1));
+  return c;
+}
+
+static VI kernel(hash_start)(const noise_cpu_tables *tables) {
+  return vi_set1(tables->hash_mode == NoiseHashInteger ?
+                 (GLint)tables->key : 0);
+}
+
+static VI kernel(lattice_hash)(const noise_cpu_tables *tables,
+                               VI c, VI hash) {
+  if (tables->hash_mode == NoiseHashInteger)
+    return kernel(white_hash)(vi_add(c, hash));
+  return vi_gather(tables->permutations, vi_add(c, hash));
+}
+
+/* Table hashes are below 256 and already select the right gradient. */
+static VI kernel(gradient3d_index)(const noise_cpu_tables *tables, VI hash) {
+  if (tables->hash_mode == NoiseHashInteger)
+    return vi_srli(vi_mul(vi_srli(hash, 8), vi_set1(Gradient3dCount)), 24);
+  return hash;
+}
+
+static VI kernel(gradient4d_index)(const noise_cpu_tables *tables, VI hash) {
+  if (tables->hash_mode == NoiseHashInteger)
+    return vi_srli(hash, 27);
+  return hash;
+}
+
+/* Most cells along x that the lanes of a vector can span and still share
+ * their corners: each cell past the first costs a select per gradient
+ * component, which remains cheaper than gathering them. */
+#define CoherentSpan 4
+
+/*
+ * The cells of a vector of voxels, when its lanes fall in span of them, next
+ * to each other along x: cell is the lattice coordinates of the first one,
+ * and base the index of its first corner in cells.
+ */
+typedef struct coherent_cells {
+  const noise_cpu_cells *cells;
+  GLfloat cell[4];
+  GLint base, span;
+} coherent_cells;
+
+/*
+ * Fills grad[a][i] with component a of the gradient of the i-th corner, x
+ * fastest, of each lane's cell, broadcast from the table rather than gathered
+ * lane by lane. Returns 0, leaving grad to the caller, when cc is NULL or a
+ * lane's cell, whose lattice coordinates are floored, isn't one of cc's.
+ */
+static int kernel(coherent_gradients)(const noise_cpu_tables *tables,
+                                      const coherent_cells *cc,
+                                      const VF *floored, VF grad[4][16]) {
+  if (!cc)
+    return 0;
+
+  const noise_cpu_cells *cells = cc->cells;
+  int dims = cells->dims;
+
+  VM in = vm_and(vm_ge(floored[0], vf_set1(cc->cell[0])),
+                 vm_gt(vf_set1(cc->cell[0] + cc->span), floored[0]));
+  for (int a = 1; a < dims; a++) {
+    VF cell = vf_set1(cc->cell[a]);
+    in = vm_and(in, vm_and(vm_ge(floored[a], cell), vm_ge(cell, floored[a])));
+  }
+  if (vm_bits(in) != (1u << VW) - 1)
+    return 0;
+
+  /* Lanes in the k-th cell or past it. */
+  VM past[CoherentSpan];
+  for (int k = 1; k < cc->span; k++)
+    past[k] = vm_ge(floored[0], vf_set1(cc->cell[0] + k));
+
+  for (int i = 0; i < 1 << dims; i++) {
+    const GLint *index = cells->index + cc->base + cells->corner[i];
+    for (int a = 0; a < dims; a++) {
+      const GLfloat *g = dims == 4 ? tables->gradients4d[a] :
+        tables->gradients3d[a];
+
+      grad[a][i] = vf_set1(g[index[0]]);
+      for (int k = 1; k < cc->span; k++)
+        grad[a][i] = vf_select(past[k], vf_set1(g[index[k]]), grad[a][i]);
+    }
+  }
+
+  return 1;
+}
+
+static VF kernel(perlin3d)(const noise_cpu_tables *tables,
+                           const coherent_cells *cc,
+                           VF px, VF py, VF pz) {
+  VF fx = vf_floor(px), fy = vf_floor(py), fz = vf_floor(pz);
+
+  VF dx[2] = {vf_sub(px, fx), vf_sub(px, vf_add(fx, vf_set1(1)))};
+  VF dy[2] = {vf_sub(py, fy), vf_sub(py, vf_add(fy, vf_set1(1)))};
+  VF dz[2] = {vf_sub(pz, fz), vf_sub(pz, vf_add(fz, vf_set1(1)))};
+
+  VF grad[4][16];
+  VF floored[3] = {fx, fy, fz};
+  if (!kernel(coherent_gradients)(tables, cc, floored, grad)) {
+    VI cx = kernel(lattice)(tables, fx);
+    VI cy = kernel(lattice)(tables, fy);
+    VI cz = kernel(lattice)(tables, fz);
+    VI start = kernel(hash_start)(tables);
+
+    int i = 0;
+    for (int z = 0; z < 2; z++) {
+      VI hash_z = kernel(lattice_hash)(tables, vi_add(cz, vi_set1(z)), start);
+      for (int y = 0; y < 2; y++) {
+        VI hash_y = kernel(lattice_hash)(tables, vi_add(cy, vi_set1(y)),
+                                         hash_z);
+        for (int x = 0; x < 2; x++) {
+          VI hash_x = kernel(lattice_hash)(tables, vi_add(cx, vi_set1(x)),
+                                           hash_y);
+          VI g = kernel(gradient3d_index)(tables, hash_x);
+
+          for (int a = 0; a < 3; a++)
+            grad[a][i] = vf_gather(tables->gradients3d[a], g);
+          i++;
+        }
+      }
+    }
+  }
+
+  VF noises[8];
+
+  int i = 0;
+  for (int z = 0; z < 2; z++) {
+    for (int y = 0; y < 2; y++) {
+      for (int x = 0; x < 2; x++) {
+        noises[i] = vf_add(vf_add(vf_mul(dx[x], grad[0][i]),
+                                  vf_mul(dy[y], grad[1][i])),
+                           vf_mul(dz[z], grad[2][i]));
+        i++;
+      }
+    }
+  }
+
+  VF t = kernel(perlin_smoothstep)(dx[0]);
+  VF u = kernel(perlin_smoothstep)(dy[0]);
+  VF v = kernel(perlin_smoothstep)(dz[0]);
+
+  for (int i = 0; i < 4; i++)
+    noises[i] = kernel(mix)(noises[i], noises[i+4], v);
+  for (int i = 0; i < 2; i++)
+    noises[i] = kernel(mix)(noises[i], noises[i+2], u);
+  return vf_mul(vf_set1(16), kernel(mix)(noises[0], noises[1], t));
+}
+
+static VF kernel(simplex_contribution)(const noise_cpu_tables *tables,
+                                       VI g, VF dx, VF dy, VF dz) {
+  VF gx = vf_gather(tables->gradients3d[0], g);
+  VF gy = vf_gather(tables->gradients3d[1], g);
+  VF gz = vf_gather(tables->gradients3d[2], g);
+
+  VF dist2 = vf_add(vf_add(vf_mul(dx, dx), vf_mul(dy, dy)), vf_mul(dz, dz));
+  VF t = vf_sub(vf_set1(0.6f), dist2);
+  VF dot = vf_add(vf_add(vf_mul(dx, gx), vf_mul(dy, gy)), vf_mul(dz, gz));
+
+  VF ret = vf_mul(vf_mul(vf_mul(vf_mul(vf_mul(vf_set1(8), t), t), t), t),
+                  dot);
+  return vf_select(vm_gt(t, vf_set1(0)), ret, vf_set1(0));
+}
+
+static VF kernel(simplex3d)(const noise_cpu_tables *tables,
+                            VF px, VF py, VF pz) {
+  VF skew = vf_div(vf_add(vf_add(px, py), pz), vf_set1(3));
+  VF fx = vf_floor(vf_add(px, skew));
+  VF fy = vf_floor(vf_add(py, skew));
+  VF fz = vf_floor(vf_add(pz, skew));
+
+  VI cx = kernel(lattice)(tables, fx);
+  VI cy = kernel(lattice)(tables, fy);
+  VI cz = kernel(lattice)(tables, fz);
+  VI start = kernel(hash_start)(tables);
+
+  VF unskew = vf_div(vf_add(vf_add(fx, fy), fz), vf_set1(6));
+  VF dx = vf_sub(px, vf_sub(fx, unskew));
+  VF dy = vf_sub(py, vf_sub(fy, unskew));
+  VF dz = vf_sub(pz, vf_sub(fz, unskew));
+
+  /* Branch-free version of find_simplex. */
+  VM xy = vm_ge(dx, dy), yz = vm_ge(dy, dz), xz = vm_ge(dx, dz);
+
+  VM ax = vm_and(xy, vm_or(yz, xz));
+  VM ay = vm_and(vm_not(xy), yz);
+  VM az = vm_or(vm_and(xy, vm_and(vm_not(yz), vm_not(xz))),
+                vm_and(vm_not(xy), vm_not(yz)));
+
+  VM bx = vm_or(xy, vm_and(yz, xz));
+  VM by = vm_or(vm_and(xy, yz), vm_not(xy));
+  VM bz = vm_or(vm_and(xy, vm_not(yz)),
+                vm_and(vm_not(xy), vm_not(vm_and(yz, xz))));
+
+  VF one = vf_set1(1), zero = vf_set1(0);
+  VF vx[4] = {zero, vf_select(ax, one, zero), vf_select(bx, one, zero), one};
+  VF vy[4] = {zero, vf_select(ay, one, zero), vf_select(by, one, zero), one};
+  VF vz[4] = {zero, vf_select(az, one, zero), vf_select(bz, one, zero), one};
+
+  VF ret = vf_set1(0);
+  for (int i = 0; i < 4; i++) {
+    VF offset = vf_set1((GLfloat)i/6.0f);
+
+    VF ix = i == 0 ? dx : vf_add(vf_sub(dx, vx[i]), offset);
+    VF iy = i == 0 ? dy : vf_add(vf_sub(dy, vy[i]), offset);
+    VF iz = i == 0 ? dz : vf_add(vf_sub(dz, vz[i]), offset);
+
+    VI hash_z = kernel(lattice_hash)(tables, vi_add(cz, vf_to_vi(vz[i])),
+                                     start);
+    VI hash_y = kernel(lattice_hash)(tables, vi_add(cy, vf_to_vi(vy[i])),
+                                     hash_z);
+    VI hash_x = kernel(lattice_hash)(tables, vi_add(cx, vf_to_vi(vx[i])),
+                                     hash_y);
+    VI g = kernel(gradient3d_index)(tables, hash_x);
+
+    ret = vf_add(ret, kernel(simplex_contribution)(tables, g, ix, iy, iz));
+  }
+
+  return vf_mul(vf_set1(16), ret);
+}
+
+static VF kernel(perlin4d)(const noise_cpu_tables *tables,
+                           const coherent_cells *cc,
+                           VF px, VF py, VF pz, VF pw) {
+  VF fx = vf_floor(px), fy = vf_floor(py);
+  VF fz = vf_floor(pz), fw = vf_floor(pw);
+
+  VF dx[2] = {vf_sub(px, fx), vf_sub(px, vf_add(fx, vf_set1(1)))};
+  VF dy[2] = {vf_sub(py, fy), vf_sub(py, vf_add(fy, vf_set1(1)))};
+  VF dz[2] = {vf_sub(pz, fz), vf_sub(pz, vf_add(fz, vf_set1(1)))};
+  VF dw[2] = {vf_sub(pw, fw), vf_sub(pw, vf_add(fw, vf_set1(1)))};
+
+  VF grad[4][16];
+  VF floored[4] = {fx, fy, fz, fw};
+  if (!kernel(coherent_gradients)(tables, cc, floored, grad)) {
+    VI cx = kernel(lattice)(tables, fx);
+    VI cy = kernel(lattice)(tables, fy);
+    VI cz = kernel(lattice)(tables, fz);
+    VI cw = kernel(lattice)(tables, fw);
+    VI start = kernel(hash_start)(tables);
+
+    int i = 0;
+    for (int w = 0; w < 2; w++) {
+      VI hash_w = kernel(lattice_hash)(tables, vi_add(cw, vi_set1(w)), start);
+      for (int z = 0; z < 2; z++) {
+        VI hash_z = kernel(lattice_hash)(tables, vi_add(cz, vi_set1(z)),
+                                         hash_w);
+        for (int y = 0; y < 2; y++) {
+          VI hash_y = kernel(lattice_hash)(tables, vi_add(cy, vi_set1(y)),
+                                           hash_z);
+          for (int x = 0; x < 2; x++) {
+            VI hash_x = kernel(lattice_hash)(tables, vi_add(cx, vi_set1(x)),
+                                             hash_y);
+            VI g = kernel(gradient4d_index)(tables, hash_x);
+
+            for (int a = 0; a < 4; a++)
+              grad[a][i] = vf_gather(tables->gradients4d[a], g);
+            i++;
+          }
+        }
+      }
+    }
+  }
+
+  VF noises[16];
+
+  int i = 0;
+  for (int w = 0; w < 2; w++) {
+    for (int z = 0; z < 2; z++) {
+      for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 2; x++) {
+          noises[i] = vf_add(vf_add(vf_add(vf_mul(dx[x], grad[0][i]),
+                                           vf_mul(dy[y], grad[1][i])),
+                                    vf_mul(dz[z], grad[2][i])),
+                             vf_mul(dw[w], grad[3][i]));
+          i++;
+        }
+      }
+    }
+  }
+
+  VF t = kernel(perlin_smoothstep)(dx[0]);
+  VF u = kernel(perlin_smoothstep)(dy[0]);
+  VF v = kernel(perlin_smoothstep)(dz[0]);
+  VF s = kernel(perlin_smoothstep)(dw[0]);
+
+  for (int i = 0; i < 8; i++)
+    noises[i] = kernel(mix)(noises[i], noises[i+8], s);
+  for (int i = 0; i < 4; i++)
+    noises[i] = kernel(mix)(noises[i], noises[i+4], v);
+  for (int i = 0; i < 2; i++)
+    noises[i] = kernel(mix)(noises[i], noises[i+2], u);
+  return vf_mul(vf_set1(16), kernel(mix)(noises[0], noises[1], t));
+}
+
+static VF kernel(simplex4d_contribution)(const noise_cpu_tables *tables,
+                                         VI g, VF dx, VF dy, VF dz, VF dw) {
+  VF gx = vf_gather(tables->gradients4d[0], g);
+  VF gy = vf_gather(tables->gradients4d[1], g);
+  VF gz = vf_gather(tables->gradients4d[2], g);
+  VF gw = vf_gather(tables->gradients4d[3], g);
+
+  VF dist2 = vf_add(vf_add(vf_add(vf_mul(dx, dx), vf_mul(dy, dy)),
+                           vf_mul(dz, dz)),
+                    vf_mul(dw, dw));
+  VF t = vf_sub(vf_set1(0.6f), dist2);
+  VF dot = vf_add(vf_add(vf_add(vf_mul(dx, gx), vf_mul(dy, gy)),
+                         vf_mul(dz, gz)),
+                  vf_mul(dw, gw));
+
+  VF ret = vf_mul(vf_mul(vf_mul(vf_mul(t, t), t), t), dot);
+  return vf_select(vm_gt(t, vf_set1(0)), ret, vf_set1(0));
+}
+
+static VF kernel(simplex4d)(const noise_cpu_tables *tables,
+                            VF px, VF py, VF pz, VF pw) {
+  const GLfloat f4 = 0.309016994374947f, g4 = 0.138196601125011f;
+
+  VF skew = vf_mul(vf_add(vf_add(vf_add(px, py), pz), pw), vf_set1(f4));
+  VF fx = vf_floor(vf_add(px, skew));
+  VF fy = vf_floor(vf_add(py, skew));
+  VF fz = vf_floor(vf_add(pz, skew));
+  VF fw = vf_floor(vf_add(pw, skew));
+
+  VI cx = kernel(lattice)(tables, fx);
+  VI cy = kernel(lattice)(tables, fy);
+  VI cz = kernel(lattice)(tables, fz);
+  VI cw = kernel(lattice)(tables, fw);
+  VI start = kernel(hash_start)(tables);
+
+  VF unskew = vf_mul(vf_add(vf_add(vf_add(fx, fy), fz), fw), vf_set1(g4));
+  VF dx = vf_sub(px, vf_sub(fx, unskew));
+  VF dy = vf_sub(py, vf_sub(fy, unskew));
+  VF dz = vf_sub(pz, vf_sub(fz, unskew));
+  VF dw = vf_sub(pw, vf_sub(fw, unskew));
+
+  /* Ranks of the coordinates, counted as in the shader. */
+  VF one = vf_set1(1), zero = vf_set1(0);
+  VF xy = vf_select(vm_ge(dx, dy), one, zero);
+  VF xz = vf_select(vm_ge(dx, dz), one, zero);
+  VF xw = vf_select(vm_ge(dx, dw), one, zero);
+  VF yz = vf_select(vm_ge(dy, dz), one, zero);
+  VF yw = vf_select(vm_ge(dy, dw), one, zero);
+  VF zw = vf_select(vm_ge(dz, dw), one, zero);
+
+  VF rx = vf_add(vf_add(xy, xz), xw);
+  VF ry = vf_add(vf_add(vf_sub(one, xy), yz), yw);
+  VF rz = vf_add(vf_add(vf_sub(one, xz), vf_sub(one, yz)), zw);
+  VF rw = vf_add(vf_add(vf_sub(one, xw), vf_sub(one, yw)), vf_sub(one, zw));
+
+  VF ret = vf_set1(0);
+  for (int i = 0; i < 5; i++) {
+    /* Vertex i steps along the axes ranked 4-i or higher. */
+    VF rank = vf_set1(4 - i);
+    VF vx = vf_select(vm_ge(rx, rank), one, zero);
+    VF vy = vf_select(vm_ge(ry, rank), one, zero);
+    VF vz = vf_select(vm_ge(rz, rank), one, zero);
+    VF vw = vf_select(vm_ge(rw, rank), one, zero);
+
+    VF offset = vf_set1((GLfloat)i*g4);
+
+    VF ix = i == 0 ? dx : vf_add(vf_sub(dx, vx), offset);
+    VF iy = i == 0 ? dy : vf_add(vf_sub(dy, vy), offset);
+    VF iz = i == 0 ? dz : vf_add(vf_sub(dz, vz), offset);
+    VF iw = i == 0 ? dw : vf_add(vf_sub(dw, vw), offset);
+
+    VI hash_w = kernel(lattice_hash)(tables, vi_add(cw, vf_to_vi(vw)), start);
+    VI hash_z = kernel(lattice_hash)(tables, vi_add(cz, vf_to_vi(vz)),
+                                     hash_w);
+    VI hash_y = kernel(lattice_hash)(tables, vi_add(cy, vf_to_vi(vy)),
+                                     hash_z);
+    VI hash_x = kernel(lattice_hash)(tables, vi_add(cx, vf_to_vi(vx)),
+                                     hash_y);
+    VI g = kernel(gradient4d_index)(tables, hash_x);
+
+    ret = vf_add(ret, kernel(simplex4d_contribution)(tables, g,
+                                                     ix, iy, iz, iw));
+  }
+
+  return vf_mul(vf_set1(370), ret);
+}
+
+/*
+ * Fills cc for the vector of voxels from the i-th of the row on, in the
+ * done-th octave, at factor, computing the positions of its first and last
+ * lanes as the kernels do. Returns NULL if the octave has no table, the lanes
+ * span more than CoherentSpan cells, or the table misses some of their
+ * corners. A single lane has nothing to share, and hashes its corners faster
+ * than it finds them in the table.
+ */
+static const coherent_cells *kernel(coherent)(const noise_cpu_row *row,
+                                              size_t i, size_t done,
+                                              GLfloat factor,
+                                              coherent_cells *cc) {
+  if (VW == 1 || done >= row->cell_octaves)
+    return NULL;
+
+  const noise_cpu_cells *cells = &row->cells[done];
+  GLfloat first = floorf((row->start_x + (GLfloat)(GLint)(row->x + i)*
+                          row->scale_x)*factor);
+  GLfloat last  = floorf((row->start_x + (GLfloat)(GLint)(row->x + i + VW - 1)*
+                          row->scale_x)*factor);
+  GLfloat span = (first < last ? last - first : first - last) + 1;
+  if (span > CoherentSpan)
+    return NULL;
+
+  cc->cells = cells;
+  cc->span = span;
+  cc->cell[0] = first < last ? first : last;
+  cc->cell[1] = floorf(row->y*factor);
+  cc->cell[2] = floorf(row->z*factor);
+  cc->cell[3] = floorf(row->w*factor);
+
+  cc->base = 0;
+  for (int a = cells->dims - 1; a >= 0; a--) {
+    GLint r = (GLint)cc->cell[a] - cells->origin[a];
+    GLint end = r + (a == 0 ? cc->span : 1);
+    if (r < 0 || end >= cells->size[a])
+      return NULL;
+    cc->base = cc->base*cells->size[a] + r;
+  }
+
+  return cc;
+}
+
+/* Sum of the amplitudes of the octaves from the done-th on, exact since
+ * they are powers of two. */
+static GLfloat kernel(octave_amplitudes)(const noise_cpu_row *row,
+                                         size_t done) {
+  return ldexpf(1, 1 - (int)done) - ldexpf(1, 1 - (int)row->octave_count);
+}
+
+/* src_octaves' octaves_decided, for every lane at once. */
+static int kernel(octaves_decided)(const noise_cpu_row *row, VF sum,
+                                   size_t done) {
+  if (!row->lazy)
+    return 0;
+
+  GLfloat target = row->threshold*kernel(octave_amplitudes)(row, 0);
+  GLfloat left = kernel(octave_amplitudes)(row, done)*row->bound +
+    NoiseOctaveMargin;
+
+  VM decided = vm_or(vm_gt(sum, vf_set1(target + left)),
+                     vm_gt(vf_set1(target - left), sum));
+  return vm_bits(decided) == (1u << VW) - 1;
+}
+
+/*
+ * Evaluates every voxel of a row, VW at a time. The last vector may extend
+ * past the end of the row, in which case it is computed into a temporary
+ * buffer and only the voxels that belong to the row are copied out. Lanes
+ * stop evaluating octaves together, so every voxel of a vector counts the
+ * same number of octaves.
+ */
+#define kernel_row(name, eval)                                            \
+  static size_t kernel(name##_row)(const noise_cpu_tables *tables,        \
+                                   const noise_cpu_row *row,              \
+                                   GLfloat *out) {                        \
+    VF y = vf_set1(row->y), z = vf_set1(row->z), w = vf_set1(row->w);     \
+    (void)w;                                                              \
+                                                                          \
+    size_t octaves = 0;                                                   \
+    for (size_t i = 0; i < row->count; i += VW) {                         \
+      VI index = vi_add(vi_set1((GLint)(row->x + i)), vi_ramp);           \
+      VF x = vf_add(vf_set1(row->start_x),                                \
+                    vf_mul(vi_to_vf(index), vf_set1(row->scale_x)));      \
+                                                                          \
+      VF ret = vf_set1(0);                                                \
+      GLfloat factor = 1.0, norm = 0.0;                                   \
+      size_t done = 0;                                                    \
+      for (; done < row->octave_count &&                                  \
+             !kernel(octaves_decided)(row, ret, done); done++) {          \
+        GLfloat amplitude = 1.0 / factor;                                 \
+        VF f = vf_set1(factor);                                           \
+        coherent_cells cells;                                             \
+        const coherent_cells *cc = kernel(coherent)(row, i, done, factor, \
+                                                    &cells);              \
+        (void)cc;                                                         \
+        ret = vf_add(ret, vf_mul(vf_set1(amplitude), eval));              \
+        norm += amplitude;                                                \
+        factor *= 2.0;                                                    \
+      }                                                                   \
+      if (row->lazy)                                                      \
+        norm = kernel(octave_amplitudes)(row, 0);                         \
+      ret = vf_div(ret, vf_set1(norm));                                   \
+                                                                          \
+      if (i + VW <= row->count) {                                         \
+        vf_storeu(out + i, ret);                                          \
+        octaves += done*VW;                                               \
+      }                                                                   \
+      else {                                                              \
+        GLfloat tail[VW];                                                 \
+        vf_storeu(tail, ret);                                             \
+        memcpy(out + i, tail, (row->count - i)*sizeof(*tail));            \
+        octaves += done*(row->count - i);                                 \
+      }                                                                   \
+    }                                                                     \
+                                                                          \
+    return octaves;                                                       \
+  }
+
+kernel_row(perlin3d,
+           kernel(perlin3d)(tables, cc, vf_mul(x, f), vf_mul(y, f),
+                            vf_mul(z, f)))
+kernel_row(simplex3d,
+           kernel(simplex3d)(tables, vf_mul(x, f), vf_mul(y, f),
+                             vf_mul(z, f)))
+kernel_row(perlin4d,
+           kernel(perlin4d)(tables, cc, vf_mul(x, f), vf_mul(y, f),
+                            vf_mul(z, f), vf_mul(w, f)))
+kernel_row(simplex4d,
+           kernel(simplex4d)(tables, vf_mul(x, f), vf_mul(y, f),
+                             vf_mul(z, f), vf_mul(w, f)))
+
+static void kernel(white_row)(const noise_cpu_white_row *row, GLfloat *out) {
+  /* Everything but x is the same along the row. */
+  GLuint inner = white_noise_hash(white_noise_hash(row->z ^ row->key) +
+                                  row->y);
+
+  VI key = vi_set1((GLint)row->key), row_hash = vi_set1((GLint)inner);
+  VF step = vf_set1(1.0f / (1 << 24));
+
+  for (size_t i = 0; i < row->count; i += VW) {
+    VI x = vi_add(vi_set1((GLint)(row->x + (GLuint)i)), vi_ramp);
+    VI hash = kernel(white_hash)(vi_xor(row_hash,
+                                        kernel(white_hash)(vi_xor(x, key))));
+    VF ret = vf_mul(vi_to_vf(vi_srli(hash, 8)), step);
+
+    if (i + VW <= row->count)
+      vf_storeu(out + i, ret);
+    else {
+      GLfloat tail[VW];
+      vf_storeu(tail, ret);
+      memcpy(out + i, tail, (row->count - i)*sizeof(*tail));
+    }
+  }
+}
+
+/* Compares VW values per instruction; since VW divides 64, a vector's bits
+ * never straddle two words. */
+static void kernel(threshold_row)(const GLfloat *noise, size_t count,
+                                  GLfloat threshold, uint64_t *bits) {
+  VF t = vf_set1(threshold);
+
+  for (size_t base = 0; base < count; base += 64) {
+    size_t end = count - base < 64 ? count : base + 64;
+
+    uint64_t word = 0;
+    size_t i = base;
+    for (; i + VW <= end; i += VW)
+      word |= (uint64_t)vm_bits(vm_ge(vf_loadu(noise + i), t)) << (i - base);
+    for (; i < end; i++)
+      word |= (uint64_t)(noise[i] >= threshold) << (i - base);
+
+    bits[base / 64] = word;
+  }
+}
+
+const noise_cpu_kernels NoiseCpuCat(noise_cpu_kernels, NoiseCpuSuffix) = {
+  kernel(perlin3d_row),
+  kernel(simplex3d_row),
+  kernel(perlin4d_row),
+  kernel(simplex4d_row),
+  kernel(white_row),
+  kernel(threshold_row),
+};
+
+#undef kernel_row
+#undef CoherentSpan
+#undef kernel
+#undef NoiseCpuCat
+#undef NoiseCpuCat_
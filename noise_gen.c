@@ -1,17 +1,205 @@
 #include "noise_gen.h"
+#include "noise_cpu.h"
+#include "noise_bounds.h"
 #include "shader_utils.h"
+#include "workgroup_tuner.h"
+#include "timer.h"
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <GL/glew.h>
 #include <stdio.h>
+#include <math.h>
+
+static void shuffle(GLint *array, size_t n, pcg32 *rng);
+
+static noise_hash_mode selected_hash_mode = NoiseHashTable;
+static noise_octave_mode selected_octave_mode = NoiseOctavesLazy;
+static int selected_cell_tables = 0;
+
+/* Buffer of the three counters incremented by NoiseOctavesCounted programs,
+ * created the first time one of them is used. */
+static GLuint octave_counter = 0;
+
+/* The #version line, the LocalSize*, HashInteger, OctaveCount, OutputBits,
+ * LazyOctaves, OctaveBound, OctaveMargin, NoiseBox*, CellTables and
+ * CellOctaves macros, count_octaves and count_skipped, followed by src_output
+ * and src_octaves, are prepended by compute_program, and src_cells appended
+ * for Perlin noise. */
+#define GLSL(code) #code
+
+/* Declares the output buffer and write_output, which stores a voxel in the
+ * format selected by OutputBits (see noise_output_format). Samples smaller
+ * than a word are combined with atomicOr into a buffer that is cleared before
+ * each dispatch, since neighbouring voxels can belong to other workgroups. */
+static const char *src_output = GLSL(
+  /* Couldn't get this to work using an image3D, not sure what I was doing
+   * wrong.  */
+  layout(std430, binding = 1) buffer outBuf {
+    uint data[];
+  };
+
+  uniform float threshold;
+
+  void write_output(int voxel, float value) {
+    uint i = uint(voxel);
+    if (OutputBits == 32)
+      data[i] = floatBitsToUint(value);
+    else if (OutputBits == 1) {
+      if (value >= threshold)
+        atomicOr(data[i >> 5], 1U << (i & 31U));
+    }
+    else {
+      const uint per_word = 32U / OutputBits;
+      const float steps = float((1U << OutputBits) - 1U);
+
+      uint quantized = uint(clamp(value, 0.0, 1.0)*steps + 0.5);
+      if (quantized != 0U)
+        atomicOr(data[i / per_word],
+                 quantized << (i % per_word * OutputBits));
+    }
+  }
+);
+
+/* Lets multioctave_noise stop once the threshold is decided, as described
+ * with noise_octave_mode. Amplitudes are powers of two, so their sums are
+ * exact. */
+static const char *src_octaves = GLSL(
+  /* Sum of the amplitudes of the octaves from the done-th on. */
+  float octave_amplitudes(int done) {
+    return exp2(1.0 - float(done)) - exp2(1.0 - float(OctaveCount));
+  }
+
+  bool octaves_decided(float sum, int done) {
+    if (!LazyOctaves)
+      return false;
+
+    float target = threshold*octave_amplitudes(0);
+    float left = octave_amplitudes(done)*OctaveBound + OctaveMargin;
+    return abs(sum - target) > left;
+  }
+
+  /* The sum is divided by every octave's amplitude even when some were
+   * skipped, which is what norm adds up to otherwise. */
+  float octave_norm(float norm) {
+    return LazyOctaves ? octave_amplitudes(0) : norm;
+  }
+
+  /* The noise_box_side of each workgroup, found by bind_group_sides. */
+  layout(std430, binding = 3) buffer groupSides {
+    uint group_sides[];
+  };
+
+  /* Whether the whole workgroup is known to lie below the threshold
+   * (NoiseBoxEmpty) or above it (NoiseBoxSolid), in which case value is on
+   * the same side. */
+  bool group_decided(out float value) {
+    if (!LazyOctaves)
+      return false;
+
+    uvec3 id = gl_WorkGroupID;
+    uvec3 count = gl_NumWorkGroups;
+    uint side = group_sides[id.x + count.x*(id.y + count.y*id.z)];
+
+    value = side == NoiseBoxSolid ? threshold : threshold - 1.0;
+    return side != NoiseBoxMixed;
+  }
+);
+
+/* Lets Perlin noise hash the corners of the lattice cells a workgroup spans
+ * once, into shared memory, as described with noise_set_cell_tables. Follows
+ * the noise's source, which defines CellDims, size, cell_position for the
+ * voxel at an image position and cell_gradient for a lattice point, masked as
+ * gradient_index expects. 3D noise leaves w at 0. */
+static const char *src_cells = GLSL(
+  /* Gradient indices of the lattice points around the cells of the first
+   * CellOctaves octaves: point p is at p - cell_origin in a box of cell_size
+   * points, which is 0 when they don't fit in CellPoints. */
+  const int CellPoints = 256;
+  shared int cell_gradients[CellOctaves*CellPoints];
+  shared ivec4 cell_origin[CellOctaves];
+  shared ivec4 cell_size[CellOctaves];
+
+  /* Positions only grow or shrink along each axis, so the workgroup's first
+   * and last voxels span all of its cells. Every invocation must call this,
+   * then barrier. */
+  void fill_cells() {
+    ivec3 first = ivec3(gl_WorkGroupID*gl_WorkGroupSize);
+    ivec3 last = min(first + ivec3(gl_WorkGroupSize) - 1, size - 1);
+    int invocations = LocalSizeX*LocalSizeY*LocalSizeZ;
+
+    float factor = 1.0;
+    for (int octave = 0; octave < CellOctaves; octave++) {
+      ivec4 a = ivec4(floor(cell_position(first)*factor));
+      ivec4 b = ivec4(floor(cell_position(last)*factor));
+
+      ivec4 origin = min(a, b);
+      ivec4 points = abs(b - a) + ivec4(2, 2, 2, CellDims == 4 ? 2 : 1);
+      if (points.x*points.y*points.z*points.w > CellPoints)
+        points = ivec4(0);
+
+      if (gl_LocalInvocationIndex == 0U) {
+        cell_origin[octave] = origin;
+        cell_size[octave] = points;
+      }
+
+      int count = points.x*points.y*points.z*points.w;
+      for (int i = int(gl_LocalInvocationIndex); i < count;
+           i += invocations) {
+        ivec4 p = origin + ivec4(i % points.x, i / points.x % points.y,
+                                 i / (points.x*points.y) % points.z,
+                                 i / (points.x*points.y*points.z));
+        cell_gradients[octave*CellPoints + i] =
+          cell_gradient(HashInteger ? p : p & 255);
+      }
+
+      factor *= 2.0;
+    }
+  }
+
+  /* Where the corners of cell, in the octave-th octave, start in
+   * cell_gradients, or -1 if the table doesn't have all of them. */
+  int cell_base(int octave, ivec4 cell) {
+    if (!CellTables || octave >= CellOctaves)
+      return -1;
+
+    ivec4 r = cell - cell_origin[octave];
+    ivec4 points = cell_size[octave];
+    ivec4 end = r + ivec4(1, 1, 1, CellDims == 4 ? 1 : 0);
+    if (any(lessThan(r, ivec4(0))) || any(greaterThanEqual(end, points)))
+      return -1;
+
+    return octave*CellPoints + r.x +
+      points.x*(r.y + points.y*(r.z + points.z*r.w));
+  }
 
-static void make_permutation_table(GLint *array, size_t n);
-static void shuffle(GLint *array, size_t n);
+  int cell_gradient_at(int base, int octave, ivec4 corner) {
+    ivec4 points = cell_size[octave];
+    return cell_gradients[base + corner.x +
+                          points.x*(corner.y + points.y*(corner.z +
+                                                         points.z*corner.w))];
+  }
+);
 
-#define GLSL(code) \
-  "#version 430\n" \
-  #code
+/* count_octaves for NoiseOctavesCounted, and for every other mode. */
+static const char *src_count_octaves =
+  "layout(std430, binding = 2) buffer octaveCounts {\n"
+  "  uint counted_voxels;\n"
+  "  uint counted_octaves;\n"
+  "  uint counted_skipped;\n"
+  "};\n"
+  "void count_octaves(int done) {\n"
+  "  atomicAdd(counted_voxels, 1U);\n"
+  "  atomicAdd(counted_octaves, uint(done));\n"
+  "}\n"
+  "void count_skipped() {\n"
+  "  atomicAdd(counted_voxels, 1U);\n"
+  "  atomicAdd(counted_skipped, 1U);\n"
+  "}\n";
+static const char *src_skip_octave_count =
+  "void count_octaves(int done) {}\n"
+  "void count_skipped() {}\n";
 
 void single_cell(size_t width, size_t height, size_t depth, GLfloat *noise,
                  size_t x, size_t y, size_t z) {
@@ -20,51 +208,269 @@ void single_cell(size_t width, size_t height, size_t depth, GLfloat *noise,
   noise[x + y*width + z*width*height] = 1.0;
 }
 
-void white_noise(size_t width, size_t height, size_t depth, GLfloat *noise) {
-  for (size_t i = 0; i < width*height*depth; i++)
-    noise[i] = (GLfloat)rand()/RAND_MAX;
+/* "lowbias32" (nullprogram.com/blog/2018/07/31): each input bit flips about
+ * half of the output bits, using only operations GLSL has for uints. */
+GLuint white_noise_hash(GLuint x) {
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+GLuint white_noise_key(uint64_t seed) {
+  return white_noise_hash((GLuint)seed ^ white_noise_hash(seed >> 32));
+}
+
+void white_noise(size_t width, size_t height, size_t depth, GLfloat *noise,
+                 uint64_t seed) {
+  white_noise_cpu(width, height, depth, noise, 0, 0, 0, seed);
 }
 
-static
-void perlin3d_like(size_t width, size_t height, size_t depth, GLfloat *noise,
-                   size_t octave_count, vec3 start, vec3 scale,
-                   const char *src);
+void noise_set_hash_mode(noise_hash_mode mode) {
+  selected_hash_mode = mode;
+}
+
+noise_hash_mode noise_current_hash_mode(void) {
+  return selected_hash_mode;
+}
+
+const char *noise_hash_mode_name(noise_hash_mode mode) {
+  switch (mode) {
+  case NoiseHashTable:   return "table";
+  case NoiseHashInteger: return "integer";
+  }
+
+  return "unknown";
+}
+
+void noise_set_octave_mode(noise_octave_mode mode) {
+  selected_octave_mode = mode;
+}
+
+noise_octave_mode noise_current_octave_mode(void) {
+  return selected_octave_mode;
+}
+
+void noise_set_cell_tables(int enabled) {
+  selected_cell_tables = enabled;
+}
+
+int noise_cell_tables(void) {
+  return selected_cell_tables;
+}
+
+/* Largest value of (0.6 - r²)⁴·r, the falloff of a simplex corner times the
+ * distance to it, reached where its derivative is 0, at r² = 0.6/9. */
+static double simplex_falloff_max(void) {
+  double r2 = 0.6/9, t = 0.6 - r2;
+  return t*t*t*t*sqrt(r2);
+}
+
+GLfloat noise_octave_bound(noise_kind kind) {
+  switch (kind) {
+  /* Perlin noise is a convex combination of the corners' dot(dist, g). Along
+   * each axis, the corners at distance t weigh 1 - s and those at 1 - t weigh
+   * s = smoothstep(t), and every gradient component is 0 or ±1, so the axis
+   * adds at most t(1 - s) + s(1 - t) = 1/2 - (1 - 2t)(1 - 2s)/2 <= 1/2:
+   * 16*3/2 in 3D and 16*4/2 in 4D. */
+  case NoisePerlin3d:  return 24;
+  case NoisePerlin4d:  return 32;
+  /* Each corner adds at most falloff·|dist|·|g|: 4 corners with |g| = √2,
+   * scaled by 8*16, and 5 corners with |g| = √3, scaled by 370. */
+  case NoiseSimplex3d: return 4*8*16*sqrt(2)*simplex_falloff_max();
+  case NoiseSimplex4d: return 5*370*sqrt(3)*simplex_falloff_max();
+  case NoiseWhite:     return 0;
+  }
+
+  return 0;
+}
+
+noise_octave_stats noise_take_octave_stats(void) {
+  noise_octave_stats stats = {0, 0, 0};
+  if (!octave_counter)
+    return stats;
+
+  GLuint counts[3];
+  const GLuint zero[3] = {0, 0, 0};
+
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, octave_counter);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counts), counts);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), zero);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  stats.voxels  = counts[0];
+  stats.octaves = counts[1];
+  stats.skipped = counts[2];
+  return stats;
+}
+
+const char *noise_output_name(noise_output_format format) {
+  switch (format) {
+  case NoiseOutputFloat:     return "float";
+  case NoiseOutputUnorm16:   return "unorm16";
+  case NoiseOutputUnorm8:    return "unorm8";
+  case NoiseOutputOccupancy: return "occupancy";
+  }
+
+  return "unknown";
+}
+
+size_t noise_output_size(noise_output_format format, size_t count) {
+  switch (format) {
+  case NoiseOutputFloat:     return count*sizeof(GLfloat);
+  case NoiseOutputUnorm16:   return (count + 1)/2*sizeof(GLuint);
+  case NoiseOutputUnorm8:    return (count + 3)/4*sizeof(GLuint);
+  case NoiseOutputOccupancy: return (count + 31)/32*sizeof(GLuint);
+  }
+
+  return 0;
+}
+
+GLfloat noise_output_sample(noise_output_format format, const void *data,
+                            size_t i) {
+  switch (format) {
+  case NoiseOutputFloat:
+    return ((const GLfloat *)data)[i];
+  case NoiseOutputUnorm16:
+    return ((const GLushort *)data)[i] / (GLfloat)UINT16_MAX;
+  case NoiseOutputUnorm8:
+    return ((const GLubyte *)data)[i] / (GLfloat)UINT8_MAX;
+  case NoiseOutputOccupancy:
+    return ((const GLuint *)data)[i / 32] >> i % 32 & 1;
+  }
+
+  return 0;
+}
+
+/* Zeroes the first size bytes of the buffer bound to GL_SHADER_STORAGE_BUFFER
+ * for the formats write_output combines with atomicOr. */
+static void clear_output(noise_output_format output, size_t size) {
+  if (output == NoiseOutputFloat)
+    return;
+
+  glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, size,
+                       GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+}
+
+static void noise3d_init(perlin3d_gen *gen, noise_kind kind, uint64_t seed);
+
+static GLuint compute_program(noise_kind kind, workgroup_size local_size,
+                              noise_hash_mode hash_mode, size_t octave_count,
+                              noise_output_format output,
+                              noise_octave_mode octaves, int cells,
+                              GLuint *shader);
+static GLuint program_variant(noise_kind kind, workgroup_size local_size,
+                              noise_hash_mode hash_mode, size_t octave_count,
+                              noise_output_format output);
+static void clear_output(noise_output_format output, size_t size);
+static int program_claim(GLuint prog, const void *user);
+static void program_forget(const void *user);
+static void bind_octave_counter(GLuint prog);
+
+/* A dispatch of a width×height×depth volume sampled at start + i*scale. */
+typedef struct group_sides {
+  const noise_cpu_tables *tables;
+  noise_kind kind;
+  size_t octave_count;
+  GLfloat threshold;
+  vec4 start, scale;
+
+  workgroup_size local_size;
+  size_t width, height, depth;
+} group_sides;
+
+static void bind_group_sides(GLuint prog, const group_sides *job,
+                             GLuint buffer, scratch_buffer *scratch);
+static void bound_tables_init(struct noise_cpu_tables **tables,
+                              uint64_t seed);
+static workgroup_size workgroup_size_for(noise_kind kind);
+static void dispatch(workgroup_size local_size,
+                     size_t width, size_t height, size_t depth);
 
 static const char *src_perlin3d = GLSL(
-  layout(local_size_x=1, local_size_y=1, local_size_z=1) in;
+  layout(local_size_x=LocalSizeX, local_size_y=LocalSizeY,
+         local_size_z=LocalSizeZ) in;
 
-  layout(packed, binding = 0) buffer inBuf {
-    vec3 gradients[12];
+  layout(std430, binding = 0) buffer inBuf {
+    vec4 gradients[12];
     int permutations[512];
   };
 
-  /* Couldn't get this to work using an image3D, not sure what I was doing
-   * wrong.  */
-  layout(std430, binding = 1) buffer outBuf {
-    float data[];
-  };
-
   uniform ivec3 size;
 
   uniform vec3 start;
   uniform vec3 scale;
 
-  uniform int octave_count;
+  uniform uint key;
 
   float perlin_smoothstep(float t) {
     return t*t*t*(t*(t*6 - 15) + 10);
   }
 
+  uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+  }
+
   int gradient_index(ivec3 pos) {
+    if (HashInteger) {
+      uvec3 p = uvec3(pos);
+      uint hash_x = hash(hash(hash(p.z + key) + p.y) + p.x);
+      return int(((hash_x >> 8) * 12U) >> 24);
+    }
+
     int hash_z = permutations[pos.z];
     int hash_y = permutations[pos.y + hash_z];
     int hash_x = permutations[pos.x + hash_y];
     return hash_x % 12;
   }
 
-  float perlin_noise(vec3 pos) {
-    ivec3 cell = ivec3(pos);
-    ivec3 cell_mod256 = cell % 256;
+  vec3 voxel_position(ivec3 image_pos) {
+    return vec3(start) + vec3(image_pos)*vec3(scale);
+  }
+
+  /* What src_cells needs from this noise, and what it defines. */
+  const int CellDims = 3;
+
+  vec4 cell_position(ivec3 image_pos) {
+    return vec4(voxel_position(image_pos), 0);
+  }
+
+  int cell_gradient(ivec4 p) {
+    return gradient_index(p.xyz);
+  }
+
+  void fill_cells();
+  int cell_base(int octave, ivec4 cell);
+  int cell_gradient_at(int base, int octave, ivec4 corner);
+
+  float perlin_noise(vec3 pos, int octave) {
+    ivec3 cell = ivec3(floor(pos));
+    ivec3 lattice = HashInteger ? cell : cell & 255;
+
+    /* Corners come from the workgroup's table when it has all of them. The
+     * branch covers all of them at once, so that both aren't evaluated. */
+    int base = cell_base(octave, ivec4(cell, 0));
+
+    int g[8];
+    for (int z = 0; z < 2; z++) {
+      for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 2; x++) {
+          int corner = x + 2*y + 4*z;
+          if (base >= 0)
+            g[corner] = cell_gradient_at(base, octave, ivec4(x,y,z,0));
+          else
+            g[corner] = gradient_index(lattice + ivec3(x,y,z));
+        }
+      }
+    }
 
     vec3 dist[8];
     float noises[8];
@@ -73,10 +479,8 @@ static const char *src_perlin3d = GLSL(
     for (int z = 0; z < 2; z++) {
       for (int y = 0; y < 2; y++) {
         for (int x = 0; x < 2; x++) {
-          int g = gradient_index(cell_mod256 + ivec3(x,y,z));
-
           dist[i]   = pos - vec3(cell + ivec3(x,y,z));
-          noises[i] = dot(dist[i], gradients[g]);
+          noises[i] = dot(dist[i], gradients[g[i]].xyz);
 
           i++;
         }
@@ -95,55 +499,93 @@ static const char *src_perlin3d = GLSL(
 
   }
 
-  float multioctave_noise(int n, vec3 pos) {
+  float multioctave_noise(vec3 pos) {
+    float decided;
+    if (group_decided(decided)) {
+      count_skipped();
+      return decided;
+    }
+
     float ret = 0.0;
     float factor = 1.0;
     float norm = 0.0;
-    for (int i = 0; i < n; i++) {
+    int done = 0;
+    for (; done < OctaveCount && !octaves_decided(ret, done); done++) {
       float amplitude = 1.0 / factor;
-      ret += amplitude * perlin_noise(pos * factor);
+      ret += amplitude * perlin_noise(pos * factor, done);
       norm += amplitude;
       factor *= 2.0;
     }
 
-    return ret / norm;
+    count_octaves(done);
+    return ret / octave_norm(norm);
   }
 
   void main() {
+    /* Every invocation takes part, including those past the volume. */
+    if (CellTables) {
+      float decided;
+      if (!group_decided(decided))
+        fill_cells();
+      barrier();
+    }
+
     ivec3 image_pos = ivec3(gl_GlobalInvocationID);
-    vec3  noise_pos = vec3(start) + vec3(image_pos)*vec3(scale);
+    if (any(greaterThanEqual(image_pos, size)))
+      return;
+
+    vec3  noise_pos = voxel_position(image_pos);
 
-    data[image_pos.x + size.x*image_pos.y + size.x*size.y*image_pos.z] =
-      multioctave_noise(octave_count, noise_pos);
+    write_output(image_pos.x + size.x*image_pos.y + size.x*size.y*image_pos.z,
+                 multioctave_noise(noise_pos));
   }
 );
 
+void perlin3d_init(perlin3d_gen *gen, uint64_t seed) {
+  noise3d_init(gen, NoisePerlin3d, seed);
+}
+
 void perlin3d(size_t width, size_t height, size_t depth, GLfloat *noise,
-               size_t octave_count, vec3 start, vec3 scale) {
-  perlin3d_like(width, height, depth, noise, octave_count, start, scale,
-                src_perlin3d);
+               size_t octave_count, vec3 start, vec3 scale, uint64_t seed) {
+  perlin3d_gen gen;
+  perlin3d_init(&gen, seed);
+  perlin3d_generate(&gen, width, height, depth, noise,
+                    octave_count, start, scale);
+  perlin3d_release(&gen);
 }
 
 static const char *src_simplex3d = GLSL(
-  layout(local_size_x=1, local_size_y=1, local_size_z=1) in;
+  layout(local_size_x=LocalSizeX, local_size_y=LocalSizeY,
+         local_size_z=LocalSizeZ) in;
 
-  layout(packed, binding = 0) buffer inBuf {
-    vec3 gradients[12];
+  layout(std430, binding = 0) buffer inBuf {
+    vec4 gradients[12];
     int permutations[512];
   };
 
-  layout(std430, binding = 1) buffer outBuf {
-    float data[];
-  };
-
   uniform ivec3 size;
 
   uniform vec3 start;
   uniform vec3 scale;
 
-  uniform int octave_count;
+  uniform uint key;
+
+  uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+  }
 
   int gradient_index(ivec3 pos) {
+    if (HashInteger) {
+      uvec3 p = uvec3(pos);
+      uint hash_x = hash(hash(hash(p.z + key) + p.y) + p.x);
+      return int(((hash_x >> 8) * 12U) >> 24);
+    }
+
     int hash_z = permutations[pos.z];
     int hash_y = permutations[pos.y + hash_z];
     int hash_x = permutations[pos.x + hash_y];
@@ -197,8 +639,8 @@ static const char *src_simplex3d = GLSL(
   }
 
   float simplex_noise(vec3 pos) {
-    ivec3 cell = ivec3(skew(pos));
-    ivec3 cell_mod256 = cell % 256;
+    ivec3 cell = ivec3(floor(skew(pos)));
+    ivec3 lattice = HashInteger ? cell : cell & 255;
 
     vec3 dist[4];
     dist[0] = pos - unskew(vec3(cell));
@@ -218,53 +660,172 @@ static const char *src_simplex3d = GLSL(
 
     float ret = 0.0;
     for (int i = 0; i < 4; i++) {
-      int g = gradient_index(cell_mod256 + ivec3(vertex[i]));
-      ret += contribution(dist[i], gradients[g]);
+      int g = gradient_index(lattice + ivec3(vertex[i]));
+      ret += contribution(dist[i], gradients[g].xyz);
     }
     return 16*ret;
   }
 
-  float multioctave_noise(int n, vec3 pos) {
+  float multioctave_noise(vec3 pos) {
+    float decided;
+    if (group_decided(decided)) {
+      count_skipped();
+      return decided;
+    }
+
     float ret = 0.0;
     float factor = 1.0;
     float norm = 0.0;
-    for (int i = 0; i < n; i++) {
+    int done = 0;
+    for (; done < OctaveCount && !octaves_decided(ret, done); done++) {
       float amplitude = 1.0 / factor;
       ret += amplitude * simplex_noise(pos * factor);
       norm += amplitude;
       factor *= 2.0;
     }
 
-    return ret / norm;
+    count_octaves(done);
+    return ret / octave_norm(norm);
   }
 
   void main() {
     ivec3 image_pos = ivec3(gl_GlobalInvocationID);
+    if (any(greaterThanEqual(image_pos, size)))
+      return;
+
     vec3  noise_pos = vec3(start) + vec3(image_pos)*vec3(scale);
 
-    data[image_pos.x + size.x*image_pos.y + size.x*size.y*image_pos.z] =
-      multioctave_noise(octave_count, noise_pos);
+    write_output(image_pos.x + size.x*image_pos.y + size.x*size.y*image_pos.z,
+                 multioctave_noise(noise_pos));
   }
 );
 
+void simplex3d_init(simplex3d_gen *gen, uint64_t seed) {
+  noise3d_init(gen, NoiseSimplex3d, seed);
+}
+
+void simplex3d_release(simplex3d_gen *gen) {
+  perlin3d_release(gen);
+}
+
+void simplex3d_set_output(simplex3d_gen *gen, noise_output_format format,
+                          GLfloat threshold) {
+  perlin3d_set_output(gen, format, threshold);
+}
+
+void simplex3d_generate(simplex3d_gen *gen,
+                        size_t width, size_t height, size_t depth,
+                        void *noise,
+                        size_t octave_count, vec3 start, vec3 scale) {
+  perlin3d_generate(gen, width, height, depth, noise,
+                    octave_count, start, scale);
+}
+
 void simplex3d(size_t width, size_t height, size_t depth, GLfloat *noise,
-               size_t octave_count, vec3 start, vec3 scale) {
-  perlin3d_like(width, height, depth, noise, octave_count, start, scale,
-                src_simplex3d);
+               size_t octave_count, vec3 start, vec3 scale, uint64_t seed) {
+  simplex3d_gen gen;
+  simplex3d_init(&gen, seed);
+  simplex3d_generate(&gen, width, height, depth, noise,
+                     octave_count, start, scale);
+  simplex3d_release(&gen);
+}
+
+static const char *src_white = GLSL(
+  layout(local_size_x=LocalSizeX, local_size_y=LocalSizeY,
+         local_size_z=LocalSizeZ) in;
+
+  uniform ivec3 size;
+  uniform ivec3 origin;
+  uniform uint key;
+
+  uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+  }
+
+  void main() {
+    ivec3 image_pos = ivec3(gl_GlobalInvocationID);
+    if (any(greaterThanEqual(image_pos, size)))
+      return;
+
+    uvec3 pos = uvec3(origin) + gl_GlobalInvocationID;
+    uint row = hash(hash(pos.z ^ key) + pos.y);
+
+    write_output(image_pos.x + size.x*image_pos.y + size.x*size.y*image_pos.z,
+                 float(hash(row ^ hash(pos.x ^ key)) >> 8) *
+                 (1.0 / 16777216.0));
+  }
+);
+
+void white_init(white_gen *gen) {
+  /* Allocated by white_generate once the size is known. */
+  glGenBuffers(1, &gen->shader_output);
+  gen->capacity = 0;
+
+  gen->local_size = workgroup_size_for(NoiseWhite);
+  white_set_output(gen, NoiseOutputFloat, 0);
+}
+
+void white_release(white_gen *gen) {
+  glDeleteBuffers(1, &gen->shader_output);
+}
+
+void white_set_output(white_gen *gen, noise_output_format format,
+                      GLfloat threshold) {
+  /* Every uniform is set by each call, so the program can be shared without
+   * keeping track of who used it last. */
+  gen->output    = format;
+  gen->threshold = threshold;
+  gen->prog = program_variant(NoiseWhite, gen->local_size, NoiseHashTable, 0,
+                              format);
+
+  gen->uniforms.size      = glGetUniformLocation(gen->prog, "size");
+  gen->uniforms.origin    = glGetUniformLocation(gen->prog, "origin");
+  gen->uniforms.key       = glGetUniformLocation(gen->prog, "key");
+  gen->uniforms.threshold = glGetUniformLocation(gen->prog, "threshold");
+}
+
+void white_generate(white_gen *gen,
+                    size_t width, size_t height, size_t depth,
+                    void *noise, GLint x, GLint y, GLint z, uint64_t seed) {
+  size_t size = noise_output_size(gen->output, width*height*depth);
+
+  glUseProgram(gen->prog);
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, gen->shader_output);
+  if (size > gen->capacity) {
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_STREAM_READ);
+    gen->capacity = size;
+  }
+
+  clear_output(gen->output, size);
+
+  glUniform3i(gen->uniforms.size, width, height, depth);
+  glUniform3i(gen->uniforms.origin, x, y, z);
+  glUniform1ui(gen->uniforms.key, white_noise_key(seed));
+  glUniform1f(gen->uniforms.threshold, gen->threshold);
+
+  dispatch(gen->local_size, width, height, depth);
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, noise);
+  glUseProgram(0);
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
 static const char *src_perlin4d = GLSL(
-  layout(local_size_x=1, local_size_y=1, local_size_z=1) in;
+  layout(local_size_x=LocalSizeX, local_size_y=LocalSizeY,
+         local_size_z=LocalSizeZ) in;
 
-  layout(packed, binding = 0) buffer inBuf {
+  layout(std430, binding = 0) buffer inBuf {
     vec4 gradients[32];
     int permutations[512];
   };
 
-  layout(std430, binding = 1) buffer outBuf {
-    float data[];
-  };
-
   uniform ivec3 size;
 
   uniform vec4 start;
@@ -272,13 +833,28 @@ static const char *src_perlin4d = GLSL(
 
   uniform float slice_w;
 
-  uniform int octave_count;
+  uniform uint key;
 
   float perlin_smoothstep(float t) {
     return t*t*t*(t*(t*6 - 15) + 10);
   }
 
+  uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+  }
+
   int gradient_index(ivec4 pos) {
+    if (HashInteger) {
+      uvec4 p = uvec4(pos);
+      uint hash_x = hash(hash(hash(hash(p.w + key) + p.z) + p.y) + p.x);
+      return int(hash_x >> 27);
+    }
+
     int hash_w = permutations[pos.w];
     int hash_z = permutations[pos.z + hash_w];
     int hash_y = permutations[pos.y + hash_z];
@@ -286,9 +862,46 @@ static const char *src_perlin4d = GLSL(
     return hash_x % 32;
   }
 
-  float perlin_noise(vec4 pos) {
-    ivec4 cell = ivec4(pos);
-    ivec4 cell_mod256 = cell % 256;
+  vec4 voxel_position(ivec3 image_pos) {
+    return start + vec4(image_pos*scale.xyz, 0) +
+      vec4(0, 0, 0, slice_w*scale.w);
+  }
+
+  /* As in src_perlin3d. */
+  const int CellDims = 4;
+
+  vec4 cell_position(ivec3 image_pos) {
+    return voxel_position(image_pos);
+  }
+
+  int cell_gradient(ivec4 p) {
+    return gradient_index(p);
+  }
+
+  void fill_cells();
+  int cell_base(int octave, ivec4 cell);
+  int cell_gradient_at(int base, int octave, ivec4 corner);
+
+  float perlin_noise(vec4 pos, int octave) {
+    ivec4 cell = ivec4(floor(pos));
+    ivec4 lattice = HashInteger ? cell : cell & 255;
+
+    int base = cell_base(octave, cell);
+
+    int g[16];
+    for (int w = 0; w < 2; w++) {
+      for (int z = 0; z < 2; z++) {
+        for (int y = 0; y < 2; y++) {
+          for (int x = 0; x < 2; x++) {
+            int corner = x + 2*y + 4*z + 8*w;
+            if (base >= 0)
+              g[corner] = cell_gradient_at(base, octave, ivec4(x,y,z,w));
+            else
+              g[corner] = gradient_index(lattice + ivec4(x,y,z,w));
+          }
+        }
+      }
+    }
 
     vec4 dist[16];
     float noises[16];
@@ -298,10 +911,8 @@ static const char *src_perlin4d = GLSL(
       for (int z = 0; z < 2; z++) {
         for (int y = 0; y < 2; y++) {
           for (int x = 0; x < 2; x++) {
-            int g = gradient_index(cell_mod256 + ivec4(x,y,z,w));
-
             dist[i]   = pos - vec4(cell + ivec4(x,y,z,w));
-            noises[i] = dot(dist[i], gradients[g]);
+            noises[i] = dot(dist[i], gradients[g[i]]);
 
             i++;
           }
@@ -323,34 +934,181 @@ static const char *src_perlin4d = GLSL(
     return 16*mix(noises[0], noises[1], t);
   }
 
-  float multioctave_noise(int n, vec4 pos) {
+  float multioctave_noise(vec4 pos) {
+    float decided;
+    if (group_decided(decided)) {
+      count_skipped();
+      return decided;
+    }
+
+    float ret = 0.0;
+    float factor = 1.0;
+    float norm = 0.0;
+    int done = 0;
+    for (; done < OctaveCount && !octaves_decided(ret, done); done++) {
+      float amplitude = 1.0 / factor;
+      ret += amplitude * perlin_noise(pos * factor, done);
+      norm += amplitude;
+      factor *= 2.0;
+    }
+
+    count_octaves(done);
+    return ret / octave_norm(norm);
+  }
+
+  void main() {
+    if (CellTables) {
+      float decided;
+      if (!group_decided(decided))
+        fill_cells();
+      barrier();
+    }
+
+    ivec3 image_pos = ivec3(gl_GlobalInvocationID);
+    if (any(greaterThanEqual(image_pos, size)))
+      return;
+
+    vec4  noise_pos = voxel_position(image_pos);
+
+    write_output(image_pos.x + size.x*image_pos.y + size.x*size.y*image_pos.z,
+                 multioctave_noise(noise_pos));
+  }
+);
+
+static const char *src_simplex4d = GLSL(
+  layout(local_size_x=LocalSizeX, local_size_y=LocalSizeY,
+         local_size_z=LocalSizeZ) in;
+
+  layout(std430, binding = 0) buffer inBuf {
+    vec4 gradients[32];
+    int permutations[512];
+  };
+
+  uniform ivec3 size;
+
+  uniform vec4 start;
+  uniform vec4 scale;
+
+  uniform float slice_w;
+
+  uniform uint key;
+
+  uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+  }
+
+  int gradient_index(ivec4 pos) {
+    if (HashInteger) {
+      uvec4 p = uvec4(pos);
+      uint hash_x = hash(hash(hash(hash(p.w + key) + p.z) + p.y) + p.x);
+      return int(hash_x >> 27);
+    }
+
+    int hash_w = permutations[pos.w];
+    int hash_z = permutations[pos.z + hash_w];
+    int hash_y = permutations[pos.y + hash_z];
+    int hash_x = permutations[pos.x + hash_y];
+    return hash_x % 32;
+  }
+
+  /* (sqrt(5) - 1)/4 and (5 - sqrt(5))/20 */
+  const float F4 = 0.309016994374947;
+  const float G4 = 0.138196601125011;
+
+  float contribution(vec4 dist, vec4 g) {
+    float t = 0.6 - dot(dist,dist);
+    return t > 0 ? t*t*t*t*dot(dist,g) : 0;
+  }
+
+  float simplex_noise(vec4 pos) {
+    float s = (pos.x+pos.y+pos.z+pos.w)*F4;
+    vec4 origin = floor(pos + vec4(s));
+    ivec4 cell = ivec4(origin);
+    ivec4 lattice = HashInteger ? cell : cell & 255;
+
+    float t = (origin.x+origin.y+origin.z+origin.w)*G4;
+
+    vec4 dist[5];
+    dist[0] = pos - (origin - vec4(t));
+
+    /* The simplex containing pos is found by sorting the coordinates of
+     * dist[0]: vertex i is one step further along each of the i largest. */
+    vec4 rank = vec4(0);
+    vec3 is_x = step(dist[0].yzw, dist[0].xxx);
+    rank.x    += is_x.x + is_x.y + is_x.z;
+    rank.yzw  += 1.0 - is_x;
+    vec2 is_y = step(dist[0].zw, dist[0].yy);
+    rank.y    += is_y.x + is_y.y;
+    rank.zw   += 1.0 - is_y;
+    float is_z = step(dist[0].w, dist[0].z);
+    rank.z    += is_z;
+    rank.w    += 1.0 - is_z;
+
+    vec4 vertex[5];
+    vertex[0] = vec4(0);
+    vertex[1] = step(vec4(3), rank);
+    vertex[2] = step(vec4(2), rank);
+    vertex[3] = step(vec4(1), rank);
+    vertex[4] = vec4(1);
+
+    for (int i = 1; i < 5; i++)
+      dist[i] = dist[0] - vertex[i] + vec4(float(i)*G4);
+
+    float ret = 0.0;
+    for (int i = 0; i < 5; i++) {
+      int g = gradient_index(lattice + ivec4(vertex[i]));
+      ret += contribution(dist[i], gradients[g]);
+    }
+    /* Scaled to spread like perlin_noise's values, so that DensityThreshold
+     * fills a similar share of the level. */
+    return 370*ret;
+  }
+
+  float multioctave_noise(vec4 pos) {
+    float decided;
+    if (group_decided(decided)) {
+      count_skipped();
+      return decided;
+    }
+
     float ret = 0.0;
     float factor = 1.0;
     float norm = 0.0;
-    for (int i = 0; i < n; i++) {
+    int done = 0;
+    for (; done < OctaveCount && !octaves_decided(ret, done); done++) {
       float amplitude = 1.0 / factor;
-      ret += amplitude * perlin_noise(pos * factor);
+      ret += amplitude * simplex_noise(pos * factor);
       norm += amplitude;
       factor *= 2.0;
     }
 
-    return ret / norm;
+    count_octaves(done);
+    return ret / octave_norm(norm);
   }
 
   void main() {
     ivec3 image_pos = ivec3(gl_GlobalInvocationID);
+    if (any(greaterThanEqual(image_pos, size)))
+      return;
+
     vec4  noise_pos = start + vec4(image_pos*scale.xyz, 0) +
                       vec4(0, 0, 0, slice_w*scale.w);
 
-    data[image_pos.x + size.x*image_pos.y + size.x*size.y*image_pos.z] =
-      multioctave_noise(octave_count, noise_pos);
+    write_output(image_pos.x + size.x*image_pos.y + size.x*size.y*image_pos.z,
+                 multioctave_noise(noise_pos));
   }
 );
 
-static const GLfloat gradients4d[] = {
+const GLfloat gradients4d[4*Gradient4dCount] = {
    0,  1,  1,  1,
    0,  1,  1, -1,
    0,  1, -1,  1,
+   0,  1, -1, -1,
 
    0, -1,  1,  1,
    0, -1,  1, -1,
@@ -388,17 +1146,24 @@ static const GLfloat gradients4d[] = {
   -1, -1, -1,  0
 };
 
-#define PermutationTableSize 256
+static void noise4d_init(perlin4d_gen *gen, noise_kind kind,
+                         size_t width, size_t height, size_t depth,
+                         size_t octave_count, vec4 start, vec4 scale,
+                         uint64_t seed) {
+  gen->kind         = kind;
+  gen->hash_mode    = selected_hash_mode;
+  gen->octave_count = octave_count;
 
-void perlin4d_init(perlin4d_gen *gen,
-                   size_t width, size_t height, size_t depth,
-                   size_t octave_count, vec4 start, vec4 scale) {
   gen->width  = width;
   gen->height = height;
   gen->depth  = depth;
 
+  gen->start = start;
+  gen->scale = scale;
+  gen->key   = white_noise_key(seed);
+
   GLint permutations[PermutationTableSize];
-  make_permutation_table(permutations, PermutationTableSize);
+  make_permutation_table(permutations, PermutationTableSize, seed);
 
   glGenBuffers(1, &gen->shader_input);
   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, gen->shader_input);
@@ -414,133 +1179,900 @@ void perlin4d_init(perlin4d_gen *gen,
                   sizeof(permutations), permutations);
 
   glGenBuffers(1, &gen->shader_output);
+
+  bound_tables_init(&gen->bound_tables, seed);
+  glGenBuffers(1, &gen->shader_sides);
+  scratch_init(&gen->sides);
+
+  gen->local_size = workgroup_size_for(kind);
+  perlin4d_set_output(gen, NoiseOutputFloat, 0);
+  /* glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0); */
+}
+
+void perlin4d_set_output(perlin4d_gen *gen, noise_output_format format,
+                         GLfloat threshold) {
+  gen->output    = format;
+  gen->threshold = threshold;
+
   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, gen->shader_output);
-  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLfloat)*width*height*depth,
+  glBufferData(GL_SHADER_STORAGE_BUFFER,
+               noise_output_size(format, gen->width*gen->height*gen->depth),
                NULL, GL_STREAM_READ);
 
-  gen->shader = create_shader(GL_COMPUTE_SHADER, src_perlin4d);
-  gen->prog = glCreateProgram();
-  glAttachShader(gen->prog, gen->shader);
-  glLinkProgram(gen->prog);
-  check_link_errors(gen->prog);
+  /* The threshold may have changed without the variant changing. */
+  program_forget(gen);
+  gen->prog = program_variant(gen->kind, gen->local_size, gen->hash_mode,
+                              gen->octave_count, format);
+  gen->slice_w = glGetUniformLocation(gen->prog, "slice_w");
+}
 
+/* Binds the program, and the octave counter and workgroup sides it may use
+ * for slice w, setting every uniform but slice_w if another generator used it
+ * since this one last did. */
+static void noise4d_use(perlin4d_gen *gen, GLfloat w) {
   glUseProgram(gen->prog);
 
-  glUniform3i(glGetUniformLocation(gen->prog, "size"), width, height, depth);
+  vec4 start = gen->start;
+  start.w += w*gen->scale.w;
+
+  group_sides sides = {
+    gen->bound_tables, gen->kind, gen->octave_count, gen->threshold,
+    start, gen->scale, gen->local_size, gen->width, gen->height, gen->depth,
+  };
+  bind_group_sides(gen->prog, &sides, gen->shader_sides, &gen->sides);
+  bind_octave_counter(gen->prog);
+  if (!program_claim(gen->prog, gen))
+    return;
+
+  glUniform1ui(glGetUniformLocation(gen->prog, "key"), gen->key);
+  glUniform3i(glGetUniformLocation(gen->prog, "size"),
+              gen->width, gen->height, gen->depth);
   glUniform4f(glGetUniformLocation(gen->prog, "start"),
-              start.x, start.y, start.z, start.w);
+              gen->start.x, gen->start.y, gen->start.z, gen->start.w);
   glUniform4f(glGetUniformLocation(gen->prog, "scale"),
-              scale.x, scale.y, scale.z, scale.w);
-  glUniform1i(glGetUniformLocation(gen->prog, "octave_count"), octave_count);
+              gen->scale.x, gen->scale.y, gen->scale.z, gen->scale.w);
+  glUniform1f(glGetUniformLocation(gen->prog, "threshold"), gen->threshold);
+}
 
-  gen->slice_w = glGetUniformLocation(gen->prog, "slice_w");
-  glUseProgram(0);
-  /* glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0); */
+void perlin4d_init(perlin4d_gen *gen,
+                   size_t width, size_t height, size_t depth,
+                   size_t octave_count, vec4 start, vec4 scale,
+                   uint64_t seed) {
+  noise4d_init(gen, NoisePerlin4d, width, height, depth,
+               octave_count, start, scale, seed);
 }
 
 void perlin4d_release(perlin4d_gen *gen) {
-  glDeleteProgram(gen->prog);
-  glDeleteShader(gen->shader);
+  program_forget(gen);
+
+  scratch_release(&gen->sides);
+  glDeleteBuffers(1, &gen->shader_sides);
+  free(gen->bound_tables);
 
   glDeleteBuffers(1, &gen->shader_output);
   glDeleteBuffers(1, &gen->shader_input);
 }
 
-void perlin4d_slice(perlin4d_gen *gen, GLfloat w, GLfloat *noise) {
-  glUseProgram(gen->prog);
+void perlin4d_dispatch(perlin4d_gen *gen, GLfloat w) {
+  noise4d_use(gen, w);
 
-  /* glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, gen->shader_input); */
-  /* glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, gen->shader_output); */
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, gen->shader_input);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, gen->shader_output);
+  clear_output(gen->output, noise_output_size(gen->output, gen->width*
+                                              gen->height*gen->depth));
   glUniform1f(gen->slice_w, w);
 
-  glDispatchCompute(gen->width, gen->height, gen->depth);
+  dispatch(gen->local_size, gen->width, gen->height, gen->depth);
+}
+
+void perlin4d_slice(perlin4d_gen *gen, GLfloat w, void *noise) {
+  perlin4d_dispatch(gen, w);
+
   glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
   glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
-                     sizeof(GLfloat)*gen->width*gen->height*gen->depth,
+                     noise_output_size(gen->output, gen->width*gen->height*
+                                       gen->depth),
                      noise);
   /* glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0); */
   /* glUseProgram(0); */
 }
 
-const GLfloat gradients[] = {
-   1,  1,  0,
-  -1,  1,  0,
-   1, -1,  0,
-  -1, -1,  0,
-   1,  0,  1,
-  -1,  0,  1,
-   1,  0, -1,
-  -1,  0, -1,
-   0,  1,  1,
-   0, -1,  1,
-   0,  1, -1,
-   0, -1, -1,
+void simplex4d_init(simplex4d_gen *gen,
+                    size_t width, size_t height, size_t depth,
+                    size_t octave_count, vec4 start, vec4 scale,
+                    uint64_t seed) {
+  noise4d_init(gen, NoiseSimplex4d, width, height, depth,
+               octave_count, start, scale, seed);
+}
+
+void simplex4d_release(simplex4d_gen *gen) {
+  perlin4d_release(gen);
+}
+
+void simplex4d_set_output(simplex4d_gen *gen, noise_output_format format,
+                          GLfloat threshold) {
+  perlin4d_set_output(gen, format, threshold);
+}
+
+void simplex4d_dispatch(simplex4d_gen *gen, GLfloat w) {
+  perlin4d_dispatch(gen, w);
+}
+
+void simplex4d_slice(simplex4d_gen *gen, GLfloat w, void *noise) {
+  perlin4d_slice(gen, w, noise);
+}
+
+int perlin4d_async_init(perlin4d_async *async, perlin4d_gen *gen,
+                        size_t depth) {
+  if (!GLEW_ARB_buffer_storage)
+    return -1;
+
+  if (depth > MaxPipelineDepth) depth = MaxPipelineDepth;
+  if (depth == 0) depth = 1;
+
+  async->gen      = gen;
+  async->depth    = depth;
+  async->first    = 0;
+  async->count    = 0;
+  async->acquired = 0;
+
+  GLsizeiptr size = noise_output_size(gen->output, gen->width*gen->height*
+                                      gen->depth);
+  GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT |
+    GL_MAP_COHERENT_BIT;
+
+  for (size_t i = 0; i < depth; i++) {
+    perlin4d_slot *slot = &async->slots[i];
+
+    glGenBuffers(1, &slot->buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot->buffer);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, size, NULL, flags);
+    slot->data  = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, size, flags);
+    slot->fence = 0;
+    slot->w     = 0;
+  }
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  return 0;
+}
+
+void perlin4d_async_release(perlin4d_async *async) {
+  for (size_t i = 0; i < async->depth; i++) {
+    perlin4d_slot *slot = &async->slots[i];
+
+    if (slot->fence) glDeleteSync(slot->fence);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot->buffer);
+    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    glDeleteBuffers(1, &slot->buffer);
+  }
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+int perlin4d_async_submit(perlin4d_async *async, GLfloat w) {
+  if (async->count == async->depth)
+    return -1;
+
+  perlin4d_gen *gen = async->gen;
+  perlin4d_slot *slot =
+    &async->slots[(async->first + async->count) % async->depth];
+
+  noise4d_use(gen, w);
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, gen->shader_input);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, slot->buffer);
+  clear_output(gen->output, noise_output_size(gen->output, gen->width*
+                                              gen->height*gen->depth));
+  glUniform1f(gen->slice_w, w);
+
+  dispatch(gen->local_size, gen->width, gen->height, gen->depth);
+
+  /* Makes the shader's writes visible through the mapping once the fence is
+   * signaled. */
+  glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+  slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot->w     = w;
+
+  glUseProgram(0);
+
+  async->count++;
+  return 0;
+}
+
+const void *perlin4d_async_try_acquire(perlin4d_async *async, GLfloat *w) {
+  if (async->count == 0)
+    return NULL;
+
+  perlin4d_slot *slot = &async->slots[async->first];
+  if (!async->acquired) {
+    /* A zero timeout only polls; the flush makes sure the fence eventually
+     * gets signaled even if nothing else is submitted. */
+    GLenum status = glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                     0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+      return NULL;
+
+    glDeleteSync(slot->fence);
+    slot->fence = 0;
+    async->acquired = 1;
+  }
+
+  if (w) *w = slot->w;
+  return slot->data;
+}
+
+void perlin4d_async_recycle(perlin4d_async *async) {
+  if (!async->acquired)
+    return;
+
+  async->acquired = 0;
+  async->first = (async->first + 1) % async->depth;
+  async->count--;
+}
+
+/* Padded to vec4 to match the std430 layout of the shaders' input buffer. */
+const GLfloat gradients3d[4*Gradient3dCount] = {
+   1,  1,  0, 0,
+  -1,  1,  0, 0,
+   1, -1,  0, 0,
+  -1, -1,  0, 0,
+   1,  0,  1, 0,
+  -1,  0,  1, 0,
+   1,  0, -1, 0,
+  -1,  0, -1, 0,
+   0,  1,  1, 0,
+   0, -1,  1, 0,
+   0,  1, -1, 0,
+   0, -1, -1, 0,
 };
 
-static
-void perlin3d_like(size_t width, size_t height, size_t depth, GLfloat *noise,
-                   size_t octave_count, vec3 start, vec3 scale,
-                   const char *src) {
+static void noise3d_init(perlin3d_gen *gen, noise_kind kind, uint64_t seed) {
+  gen->kind      = kind;
+  gen->hash_mode = selected_hash_mode;
+  gen->key       = white_noise_key(seed);
+
   GLint permutations[PermutationTableSize];
-  make_permutation_table(permutations, PermutationTableSize);
+  make_permutation_table(permutations, PermutationTableSize, seed);
 
-  GLuint shader_input;
-  glGenBuffers(1, &shader_input);
-  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, shader_input);
+  glGenBuffers(1, &gen->shader_input);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, gen->shader_input);
   glBufferData(GL_SHADER_STORAGE_BUFFER,
-               sizeof(gradients) + 2*sizeof(permutations),
+               sizeof(gradients3d) + 2*sizeof(permutations),
                NULL, GL_STATIC_DRAW);
-  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(gradients), gradients);
-  glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(gradients),
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(gradients3d),
+                  gradients3d);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(gradients3d),
                   sizeof(permutations), permutations);
   glBufferSubData(GL_SHADER_STORAGE_BUFFER,
-                  sizeof(gradients) + sizeof(permutations),
+                  sizeof(gradients3d) + sizeof(permutations),
                   sizeof(permutations), permutations);
 
-  GLuint shader_output;
-  glGenBuffers(1, &shader_output);
-  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, shader_output);
-  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLfloat)*width*height*depth,
-               NULL, GL_STREAM_READ);
+  /* The output buffer is only allocated once we know how big the volume is,
+   * see perlin3d_generate. */
+  glGenBuffers(1, &gen->shader_output);
+  gen->capacity = 0;
+
+  /* The program is picked, and its uniforms set, by perlin3d_generate. */
+  gen->local_size = workgroup_size_for(kind);
+  gen->prog = 0;
+
+  bound_tables_init(&gen->bound_tables, seed);
+  glGenBuffers(1, &gen->shader_sides);
+  scratch_init(&gen->sides);
 
-  GLuint shader = create_shader(GL_COMPUTE_SHADER, src);
-  GLuint prog = glCreateProgram();
-  glAttachShader(prog, shader);
-  glLinkProgram(prog);
-  check_link_errors(prog);
+  gen->output    = NoiseOutputFloat;
+  gen->threshold = 0;
 
-  glUseProgram(prog);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void perlin3d_release(perlin3d_gen *gen) {
+  program_forget(gen);
+
+  scratch_release(&gen->sides);
+  glDeleteBuffers(1, &gen->shader_sides);
+  free(gen->bound_tables);
+
+  glDeleteBuffers(1, &gen->shader_output);
+  glDeleteBuffers(1, &gen->shader_input);
+}
+
+void perlin3d_set_output(perlin3d_gen *gen, noise_output_format format,
+                         GLfloat threshold) {
+  gen->output    = format;
+  gen->threshold = threshold;
+
+  /* Sets every uniform again on the next call. */
+  program_forget(gen);
+  gen->prog = 0;
+}
+
+static int vec3_equal(vec3 a, vec3 b) {
+  return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+void perlin3d_generate(perlin3d_gen *gen,
+                       size_t width, size_t height, size_t depth,
+                       void *noise,
+                       size_t octave_count, vec3 start, vec3 scale) {
+  size_t size = noise_output_size(gen->output, width*height*depth);
+
+  /* Every uniform is set again after switching to another variant, or if
+   * another generator used this one in the meantime. */
+  GLuint prog = program_variant(gen->kind, gen->local_size, gen->hash_mode,
+                                octave_count, gen->output);
+  int reload = program_claim(prog, gen) || prog != gen->prog;
+  gen->prog = prog;
+
+  glUseProgram(gen->prog);
+
+  group_sides sides = {
+    gen->bound_tables, gen->kind, octave_count, gen->threshold,
+    {start.x, start.y, start.z, 0}, {scale.x, scale.y, scale.z, 0},
+    gen->local_size, width, height, depth,
+  };
+  bind_group_sides(gen->prog, &sides, gen->shader_sides, &gen->sides);
+  bind_octave_counter(gen->prog);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, gen->shader_input);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, gen->shader_output);
+  if (size > gen->capacity) {
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_STREAM_READ);
+    gen->capacity = size;
+  }
+
+  clear_output(gen->output, size);
+
+  if (reload) {
+    gen->uniforms.size      = glGetUniformLocation(gen->prog, "size");
+    gen->uniforms.start     = glGetUniformLocation(gen->prog, "start");
+    gen->uniforms.scale     = glGetUniformLocation(gen->prog, "scale");
+    gen->uniforms.key       = glGetUniformLocation(gen->prog, "key");
+    gen->uniforms.threshold = glGetUniformLocation(gen->prog, "threshold");
+
+    /* Only used by NoiseHashInteger and NoiseOutputOccupancy; the uniforms
+     * are optimized out otherwise. */
+    glUniform1ui(gen->uniforms.key, gen->key);
+    glUniform1f(gen->uniforms.threshold, gen->threshold);
+  }
+
+  if (reload ||
+      width != gen->width || height != gen->height || depth != gen->depth) {
+    glUniform3i(gen->uniforms.size, width, height, depth);
+    gen->width  = width;
+    gen->height = height;
+    gen->depth  = depth;
+  }
+
+  if (reload || !vec3_equal(start, gen->start)) {
+    glUniform3f(gen->uniforms.start, start.x, start.y, start.z);
+    gen->start = start;
+  }
 
-  glUniform3i(glGetUniformLocation(prog, "size"), width, height, depth);
-  glUniform3f(glGetUniformLocation(prog, "start"), start.x, start.y, start.z);
-  glUniform3f(glGetUniformLocation(prog, "scale"), scale.x, scale.y, scale.z);
-  glUniform1i(glGetUniformLocation(prog, "octave_count"), octave_count);
+  if (reload || !vec3_equal(scale, gen->scale)) {
+    glUniform3f(gen->uniforms.scale, scale.x, scale.y, scale.z);
+    gen->scale = scale;
+  }
 
-  glDispatchCompute(width, height, depth);
+  dispatch(gen->local_size, width, height, depth);
   glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
-  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
-                     sizeof(GLfloat)*width*height*depth, noise);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, noise);
   glUseProgram(0);
 
-  glDeleteProgram(prog);
-  glDeleteShader(shader);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+/* Stream the permutation tables are drawn from, so that they don't correlate
+ * with other uses of the same seed. */
+#define PermutationStream 0x7065726d75746531ull
+
+void pcg32_init(pcg32 *rng, uint64_t seed, uint64_t stream) {
+  rng->state = 0;
+  rng->inc   = stream << 1 | 1;
+  pcg32_next(rng);
+  rng->state += seed;
+  pcg32_next(rng);
+}
 
-  glDeleteBuffers(1, &shader_output);
+uint32_t pcg32_next(pcg32 *rng) {
+  uint64_t old = rng->state;
+  rng->state = old*6364136223846793005ull + rng->inc;
 
-  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-  glDeleteBuffers(1, &shader_input);
+  uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+  uint32_t rot = old >> 59;
+  return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
 }
 
-static void make_permutation_table(GLint *array, size_t n) {
+uint32_t pcg32_bounded(pcg32 *rng, uint32_t bound) {
+  /* Rejects the 2^32 % bound smallest values, which would otherwise make the
+   * first few results more likely. */
+  uint32_t threshold = -bound % bound;
+  for (;;) {
+    uint32_t r = pcg32_next(rng);
+    if (r >= threshold)
+      return r % bound;
+  }
+}
+
+void make_permutation_table(GLint *array, size_t n, uint64_t seed) {
+  pcg32 rng;
+  pcg32_init(&rng, seed, PermutationStream);
+
   for (size_t i = 0; i < n; i++) array[i] = i;
-  shuffle(array, n);
+  shuffle(array, n, &rng);
 }
 
-static void shuffle(GLint *array, size_t n) {
+static void shuffle(GLint *array, size_t n, pcg32 *rng) {
   for (size_t i = n; i > 0; i--) {
-    size_t j = rand() % i;
+    size_t j = pcg32_bounded(rng, i);
     GLint tmp = array[i-1];
     array[i-1] = array[j];
     array[j] = tmp;
   }
 }
+
+static unsigned output_bits(noise_output_format output) {
+  switch (output) {
+  case NoiseOutputFloat:     return 32;
+  case NoiseOutputUnorm16:   return 16;
+  case NoiseOutputUnorm8:    return 8;
+  case NoiseOutputOccupancy: return 1;
+  }
+
+  return 32;
+}
+
+static const char *kind_source(noise_kind kind) {
+  switch (kind) {
+  case NoisePerlin3d:  return src_perlin3d;
+  case NoiseSimplex3d: return src_simplex3d;
+  case NoisePerlin4d:  return src_perlin4d;
+  case NoiseSimplex4d: return src_simplex4d;
+  case NoiseWhite:     return src_white;
+  }
+
+  return NULL;
+}
+
+/* Octaves can only stop early when nothing but the side of the threshold is
+ * written. */
+static noise_octave_mode octave_mode_for(noise_kind kind,
+                                         noise_output_format output) {
+  if (kind == NoiseWhite || output != NoiseOutputOccupancy)
+    return NoiseOctavesAll;
+  return selected_octave_mode;
+}
+
+/* Octaves of Perlin noise that CellTables programs build tables for. */
+#define CellTableOctaves 8
+
+static GLuint compute_program(noise_kind kind, workgroup_size local_size,
+                              noise_hash_mode hash_mode, size_t octave_count,
+                              noise_output_format output,
+                              noise_octave_mode octaves, int cells,
+                              GLuint *shader) {
+  /* HashInteger is a constant, so the compiler drops the other mode's code
+   * along with its permutation table reads. The octave loop has a constant
+   * trip count and is unrolled, and keeps its early exits only when
+   * LazyOctaves is true. OutputBits leaves a single path in write_output.
+   * CellOctaves sizes a shared array, so it is at least 1. */
+  size_t cell_octaves = octave_count < CellTableOctaves ? octave_count :
+    CellTableOctaves;
+  if (cell_octaves == 0)
+    cell_octaves = 1;
+
+  char header[448];
+  snprintf(header, sizeof(header),
+           "#version 430\n"
+           "#define LocalSizeX %u\n"
+           "#define LocalSizeY %u\n"
+           "#define LocalSizeZ %u\n"
+           "#define HashInteger %s\n"
+           "#define OctaveCount %zu\n"
+           "#define OutputBits %uU\n"
+           "#define LazyOctaves %s\n"
+           "#define OctaveBound %.9e\n"
+           "#define OctaveMargin %.9e\n"
+           "#define NoiseBoxMixed %uU\n"
+           "#define NoiseBoxSolid %uU\n"
+           "#define CellTables %s\n"
+           "#define CellOctaves %zu\n",
+           local_size.x, local_size.y, local_size.z,
+           hash_mode == NoiseHashInteger ? "true" : "false", octave_count,
+           output_bits(output),
+           octaves != NoiseOctavesAll ? "true" : "false",
+           noise_octave_bound(kind), NoiseOctaveMargin,
+           (unsigned)NoiseBoxMixed, (unsigned)NoiseBoxSolid,
+           cells ? "true" : "false", cell_octaves);
+
+  const char *srcs[] = {
+    header,
+    octaves == NoiseOctavesCounted ? src_count_octaves :
+      src_skip_octave_count,
+    src_output, src_octaves, kind_source(kind),
+    kind == NoisePerlin3d || kind == NoisePerlin4d ? src_cells : "",
+  };
+  shader_stage stage = {GL_COMPUTE_SHADER, sizeof(srcs)/sizeof(*srcs), srcs};
+  return create_program(1, &stage, NULL, shader);
+}
+
+typedef struct program_entry {
+  noise_kind kind;
+  workgroup_size local_size;
+  noise_hash_mode hash_mode;
+  size_t octave_count;
+  noise_output_format output;
+  noise_octave_mode octaves;
+  int cells;
+
+  GLuint prog, shader;
+  const void *user; /* generator that last set the program's uniforms */
+} program_entry;
+
+static program_entry *programs = NULL;
+static size_t program_count = 0, program_capacity = 0;
+
+static GLuint program_variant(noise_kind kind, workgroup_size local_size,
+                              noise_hash_mode hash_mode, size_t octave_count,
+                              noise_output_format output) {
+  noise_octave_mode octaves = octave_mode_for(kind, output);
+  int cells = selected_cell_tables;
+
+  for (size_t i = 0; i < program_count; i++) {
+    program_entry *entry = &programs[i];
+    if (entry->kind == kind && entry->hash_mode == hash_mode &&
+        entry->octave_count == octave_count && entry->output == output &&
+        entry->octaves == octaves && entry->cells == cells &&
+        entry->local_size.x == local_size.x &&
+        entry->local_size.y == local_size.y &&
+        entry->local_size.z == local_size.z)
+      return entry->prog;
+  }
+
+  if (program_count == program_capacity) {
+    size_t capacity = program_capacity ? 2*program_capacity : 16;
+    program_entry *new_programs = realloc(programs,
+                                          capacity*sizeof(*programs));
+    if (!new_programs) {
+      /* Still works, but the variant is compiled again on every call and
+       * never deleted. Nothing binds the counter or the workgroups' sides
+       * for it either, so it evaluates every octave. */
+      GLuint shader;
+      return compute_program(kind, local_size, hash_mode, octave_count,
+                             output, NoiseOctavesAll, cells, &shader);
+    }
+
+    programs = new_programs;
+    program_capacity = capacity;
+  }
+
+  program_entry *entry = &programs[program_count++];
+  entry->kind = kind;
+  entry->local_size = local_size;
+  entry->hash_mode = hash_mode;
+  entry->octave_count = octave_count;
+  entry->output = output;
+  entry->octaves = octaves;
+  entry->cells = cells;
+  entry->user = NULL;
+  entry->prog = compute_program(kind, local_size, hash_mode, octave_count,
+                                output, octaves, cells, &entry->shader);
+  return entry->prog;
+}
+
+/* Binds the octave counter to binding 2 if prog counts octaves. This also
+ * binds it to GL_SHADER_STORAGE_BUFFER, so it must come before the buffers
+ * the caller keeps using through that target. */
+static void bind_octave_counter(GLuint prog) {
+  for (size_t i = 0; i < program_count; i++) {
+    if (programs[i].prog != prog)
+      continue;
+    if (programs[i].octaves != NoiseOctavesCounted)
+      return;
+
+    if (!octave_counter) {
+      const GLuint zero[3] = {0, 0, 0};
+      glGenBuffers(1, &octave_counter);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, octave_counter);
+      glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zero), zero,
+                   GL_DYNAMIC_READ);
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, octave_counter);
+    return;
+  }
+}
+
+/* Output of classify_groups, numbered as in group_decided. */
+typedef struct group_grid {
+  const group_sides *job;
+  size_t count_x, count_y;
+  GLuint *sides;
+} group_grid;
+
+/* classify_groups stops splitting boxes of workgroups once they hold this
+ * many voxels or fewer: smaller ones rarely pay for the microseconds it takes
+ * to bound them, which add up to more than the dispatch itself when every
+ * workgroup is bounded. */
+#define GroupSidesMinVoxels 2048
+
+/* Classifies the workgroups from first to last, exclusive, as a whole, and
+ * splits them in two along their longest side, in voxels, that spans more
+ * than one workgroup until they are decided or down to GroupSidesMinVoxels.
+ * Large boxes are mostly bounded by noise_octave_bound, so they cost little
+ * more than small ones. */
+static void classify_groups(const group_grid *grid,
+                            const size_t first[3], const size_t last[3]) {
+  const group_sides *job = grid->job;
+  size_t local[3] = {job->local_size.x, job->local_size.y,
+                     job->local_size.z};
+  size_t size[3] = {job->width, job->height, job->depth};
+
+  size_t min[3], max[3], longest = 0, longest_size = 0, voxels = 1;
+  for (size_t a = 0; a < 3; a++) {
+    min[a] = first[a]*local[a];
+    max[a] = last[a]*local[a] < size[a] ? last[a]*local[a] : size[a];
+    max[a]--;
+    voxels *= max[a] - min[a] + 1;
+
+    if (last[a] - first[a] > 1 && max[a] - min[a] + 1 > longest_size) {
+      longest = a;
+      longest_size = max[a] - min[a] + 1;
+    }
+  }
+
+  noise_box box = noise_voxel_box(job->start, job->scale,
+                                  min[0], min[1], min[2],
+                                  max[0], max[1], max[2]);
+
+  GLfloat value;
+  noise_box_side side = noise_box_classify(job->tables, job->kind,
+                                           job->octave_count, box,
+                                           job->threshold, &value);
+
+  if (side == NoiseBoxMixed && longest_size != 0 &&
+      voxels > GroupSidesMinVoxels) {
+    size_t middle = first[longest] + (last[longest] - first[longest])/2;
+
+    size_t split_last[3] = {last[0], last[1], last[2]};
+    size_t split_first[3] = {first[0], first[1], first[2]};
+    split_last[longest] = split_first[longest] = middle;
+
+    classify_groups(grid, first, split_last);
+    classify_groups(grid, split_first, last);
+    return;
+  }
+
+  for (size_t z = first[2]; z < last[2]; z++) {
+    for (size_t y = first[1]; y < last[1]; y++) {
+      for (size_t x = first[0]; x < last[0]; x++)
+        grid->sides[x + grid->count_x*(y + grid->count_y*z)] = side;
+    }
+  }
+}
+
+/* Binds the side of the threshold of each workgroup of job to binding 3 if
+ * prog stops octaves early. Like bind_octave_counter, this must come before
+ * the buffers the caller keeps using through GL_SHADER_STORAGE_BUFFER. */
+static void bind_group_sides(GLuint prog, const group_sides *job,
+                             GLuint buffer, scratch_buffer *scratch) {
+  int lazy = 0;
+  for (size_t i = 0; i < program_count; i++) {
+    if (programs[i].prog == prog)
+      lazy = programs[i].octaves != NoiseOctavesAll;
+  }
+
+  if (!lazy)
+    return;
+
+  size_t last[3] = {
+    (job->width  + job->local_size.x - 1) / job->local_size.x,
+    (job->height + job->local_size.y - 1) / job->local_size.y,
+    (job->depth  + job->local_size.z - 1) / job->local_size.z,
+  };
+  size_t first[3] = {0, 0, 0};
+  size_t size = last[0]*last[1]*last[2]*sizeof(GLuint);
+
+  group_grid grid = {job, last[0], last[1], scratch_reserve(scratch, size)};
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, buffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_STREAM_DRAW);
+
+  /* Without tables or memory, every workgroup is left mixed. */
+  if (!job->tables || !grid.sides) {
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER,
+                      GL_UNSIGNED_INT, NULL);
+    return;
+  }
+
+  classify_groups(&grid, first, last);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, grid.sides);
+}
+
+/* The tables are only read by bind_group_sides, so generators still work
+ * without them. */
+static void bound_tables_init(struct noise_cpu_tables **tables,
+                              uint64_t seed) {
+  *tables = malloc(sizeof(**tables));
+  if (*tables)
+    noise_cpu_tables_init(*tables, seed);
+}
+
+/* Records that user is about to set the uniforms of prog, and returns 1 if
+ * another generator (or none) set them last. */
+static int program_claim(GLuint prog, const void *user) {
+  for (size_t i = 0; i < program_count; i++) {
+    if (programs[i].prog == prog) {
+      int changed = programs[i].user != user;
+      programs[i].user = user;
+      return changed;
+    }
+  }
+
+  return 1;
+}
+
+/* Called when a generator is released, as another one may later be created
+ * at the same address. */
+static void program_forget(const void *user) {
+  for (size_t i = 0; i < program_count; i++) {
+    if (programs[i].user == user)
+      programs[i].user = NULL;
+  }
+}
+
+void noise_release_programs(void) {
+  for (size_t i = 0; i < program_count; i++) {
+    glDeleteProgram(programs[i].prog);
+    glDeleteShader(programs[i].shader);
+  }
+
+  free(programs);
+  programs = NULL;
+  program_count = program_capacity = 0;
+
+  glDeleteBuffers(1, &octave_counter);
+  octave_counter = 0;
+}
+
+size_t noise_program_count(void) {
+  return program_count;
+}
+
+static void dispatch(workgroup_size local_size,
+                     size_t width, size_t height, size_t depth) {
+  glDispatchCompute((width  + local_size.x - 1) / local_size.x,
+                    (height + local_size.y - 1) / local_size.y,
+                    (depth  + local_size.z - 1) / local_size.z);
+}
+
+static const char *kind_name(noise_kind kind) {
+  switch (kind) {
+  case NoisePerlin3d:  return "perlin3d";
+  case NoiseSimplex3d: return "simplex3d";
+  case NoisePerlin4d:  return "perlin4d";
+  case NoiseSimplex4d: return "simplex4d";
+  case NoiseWhite:     return "white";
+  }
+
+  return "unknown";
+}
+
+static workgroup_size workgroup_size_for(noise_kind kind) {
+  workgroup_size ret;
+  if (!workgroup_lookup(kind_name(kind), &ret))
+    ret = noise_tune_workgroup(kind, NULL);
+  return ret;
+}
+
+#define TuneSize 64
+#define TuneRuns 3
+#define TuneOctaves 3
+
+workgroup_size noise_tune_workgroup(noise_kind kind, double *times) {
+  const char *src = kind_source(kind);
+  const GLfloat *gradients = gradients3d;
+  size_t gradients_size = sizeof(gradients3d);
+
+  if (kind == NoisePerlin4d || kind == NoiseSimplex4d) {
+    gradients = gradients4d;
+    gradients_size = sizeof(gradients4d);
+  }
+
+  if (!src)
+    return DefaultWorkgroupSize;
+
+  /* The identity permutation is as fast as any other. */
+  GLint permutations[2*PermutationTableSize];
+  for (size_t i = 0; i < 2*PermutationTableSize; i++)
+    permutations[i] = i % PermutationTableSize;
+
+  GLuint buffers[2];
+  glGenBuffers(2, buffers);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[0]);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, gradients_size + sizeof(permutations),
+               NULL, GL_STATIC_DRAW);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, gradients_size, gradients);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, gradients_size,
+                  sizeof(permutations), permutations);
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers[1]);
+  glBufferData(GL_SHADER_STORAGE_BUFFER,
+               sizeof(GLfloat)*TuneSize*TuneSize*TuneSize,
+               NULL, GL_STREAM_READ);
+
+  GLint max_invocations;
+  glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &max_invocations);
+
+  workgroup_size best = DefaultWorkgroupSize;
+  double best_time = INFINITY;
+
+  /* Candidates are only compiled once, so their binaries aren't saved. */
+  int cache_was_enabled = program_cache_enabled();
+  program_cache_set_enabled(0);
+
+  for (size_t i = 0; i < workgroup_candidate_count; i++) {
+    workgroup_size size = workgroup_candidates[i];
+    double time = INFINITY;
+
+    if (size.x*size.y*size.z <= (GLuint)max_invocations) {
+      GLuint shader;
+      GLuint prog = compute_program(kind, size, NoiseHashTable, TuneOctaves,
+                                    NoiseOutputFloat, NoiseOctavesAll,
+                                    selected_cell_tables, &shader);
+
+      GLint linked;
+      glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+
+      if (linked) {
+        glUseProgram(prog);
+        glUniform3i(glGetUniformLocation(prog, "size"),
+                    TuneSize, TuneSize, TuneSize);
+        if (kind == NoisePerlin4d || kind == NoiseSimplex4d) {
+          glUniform4f(glGetUniformLocation(prog, "scale"),
+                      1.0/30, 1.0/30, 1.0/30, 0.1);
+        }
+        else {
+          glUniform3f(glGetUniformLocation(prog, "scale"),
+                      1.0/30, 1.0/30, 1.0/30);
+        }
+
+        /* The first dispatch may include lazy compilation by the driver.
+         * Timer queries aren't used because some drivers, llvmpipe
+         * included, report 0 for compute work. */
+        dispatch(size, TuneSize, TuneSize, TuneSize);
+        glFinish();
+        for (size_t run = 0; run < TuneRuns; run++) {
+          double t = timer_now();
+          dispatch(size, TuneSize, TuneSize, TuneSize);
+          glFinish();
+          t = timer_now() - t;
+
+          if (t < time) time = t;
+        }
+
+        glUseProgram(0);
+      }
+
+      glDeleteProgram(prog);
+      glDeleteShader(shader);
+    }
+
+    if (times) times[i] = time;
+    if (time < best_time) {
+      best_time = time;
+      best = size;
+    }
+  }
+
+  program_cache_set_enabled(cache_was_enabled);
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  glDeleteBuffers(2, buffers);
+
+  if (best_time != INFINITY)
+    workgroup_remember(kind_name(kind), best);
+
+  return best;
+}
@@ -2,32 +2,471 @@
 #define NOISE_GEN_H_
 
 #include <stddef.h>
+#include <stdint.h>
 #include <GL/glew.h>
 #include "vector_math.h"
+#include "workgroup_tuner.h"
+#include "scratch.h"
+
+#define PermutationTableSize 256
+
+#define Gradient3dCount 12
+#define Gradient4dCount 32
+
+/**
+ * Gradient tables shared by the compute shaders and the CPU generators. Each
+ * gradient is stored as 4 floats, the 3D ones being padded with a zero.
+ */
+extern const GLfloat gradients3d[4*Gradient3dCount];
+extern const GLfloat gradients4d[4*Gradient4dCount];
+
+/**
+ * PCG32 (XSH RR variant, see pcg-random.org). Its whole state is held by the
+ * caller, so threads can draw from their own generators without locking, and
+ * a given seed and stream produce the same numbers on every platform.
+ */
+typedef struct pcg32 {
+  uint64_t state, inc;
+} pcg32;
+
+void pcg32_init(pcg32 *rng, uint64_t seed, uint64_t stream);
+uint32_t pcg32_next(pcg32 *rng);
+
+/**
+ * Returns a number in [0, bound), all of them equally likely.
+ */
+uint32_t pcg32_bounded(pcg32 *rng, uint32_t bound);
+
+/**
+ * Fills array with a permutation of 0..n-1 that only depends on seed. Every
+ * generator derives its table this way, so generators created with the same
+ * seed, on any thread or in any run, produce bit-identical volumes.
+ */
+void make_permutation_table(GLint *array, size_t n, uint64_t seed);
+
+typedef enum noise_kind {
+  NoisePerlin3d,
+  NoiseSimplex3d,
+  NoisePerlin4d,
+  NoiseSimplex4d,
+  NoiseWhite,
+} noise_kind;
+
+/**
+ * How gradient noise picks the gradient of a lattice point. NoiseHashTable
+ * chains lookups into the seed's permutation table, so the noise repeats every
+ * 256 cells along each axis:
+ *
+ *   gradient = permutations[x + permutations[y + permutations[z]]] % count
+ *
+ * NoiseHashInteger instead computes it from the point's coordinates with
+ * white_noise_hash, in registers, and never repeats (4D starts from w):
+ *
+ *   hash     = hash(hash(hash(z + key) + y) + x)
+ *   gradient = ((hash >> 8) * count) >> 24  (3D)
+ *   gradient = hash >> 27                    (4D, 32 gradients)
+ *
+ * where key is white_noise_key(seed) and additions wrap around at 2^32. The
+ * two modes produce different volumes for the same seed.
+ */
+typedef enum noise_hash_mode {
+  NoiseHashTable,
+  NoiseHashInteger,
+} noise_hash_mode;
+
+/**
+ * Selects the mode used by gradient noise generators, on the GPU and the CPU,
+ * created after this call. NoiseHashTable is the default.
+ */
+void noise_set_hash_mode(noise_hash_mode mode);
+noise_hash_mode noise_current_hash_mode(void);
+
+const char *noise_hash_mode_name(noise_hash_mode mode);
+
+/**
+ * How many octaves gradient noise evaluates when only the side of a threshold
+ * matters, i.e. for NoiseOutputOccupancy. Octave i adds noise*2^-i to a sum
+ * that is divided by the total of the amplitudes, and the noise of an octave
+ * never exceeds noise_octave_bound in absolute value. Once the octaves left
+ * can no longer move the sum across the threshold, by more than
+ * NoiseOctaveMargin of rounding, the remaining ones are skipped:
+ *
+ *   |sum - threshold*norm| > bound*(2^(1-i) - 2^(1-octave_count)) + margin
+ *
+ * after i octaves. The partial sum lies on the same side of the threshold as
+ * the full one, so the mask is the same as with every octave evaluated.
+ * Before each dispatch, workgroups are also bounded as a whole with
+ * noise_box_classify (see noise_bounds.h), and those that lie on one side of
+ * the threshold skip every octave.
+ *
+ *   NoiseOctavesAll      every octave of every voxel
+ *   NoiseOctavesLazy     stops early, the default
+ *   NoiseOctavesCounted  stops early and counts the octaves evaluated, for
+ *                        noise_take_octave_stats, which slows the shaders down
+ *
+ * The mode is read when a generator picks its program: on every call to
+ * perlin3d_generate, and by perlin4d_set_output for 4D generators.
+ */
+typedef enum noise_octave_mode {
+  NoiseOctavesAll,
+  NoiseOctavesLazy,
+  NoiseOctavesCounted,
+} noise_octave_mode;
+
+#define NoiseOctaveMargin 1e-3
+
+void noise_set_octave_mode(noise_octave_mode mode);
+noise_octave_mode noise_current_octave_mode(void);
+
+/**
+ * Whether Perlin noise programs hash the corners of the lattice cells a
+ * workgroup spans once, into shared memory, for its first octaves, instead of
+ * hashing the corners of every voxel's cell. Low frequency octaves put many
+ * voxels in each cell, so most of those hashes are the same. The values are
+ * the same either way. Off by default: filling the tables needs a barrier
+ * and shared memory per workgroup, which cost llvmpipe more than the hashes
+ * they save (see `bench cells`). Read when the octave mode is.
+ */
+void noise_set_cell_tables(int enabled);
+int noise_cell_tables(void);
+
+/**
+ * Largest absolute value of a single octave of kind, before its amplitude is
+ * applied, or 0 for white noise, which has no octaves.
+ */
+GLfloat noise_octave_bound(noise_kind kind);
+
+typedef struct noise_octave_stats {
+  uint64_t voxels;  /* voxels generated with early exits */
+  uint64_t octaves; /* octaves evaluated, summed over those voxels */
+  uint64_t skipped; /* voxels of boxes decided by noise_bounds.h */
+} noise_octave_stats;
+
+/**
+ * Octaves evaluated by NoiseOctavesCounted programs since the last call,
+ * which waits for the GPU. The shaders count with 32-bit integers, so this
+ * should be called at least every 2^32 octaves, e.g. once per slice.
+ */
+noise_octave_stats noise_take_octave_stats(void);
+
+/**
+ * What the compute shaders write for each voxel. The CPU mesher only compares
+ * samples to DensityThreshold, so smaller formats cut the data read back from
+ * the GPU, by up to 32 times:
+ *
+ *   NoiseOutputFloat     GLfloat, the noise itself
+ *   NoiseOutputUnorm16   GLushort, round(clamp(value, 0, 1) * 65535)
+ *   NoiseOutputUnorm8    GLubyte, round(clamp(value, 0, 1) * 255)
+ *   NoiseOutputOccupancy bit i%32 of GLuint i/32 is set when the value of
+ *                        voxel i is at least the generator's threshold
+ *
+ * Every format uses whole GLuints, the last one being padded. Noise outside of
+ * [0, 1] is clamped by the unorm formats; comparing their samples to the
+ * quantized DensityThreshold gives the same result as comparing the noise, as
+ * 0.5 lies halfway between two steps.
+ */
+typedef enum noise_output_format {
+  NoiseOutputFloat,
+  NoiseOutputUnorm16,
+  NoiseOutputUnorm8,
+  NoiseOutputOccupancy,
+} noise_output_format;
+
+const char *noise_output_name(noise_output_format format);
+
+/** Bytes taken by count voxels in the given format. */
+size_t noise_output_size(noise_output_format format, size_t count);
+
+/**
+ * Value of voxel i of data: the noise, as rounded by the unorm formats, or 0
+ * or 1 for NoiseOutputOccupancy.
+ */
+GLfloat noise_output_sample(noise_output_format format, const void *data,
+                            size_t i);
+
+/**
+ * The compute programs are specialized for each generator, workgroup size,
+ * hash mode, octave count, output format and, for NoiseOutputOccupancy,
+ * octave mode, which the shaders see as constants, so that the octave loop is
+ * unrolled and its amplitudes folded.
+ * Each variant is compiled the first time a generator needs it and shared by
+ * every generator that uses it afterwards, so switching between
+ * configurations only ever compiles the ones not seen before.
+ *
+ * noise_release_programs deletes them all, along with the octave counter.
+ * It must be called while the context is still current, once no generator is
+ * left.
+ */
+void noise_release_programs(void);
+size_t noise_program_count(void);
+
+/**
+ * Times each of workgroup_candidates on a 64³ volume with the compute shader
+ * used for kind, remembers the fastest for the current driver, and returns
+ * it. If times isn't NULL, it receives the time of each candidate in seconds
+ * (INFINITY for shapes the driver rejects).
+ *
+ * Generators call this the first time they are created on a driver. It only
+ * needs to be called directly to tune again.
+ */
+workgroup_size noise_tune_workgroup(noise_kind kind, double *times);
 
 void single_cell(size_t width, size_t height, size_t depth, GLfloat *noise,
                  size_t x, size_t y, size_t z);
-void white_noise(size_t width, size_t height, size_t depth, GLfloat *noise);
+
+/**
+ * White noise is a pure function of the seed and of each voxel's integer
+ * coordinates, in [0, 1):
+ *
+ *   row   = hash(hash(z ^ key) + y)
+ *   value = (hash(row ^ hash(x ^ key)) >> 8) / 2^24
+ *
+ * where hash is white_noise_hash and key is white_noise_key(seed). The CPU
+ * and the GPU compute exactly the same values, and a volume can be filled in
+ * pieces, in any order, with the same result as in one go.
+ */
+GLuint white_noise_hash(GLuint x);
+GLuint white_noise_key(uint64_t seed);
+
+/**
+ * Same as white_noise_cpu with the volume's first voxel at the origin.
+ */
+void white_noise(size_t width, size_t height, size_t depth, GLfloat *noise,
+                 uint64_t seed);
+
+/**
+ * One-shot versions of perlin3d_generate and simplex3d_generate. These compile
+ * the shader and allocate buffers on every call, so use a generator object
+ * instead when generating more than one volume.
+ */
 void perlin3d(size_t width, size_t height, size_t depth, GLfloat *noise,
-               size_t octave_count, vec3 start, vec3 scale);
+               size_t octave_count, vec3 start, vec3 scale, uint64_t seed);
 void simplex3d(size_t width, size_t height, size_t depth, GLfloat *noise,
-               size_t octave_count, vec3 start, vec3 scale);
+               size_t octave_count, vec3 start, vec3 scale, uint64_t seed);
+
+/**
+ * Keeps the gradient and permutation tables and the output buffer alive
+ * between calls to perlin3d_generate, which picks the program variant for the
+ * requested octave count. Uniforms are only uploaded again when their value
+ * changes, or when another generator used the same variant in the meantime.
+ */
+typedef struct perlin3d_gen {
+  noise_kind kind;
+  noise_hash_mode hash_mode;
+  GLuint key;
+
+  noise_output_format output;
+  GLfloat threshold;
+
+  GLuint prog; /* variant used by the last call, 0 before the first one */
+
+  GLuint shader_input, shader_output;
+  size_t capacity;
+
+  workgroup_size local_size;
+
+  struct {
+    GLint size;
+    GLint start;
+    GLint scale;
+    GLint key;
+    GLint threshold;
+  } uniforms;
+
+  size_t width, height, depth;
+  vec3 start, scale;
+
+  /* The tables noise_bounds.h reads (NULL if they couldn't be allocated),
+   * and the side of the threshold of each workgroup, for lazy octaves. */
+  struct noise_cpu_tables *bound_tables;
+  GLuint shader_sides;
+  scratch_buffer sides;
+} perlin3d_gen;
+
+typedef perlin3d_gen simplex3d_gen;
+
+/**
+ * Creates a generator whose permutation table, or hash key, is derived from
+ * seed, using the current hash mode.
+ */
+void perlin3d_init(perlin3d_gen *gen, uint64_t seed);
+void perlin3d_release(perlin3d_gen *gen);
+
+/**
+ * Selects the format written to noise by later calls, NoiseOutputFloat by
+ * default. threshold is only used by NoiseOutputOccupancy, and noise must hold
+ * noise_output_size bytes.
+ */
+void perlin3d_set_output(perlin3d_gen *gen, noise_output_format format,
+                         GLfloat threshold);
+
+void perlin3d_generate(perlin3d_gen *gen,
+                       size_t width, size_t height, size_t depth,
+                       void *noise,
+                       size_t octave_count, vec3 start, vec3 scale);
+
+void simplex3d_init(simplex3d_gen *gen, uint64_t seed);
+void simplex3d_release(simplex3d_gen *gen);
+void simplex3d_set_output(simplex3d_gen *gen, noise_output_format format,
+                          GLfloat threshold);
+
+void simplex3d_generate(simplex3d_gen *gen,
+                        size_t width, size_t height, size_t depth,
+                        void *noise,
+                        size_t octave_count, vec3 start, vec3 scale);
+
+/**
+ * Computes white noise with a compute shader, for volumes whose first voxel
+ * is at x, y, z.
+ */
+typedef struct white_gen {
+  GLuint prog;
+
+  noise_output_format output;
+  GLfloat threshold;
+
+  GLuint shader_output;
+  size_t capacity;
+
+  workgroup_size local_size;
+
+  struct {
+    GLint size;
+    GLint origin;
+    GLint key;
+    GLint threshold;
+  } uniforms;
+} white_gen;
+
+void white_init(white_gen *gen);
+void white_release(white_gen *gen);
+
+/** Same as perlin3d_set_output. */
+void white_set_output(white_gen *gen, noise_output_format format,
+                      GLfloat threshold);
+
+void white_generate(white_gen *gen,
+                    size_t width, size_t height, size_t depth,
+                    void *noise, GLint x, GLint y, GLint z, uint64_t seed);
 
 typedef struct perlin4d_gen {
+  noise_kind kind;
+  noise_hash_mode hash_mode;
+  size_t octave_count;
   GLuint prog;
-  GLuint shader;
+
+  noise_output_format output;
 
   GLuint shader_input, shader_output;
   size_t width, height, depth;
 
+  workgroup_size local_size;
+
+  /* Uploaded again whenever another generator used the same variant. */
+  vec4 start, scale;
+  GLuint key;
+  GLfloat threshold;
+
   GLint slice_w;
+
+  /* Same as perlin3d_gen's. */
+  struct noise_cpu_tables *bound_tables;
+  GLuint shader_sides;
+  scratch_buffer sides;
 } perlin4d_gen;
 
 void perlin4d_init(perlin4d_gen *gen,
                    size_t width, size_t height, size_t depth,
-                   size_t octave_count, vec4 start, vec4 scale);
+                   size_t octave_count, vec4 start, vec4 scale,
+                   uint64_t seed);
 void perlin4d_release(perlin4d_gen *gen);
 
-void perlin4d_slice(perlin4d_gen *gen, GLfloat w, GLfloat *noise);
+/**
+ * Same as perlin3d_set_output. This reallocates gen->shader_output, so it
+ * must be called before perlin4d_async_init.
+ */
+void perlin4d_set_output(perlin4d_gen *gen, noise_output_format format,
+                         GLfloat threshold);
+
+/**
+ * Computes slice w into gen->shader_output without reading it back, for
+ * consumers that stay on the GPU (see generate_geometry_gpu, which needs
+ * NoiseOutputFloat). They must issue the memory barrier matching their use
+ * of the buffer.
+ */
+void perlin4d_dispatch(perlin4d_gen *gen, GLfloat w);
+
+void perlin4d_slice(perlin4d_gen *gen, GLfloat w, void *noise);
+
+/**
+ * 4D simplex noise, with the same API as perlin4d_gen. Each voxel only
+ * evaluates the 5 corners of the simplex that contains it, where Perlin noise
+ * interpolates between the 16 corners of a hypercube, so slices are much
+ * cheaper to compute. Being the same type, the generator can also be used
+ * with perlin4d_async and generate_geometry_gpu.
+ */
+typedef perlin4d_gen simplex4d_gen;
+
+void simplex4d_init(simplex4d_gen *gen,
+                    size_t width, size_t height, size_t depth,
+                    size_t octave_count, vec4 start, vec4 scale,
+                    uint64_t seed);
+void simplex4d_release(simplex4d_gen *gen);
+void simplex4d_set_output(simplex4d_gen *gen, noise_output_format format,
+                          GLfloat threshold);
+
+void simplex4d_dispatch(simplex4d_gen *gen, GLfloat w);
+void simplex4d_slice(simplex4d_gen *gen, GLfloat w, void *noise);
+
+#define MaxPipelineDepth     8
+#define DefaultPipelineDepth 3
+
+typedef struct perlin4d_slot {
+  GLuint buffer;
+  const void *data;
+  GLsync fence;
+  GLfloat w;
+} perlin4d_slot;
+
+/**
+ * Generates slices ahead of time into a ring of persistently mapped buffers,
+ * so that reading a slice never waits for the GPU. Slices are acquired in the
+ * order they were submitted.
+ */
+typedef struct perlin4d_async {
+  perlin4d_gen *gen;
+
+  perlin4d_slot slots[MaxPipelineDepth];
+  size_t depth;
+
+  size_t first;    /* oldest slot in flight or acquired */
+  size_t count;    /* slots in flight or acquired */
+  int acquired;
+} perlin4d_async;
+
+/**
+ * Creates depth (at most MaxPipelineDepth) output buffers for gen. Returns -1
+ * if the implementation lacks ARB_buffer_storage, in which case perlin4d_slice
+ * is the only option.
+ */
+int perlin4d_async_init(perlin4d_async *async, perlin4d_gen *gen,
+                        size_t depth);
+void perlin4d_async_release(perlin4d_async *async);
+
+/**
+ * Dispatches slice w into the next free buffer and returns 0, or returns -1
+ * without doing anything if all of them are in flight or acquired.
+ */
+int perlin4d_async_submit(perlin4d_async *async, GLfloat w);
+
+/**
+ * Returns the oldest submitted slice if the GPU has finished it, or NULL
+ * without blocking otherwise. The slice is in the generator's output format,
+ * and stays valid, and its buffer won't be reused, until
+ * perlin4d_async_recycle is called. If w isn't NULL, it receives the slice's
+ * position along the 4th dimension.
+ */
+const void *perlin4d_async_try_acquire(perlin4d_async *async, GLfloat *w);
+void perlin4d_async_recycle(perlin4d_async *async);
 
 #endif
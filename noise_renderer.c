@@ -3,16 +3,60 @@
 
 #include "noise_renderer.h"
 #include "shader_utils.h"
+#include "timer.h"
 
 #define GLSL(code) \
   "#version 330\n"   \
   #code
 
-const char *src_main_vs = GLSL(
+/* The main vertex shader is compiled after one of these, which define how to
+ * read the vertex attributes. */
+#define GLSL_BODY(code) #code
+
+const char *src_float_vertex = GLSL(
   in vec3 pos;
   in vec3 normal;
   in vec3 color;
 
+  vec3 vertex_pos()    { return pos; }
+  vec3 vertex_normal() { return normal; }
+  vec3 vertex_color()  { return color; }
+);
+
+/* normals and palette match normal_index and palette in this file. */
+const char *src_packed_vertex = GLSL(
+  in uvec3 pos;
+  in uvec2 attribs;
+
+  const vec3 normals[6] = vec3[](
+    vec3(-1, 0, 0), vec3(+1, 0, 0),
+    vec3(0, -1, 0), vec3(0, +1, 0),
+    vec3(0, 0, -1), vec3(0, 0, +1));
+
+  const vec3 palette[2] = vec3[](
+    vec3(127, 127, 127) / 255,
+    vec3(0, 183, 235) / 255);
+
+  vec3 vertex_pos()    { return vec3(pos); }
+  vec3 vertex_normal() { return normals[attribs.x]; }
+  vec3 vertex_color()  { return palette[attribs.y]; }
+);
+
+/* Voxel coordinates of instanced cubes, 10 bits each. */
+const char *src_instanced = GLSL_BODY(
+  in uint instance;
+
+  vec3 instance_offset() {
+    return vec3(instance & 1023u, (instance >> 10) & 1023u,
+                (instance >> 20) & 1023u);
+  }
+);
+
+const char *src_not_instanced = GLSL_BODY(
+  vec3 instance_offset() { return vec3(0); }
+);
+
+const char *src_main_vs = GLSL_BODY(
   struct light_source {
     vec3 pos;
 
@@ -43,11 +87,12 @@ const char *src_main_vs = GLSL(
   uniform mat3 normal_matrix;
 
   void main() {
-    vec4 pos_rel_to_eye = model_view * vec4(pos, 1);
+    vec4 pos_rel_to_eye = model_view *
+      vec4(vertex_pos() + instance_offset(), 1);
 
-    frag_base_color = color;
+    frag_base_color = vertex_color();
 
-    frag_normal = normalize(normal_matrix * normal);
+    frag_normal = normalize(normal_matrix * vertex_normal());
     frag_pos    = -pos_rel_to_eye.xyz;
     frag_light  = light.pos + frag_pos;
 
@@ -97,44 +142,340 @@ const char *src_main_fs = GLSL(
   }
 );
 
-void noise_renderer_init(noise_renderer *renderer, noise_usage usage) {
+#define GLSL_COMPUTE(code) \
+  "#version 430\n"          \
+  #code
+
+/* Mirrors generate_geometry: one invocation per voxel, each claiming room for
+ * a whole cube with a single atomic add on requested, which follows the
+ * indirect command. Cubes that don't fit in the capacity squares the buffers
+ * hold are dropped, so the ones written form a prefix whose size goes to the
+ * command's count. The output buffers are the renderer's VBO and IBO, with
+ * vertices written as seven words in the layout of the vertex struct, or two
+ * for packed_vertex. When instancing, capacity counts instances instead, and
+ * the voxel's coordinates go to the instance buffer bound in place of the
+ * VBO. */
+const char *src_mesher_cs = GLSL_COMPUTE(
+  layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+  layout(std430, binding = 1) readonly buffer noiseBuf {
+    float noise[];
+  };
+
+  layout(std430, binding = 2) writeonly buffer vertexBuf {
+    uint vertices[];
+  };
+
+  layout(std430, binding = 3) writeonly buffer indexBuf {
+    uint indices[];
+  };
+
+  layout(std430, binding = 4) buffer commandBuf {
+    uint count;
+    uint instance_count;
+    uint first_index;
+    int  base_vertex;
+    uint base_instance;
+    uint requested;
+  };
+
+  uniform ivec3 size;
+  uniform uint capacity;
+  uniform float threshold;
+  uniform bool cull_hidden;
+  uniform bool packed_vertices;
+  uniform bool instanced;
+
+  /* Indices into the palette, with the matching RGB values. */
+  const uint BoxColor  = 0u;
+  const uint CubeColor = 1u;
+  const uint colors[2] = uint[](0x7f7f7fu, 0xebb700u);
+
+  uint normal_index(vec3 n) {
+    if (n.x != 0) return n.x < 0 ? 0u : 1u;
+    else if (n.y != 0) return n.y < 0 ? 2u : 3u;
+    else return n.z < 0 ? 4u : 5u;
+  }
+
+  void emit_vertex(uint i, vec3 pos, vec3 n, uint color) {
+    if (packed_vertices) {
+      uvec3 p = uvec3(pos);
+      vertices[2u*i + 0u] = p.x | (p.y << 16);
+      vertices[2u*i + 1u] = p.z | (normal_index(n) << 16) | (color << 24);
+    }
+    else {
+      vertices[7u*i + 0u] = floatBitsToUint(pos.x);
+      vertices[7u*i + 1u] = floatBitsToUint(pos.y);
+      vertices[7u*i + 2u] = floatBitsToUint(pos.z);
+      vertices[7u*i + 3u] = floatBitsToUint(n.x);
+      vertices[7u*i + 4u] = floatBitsToUint(n.y);
+      vertices[7u*i + 5u] = floatBitsToUint(n.z);
+      vertices[7u*i + 6u] = colors[color];
+    }
+  }
+
+  void emit_square(inout uint index, inout uint vertex,
+                   vec3 a, vec3 b, vec3 c, vec3 d, vec3 n, uint color) {
+    if (dot(cross(b - a, c - b), n) > 0) { /* vertices are in order */
+      indices[index++] = vertex;
+      indices[index++] = vertex + 1u;
+      indices[index++] = vertex + 2u;
+
+      indices[index++] = vertex + 2u;
+      indices[index++] = vertex + 1u;
+      indices[index++] = vertex + 3u;
+    }
+    else { /* vertices are backwards */
+      indices[index++] = vertex + 3u;
+      indices[index++] = vertex + 1u;
+      indices[index++] = vertex + 2u;
+
+      indices[index++] = vertex + 2u;
+      indices[index++] = vertex + 1u;
+      indices[index++] = vertex;
+    }
+
+    emit_vertex(vertex++, a, n, color);
+    emit_vertex(vertex++, b, n, color);
+    emit_vertex(vertex++, c, n, color);
+    emit_vertex(vertex++, d, n, color);
+  }
+
+);
+
+const char *src_mesher_main_cs = GLSL_BODY(
+  bool is_solid(ivec3 pos) {
+    return all(greaterThanEqual(pos, ivec3(0))) &&
+      all(lessThan(pos, size)) &&
+      noise[pos.x + pos.y*size.x + pos.z*size.x*size.y] >= threshold;
+  }
+
+  /* The squares selected by faces (left, right, bottom, top, back, front,
+   * from the lowest bit) with the corners and normals used by
+   * generate_geometry. The box around the scene faces inwards. */
+  void emit_cube(vec3 p, vec3 q, float facing, uint faces, uint color) {
+    uint n     = uint(bitCount(faces));
+    uint first = atomicAdd(requested, n);
+    if (first + n > capacity)
+      return;
+    atomicAdd(count, 6u*n);
+
+    uint index  = first * 6u;
+    uint vertex = first * 4u;
+
+    if ((faces & 1u) != 0u)
+      emit_square(index, vertex,
+                  vec3(p.x, p.y, p.z), vec3(p.x, p.y, q.z),
+                  vec3(p.x, q.y, p.z), vec3(p.x, q.y, q.z),
+                  vec3(-facing, 0, 0), color);
+    if ((faces & 2u) != 0u)
+      emit_square(index, vertex,
+                  vec3(q.x, p.y, p.z), vec3(q.x, p.y, q.z),
+                  vec3(q.x, q.y, p.z), vec3(q.x, q.y, q.z),
+                  vec3(+facing, 0, 0), color);
+    if ((faces & 4u) != 0u)
+      emit_square(index, vertex,
+                  vec3(p.x, p.y, p.z), vec3(p.x, p.y, q.z),
+                  vec3(q.x, p.y, p.z), vec3(q.x, p.y, q.z),
+                  vec3(0, -facing, 0), color);
+    if ((faces & 8u) != 0u)
+      emit_square(index, vertex,
+                  vec3(p.x, q.y, p.z), vec3(p.x, q.y, q.z),
+                  vec3(q.x, q.y, p.z), vec3(q.x, q.y, q.z),
+                  vec3(0, +facing, 0), color);
+    if ((faces & 16u) != 0u)
+      emit_square(index, vertex,
+                  vec3(p.x, p.y, p.z), vec3(p.x, q.y, p.z),
+                  vec3(q.x, p.y, p.z), vec3(q.x, q.y, p.z),
+                  vec3(0, 0, -facing), color);
+    if ((faces & 32u) != 0u)
+      emit_square(index, vertex,
+                  vec3(p.x, p.y, q.z), vec3(p.x, q.y, q.z),
+                  vec3(q.x, p.y, q.z), vec3(q.x, q.y, q.z),
+                  vec3(0, 0, +facing), color);
+  }
+
+  void main() {
+    ivec3 pos = ivec3(gl_GlobalInvocationID);
+    if (any(greaterThanEqual(pos, size)))
+      return;
+
+    if (pos == ivec3(0) && !instanced)
+      emit_cube(vec3(0), vec3(size), -1, 63u, BoxColor);
+
+    if (!is_solid(pos))
+      return;
+
+    uint faces = 63u;
+    if (cull_hidden) {
+      faces = 0u;
+      if (!is_solid(pos + ivec3(-1, 0, 0))) faces |= 1u;
+      if (!is_solid(pos + ivec3(+1, 0, 0))) faces |= 2u;
+      if (!is_solid(pos + ivec3(0, -1, 0))) faces |= 4u;
+      if (!is_solid(pos + ivec3(0, +1, 0))) faces |= 8u;
+      if (!is_solid(pos + ivec3(0, 0, -1))) faces |= 16u;
+      if (!is_solid(pos + ivec3(0, 0, +1))) faces |= 32u;
+    }
+
+    if (faces == 0u)
+      return;
+
+    if (instanced) {
+      /* Instance 0 is the box, which isn't offset. */
+      uint i = atomicAdd(requested, 1u);
+      if (i >= capacity)
+        return;
+      atomicAdd(instance_count, 1u);
+      vertices[i + 1u] =
+        uint(pos.x) | (uint(pos.y) << 10) | (uint(pos.z) << 20);
+    }
+    else
+      emit_cube(vec3(pos), vec3(pos + 1), 1, faces, CubeColor);
+  }
+);
+
+#define MesherLocalSizeX 8
+#define MesherLocalSizeY 8
+
+static void upload_instanced_mesh(noise_renderer *renderer);
+
+/* Describes the vertices of the buffer bound to GL_ARRAY_BUFFER to the bound
+ * vertex array. */
+static void set_vertex_attribs(noise_vertex_format format) {
+  if (format == NoiseVertexPacked) {
+    glEnableVertexAttribArray(0);
+    glVertexAttribIPointer(0, 3, GL_UNSIGNED_SHORT, sizeof(packed_vertex),
+                           (void*)offsetof(packed_vertex, x));
+    glEnableVertexAttribArray(1);
+    glVertexAttribIPointer(1, 2, GL_UNSIGNED_BYTE, sizeof(packed_vertex),
+                           (void*)offsetof(packed_vertex, normal));
+  }
+  else {
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex),
+                          (void*)offsetof(vertex, pos));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex),
+                          (void*)offsetof(vertex, normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(vertex),
+                          (void*)offsetof(vertex, color));
+  }
+}
+
+/* Matches set_vertex_attribs. Not needed when the program is loaded from a
+ * binary, which keeps the locations it was linked with. */
+static void bind_locations(GLuint prog) {
+  glBindFragDataLocation(prog, 0, "frag_color");
+  glBindAttribLocation(prog, 0, "pos");
+  glBindAttribLocation(prog, 1, "normal");
+  glBindAttribLocation(prog, 2, "color");
+  glBindAttribLocation(prog, 1, "attribs");
+  glBindAttribLocation(prog, 3, "instance");
+}
+
+int noise_renderer_init(noise_renderer *renderer, noise_usage usage,
+                        noise_mesher mesher, noise_vertex_format format,
+                        size_t width, size_t height, size_t depth) {
+  size_t max_size = mesher == NoiseMesherInstanced ?
+    MaxInstancedLevelSize : MaxLevelSize;
+  if (width == 0 || height == 0 || depth == 0 ||
+      width > max_size || height > max_size || depth > max_size)
+    return -1;
+
+  renderer->width  = width;
+  renderer->height = height;
+  renderer->depth  = depth;
+
+  renderer->mesher = mesher;
+  renderer->format = format;
+  renderer->input  = NoiseOutputFloat;
+  renderer->stats  = (noise_mesh_stats){0, 0, 0, 0};
+  renderer->usage  = usage == NoiseConstant ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW;
+  renderer->index_count    = 0;
+  renderer->index_type     = GL_UNSIGNED_SHORT;
+  renderer->instance_count = 0;
+  renderer->gpu_capacity   = 0;
+
+  renderer->vbo_size = renderer->ibo_size = renderer->instances_size = 0;
+
+  scratch_init(&renderer->vertex_scratch);
+  scratch_init(&renderer->index_scratch);
+  scratch_init(&renderer->instance_scratch);
+  scratch_init(&renderer->mask_scratch);
+  occupancy_init(&renderer->occupancy);
+
+  int instanced = mesher == NoiseMesherInstanced;
+
   glGenVertexArrays(1, &renderer->vao);
   glBindVertexArray(renderer->vao);
 
   glGenBuffers(1, &renderer->vbo);
   glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
-  glBufferData(GL_ARRAY_BUFFER, MaxVertexBufferSize, NULL,
-               usage == NoiseConstant ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW);
-
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex),
-                        (void*)offsetof(vertex, pos));
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex),
-                        (void*)offsetof(vertex, normal));
-  glEnableVertexAttribArray(2);
-  glVertexAttribPointer(2, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(vertex),
-                        (void*)offsetof(vertex, color));
+  set_vertex_attribs(format);
 
   glGenBuffers(1, &renderer->ibo);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->ibo);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, MaxIndexBufferSize, NULL,
-               usage == NoiseConstant ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW);
+
+  /* Storage is only allocated once the size of a mesh is known. */
+  glGenBuffers(1, &renderer->instances);
+  glBindBuffer(GL_ARRAY_BUFFER, renderer->instances);
+  if (instanced) {
+    glEnableVertexAttribArray(3);
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), NULL);
+    glVertexAttribDivisor(3, 1);
+
+    upload_instanced_mesh(renderer);
+  }
 
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   glBindVertexArray(0);
 
-  renderer->vs = create_shader(GL_VERTEX_SHADER, src_main_vs);
-  renderer->fs = create_shader(GL_FRAGMENT_SHADER, src_main_fs);
-  renderer->prog = glCreateProgram();
-  glAttachShader(renderer->prog, renderer->vs);
-  glAttachShader(renderer->prog, renderer->fs);
-  glBindFragDataLocation(renderer->prog, 0, "frag_color");
-  glBindAttribLocation(renderer->prog, 0, "pos");
-  glBindAttribLocation(renderer->prog, 1, "normal");
-  glBindAttribLocation(renderer->prog, 2, "color");
-  glLinkProgram(renderer->prog);
-  check_link_errors(renderer->prog);
+  const char *vs_sources[] = {
+    format == NoiseVertexPacked ? src_packed_vertex : src_float_vertex,
+    instanced ? src_instanced : src_not_instanced,
+    src_main_vs,
+  };
+
+  const shader_stage stages[] = {
+    {GL_VERTEX_SHADER, 3, vs_sources},
+    {GL_FRAGMENT_SHADER, 1, &src_main_fs},
+  };
+
+  GLuint shaders[2];
+  renderer->prog = create_program(2, stages, bind_locations, shaders);
+  renderer->vs = shaders[0];
+  renderer->fs = shaders[1];
+
+  /* The indirect command's count, or its instance count when instancing, is
+   * cleared before every run of the mesher along with the room it requested;
+   * the other fields never change. */
+  const GLuint command[] = {0, 1, 0, 0, 0, 0};
+  const GLuint instanced_command[] = {36, 0, 0, 0, 1, 0};
+  glGenBuffers(1, &renderer->indirect);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, renderer->indirect);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(command),
+               instanced ? instanced_command : command, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  renderer->indirect_draw = 0;
+
+  const char *mesher_sources[] = {src_mesher_cs, src_mesher_main_cs};
+  const shader_stage mesher_stage = {GL_COMPUTE_SHADER, 2, mesher_sources};
+  renderer->mesher_prog = create_program(1, &mesher_stage, NULL,
+                                         &renderer->mesher_cs);
+
+  glUseProgram(renderer->mesher_prog);
+  glUniform3i(glGetUniformLocation(renderer->mesher_prog, "size"),
+              width, height, depth);
+  glUniform1f(glGetUniformLocation(renderer->mesher_prog, "threshold"),
+              DensityThreshold);
+  glUniform1i(glGetUniformLocation(renderer->mesher_prog, "cull_hidden"),
+              mesher != NoiseMesherNaive);
+  glUniform1i(glGetUniformLocation(renderer->mesher_prog, "packed_vertices"),
+              format == NoiseVertexPacked);
+  glUniform1i(glGetUniformLocation(renderer->mesher_prog, "instanced"),
+              instanced);
+  glUseProgram(0);
 
   renderer->uniforms.model_view = glGetUniformLocation(renderer->prog,
                                                       "model_view");
@@ -177,16 +518,29 @@ void noise_renderer_init(noise_renderer *renderer, noise_usage usage) {
   glUniform1f(renderer->uniforms.mat.shininess, 128);
 
   glUseProgram(0);
+
+  return 0;
 }
 
 void noise_renderer_release(noise_renderer *renderer) {
+  glDeleteProgram(renderer->mesher_prog);
+  glDeleteShader(renderer->mesher_cs);
+  glDeleteBuffers(1, &renderer->indirect);
+
   glDeleteProgram(renderer->prog);
   glDeleteShader(renderer->fs);
   glDeleteShader(renderer->vs);
 
   glDeleteVertexArrays(1, &renderer->vao);
+  glDeleteBuffers(1, &renderer->instances);
   glDeleteBuffers(1, &renderer->ibo);
   glDeleteBuffers(1, &renderer->vbo);
+
+  occupancy_release(&renderer->occupancy);
+  scratch_release(&renderer->mask_scratch);
+  scratch_release(&renderer->instance_scratch);
+  scratch_release(&renderer->index_scratch);
+  scratch_release(&renderer->vertex_scratch);
 }
 
 static
@@ -199,167 +553,835 @@ void generate_square(size_t *index_count, size_t *vertex_count,
                      GLfloat nx, GLfloat ny, GLfloat nz,
                      GLubyte r, GLubyte g, GLubyte b);
 
-int generate_geometry(noise_renderer *renderer, GLfloat *noise) {
-  int status = 0;
+/* The width×height×depth region being meshed, surrounded in the occupancy
+ * volume by border layers of voxels that are only used to tell whether the
+ * faces on its edges are hidden. */
+typedef struct volume {
+  const occupancy_volume *occupancy;
+  size_t width, height, depth;
+  size_t border;
+} volume;
+
+static volume whole_volume(const occupancy_volume *occupancy) {
+  volume v = {occupancy, occupancy->width, occupancy->height,
+              occupancy->depth, 0};
+  return v;
+}
 
-  GLuint *indices = malloc(MaxIndexBufferSize);
-  if (!indices) {
-    status = -1;
-    goto fail_alloc_indices;
-  }
+/* Chunks are surrounded by one layer of their neighbours. */
+static volume chunk_volume(const occupancy_volume *occupancy) {
+  volume v = {occupancy, occupancy->width - 2, occupancy->height - 2,
+              occupancy->depth - 2, 1};
+  return v;
+}
+
+/* Coordinates wrap around when a neighbour below -border is requested, so
+ * anything outside the volume and its border counts as empty. */
+static int is_solid(const volume *v, size_t x, size_t y, size_t z) {
+  return occupancy_get(v->occupancy, x + v->border, y + v->border,
+                       z + v->border);
+}
+
+static int mesh_greedy(const volume *v, scratch_buffer *mask,
+                       vertex *vertices, GLuint *indices,
+                       size_t *vertex_count, size_t *index_count);
+
+/* Bits of the faces of a cube, also used by src_mesher_cs. */
+#define FaceLeft   1
+#define FaceRight  2
+#define FaceBottom 4
+#define FaceTop    8
+#define FaceBack   16
+#define FaceFront  32
+#define FaceAll    63
+
+/* Bits of word k of a row of v's occupancy volume that lie in v's region
+ * along x. */
+static uint64_t region_mask(const volume *v, size_t k) {
+  size_t begin = v->border, end = v->border + v->width;
+  size_t first = 64*k;
+
+  uint64_t mask = ~(uint64_t)0;
+  if (begin > first)
+    mask = begin - first >= 64 ? 0 : mask << (begin - first);
+  if (end < first + 64)
+    mask &= end <= first ? 0 : ~(~(uint64_t)0 << (end - first));
+
+  return mask;
+}
 
-  vertex *vertices = malloc(MaxVertexBufferSize);
-  if (!vertices) {
-    status = -1;
-    goto fail_alloc_vertices;
+/* Calls fn for each word of v's region holding a solid voxel, with those
+ * voxels and their faces next to empty space, as returned by occupancy_faces.
+ * x, y and z locate the word's first bit in the region; x wraps around when
+ * that bit is part of the border. Words are visited row by row, so voxels
+ * come in the same order as in nested loops over z, y and x. */
+typedef void (*region_word_fn)(void *data, size_t x, size_t y, size_t z,
+                               uint64_t solid, const uint64_t faces[6]);
+
+static void for_each_word(const volume *v, region_word_fn fn, void *data) {
+  const occupancy_volume *occupancy = v->occupancy;
+  size_t first_word = v->border / 64;
+  size_t last_word  = (v->border + v->width + 63) / 64;
+
+  for (size_t z = 0; z < v->depth; z++) {
+    for (size_t y = 0; y < v->height; y++) {
+      size_t row_y = y + v->border, row_z = z + v->border;
+      const uint64_t *row = occupancy_row(occupancy, row_y, row_z);
+
+      for (size_t k = first_word; k < last_word; k++) {
+        uint64_t solid = row[k] & region_mask(v, k);
+        if (!solid)
+          continue;
+
+        uint64_t faces[6];
+        occupancy_faces(occupancy, row_y, row_z, k, faces);
+        for (size_t f = 0; f < 6; f++)
+          faces[f] &= solid;
+
+        fn(data, 64*k - v->border, y, z, solid, faces);
+      }
+    }
   }
+}
 
-  size_t vertex_count   = 0;
-  renderer->index_count = 0;
+/* Bits of the faces of voxel i of a word, as FaceLeft...FaceFront. */
+static unsigned word_faces(const uint64_t faces[6], size_t i) {
+  unsigned ret = 0;
+  for (size_t f = 0; f < 6; f++)
+    ret |= (unsigned)(faces[f] >> i & 1) << f;
+  return ret;
+}
 
+static void generate_box(size_t *index_count, size_t *vertex_count,
+                         GLuint *indices, vertex *vertices,
+                         size_t width, size_t height, size_t depth) {
   /* left face */
-  generate_square(&renderer->index_count, &vertex_count,
+  generate_square(index_count, vertex_count,
                   indices, vertices,
                   0, 0, 0,
-                  0, 0, LevelDepth,
-                  0, LevelHeight, 0,
-                  0, LevelHeight, LevelDepth,
+                  0, 0, depth,
+                  0, height, 0,
+                  0, height, depth,
                   1, 0, 0,
                   127, 127, 127);
 
   /* right face */
-  generate_square(&renderer->index_count, &vertex_count,
+  generate_square(index_count, vertex_count,
                   indices, vertices,
-                  LevelWidth, 0, 0,
-                  LevelWidth, 0, LevelDepth,
-                  LevelWidth, LevelHeight, 0,
-                  LevelWidth, LevelHeight, LevelDepth,
+                  width, 0, 0,
+                  width, 0, depth,
+                  width, height, 0,
+                  width, height, depth,
                   -1, 0, 0,
                   127, 127, 127);
 
   /* bottom face */
-  generate_square(&renderer->index_count, &vertex_count,
+  generate_square(index_count, vertex_count,
                   indices, vertices,
                   0, 0, 0,
-                  0, 0, LevelDepth,
-                  LevelWidth, 0, 0,
-                  LevelWidth, 0, LevelDepth,
+                  0, 0, depth,
+                  width, 0, 0,
+                  width, 0, depth,
                   0, 1, 0,
                   127, 127, 127);
 
   /* top face */
-  generate_square(&renderer->index_count, &vertex_count,
+  generate_square(index_count, vertex_count,
                   indices, vertices,
-                  0, LevelHeight, 0,
-                  0, LevelHeight, LevelDepth,
-                  LevelWidth, LevelHeight, 0,
-                  LevelWidth, LevelHeight, LevelDepth,
+                  0, height, 0,
+                  0, height, depth,
+                  width, height, 0,
+                  width, height, depth,
                   0, -1, 0,
                   127, 127, 127);
 
   /* back face */
-  generate_square(&renderer->index_count, &vertex_count,
+  generate_square(index_count, vertex_count,
                   indices, vertices,
                   0, 0, 0,
-                  0, LevelHeight, 0,
-                  LevelWidth, 0, 0,
-                  LevelWidth, LevelHeight, 0,
+                  0, height, 0,
+                  width, 0, 0,
+                  width, height, 0,
                   0, 0, 1,
                   127, 127, 127);
 
   /* front face */
-  generate_square(&renderer->index_count, &vertex_count,
+  generate_square(index_count, vertex_count,
                   indices, vertices,
-                  0, 0, LevelDepth,
-                  0, LevelHeight, LevelDepth,
-                  LevelWidth, 0, LevelDepth,
-                  LevelWidth, LevelHeight, LevelDepth,
+                  0, 0, depth,
+                  0, height, depth,
+                  width, 0, depth,
+                  width, height, depth,
                   0, 0, -1,
                   127, 127, 127);
+}
+
+static void generate_cube(size_t *index_count, size_t *vertex_count,
+                          GLuint *indices, vertex *vertices,
+                          size_t x, size_t y, size_t z, unsigned faces) {
+  /* left face */
+  if (faces & FaceLeft)
+    generate_square(index_count, vertex_count,
+                    indices, vertices,
+                    x, y, z,
+                    x, y, z+1,
+                    x, y+1, z,
+                    x, y+1, z+1,
+                    -1, 0, 0,
+                    0, 183, 235);
+
+  /* right face */
+  if (faces & FaceRight)
+    generate_square(index_count, vertex_count,
+                    indices, vertices,
+                    x+1, y, z,
+                    x+1, y, z+1,
+                    x+1, y+1, z,
+                    x+1, y+1, z+1,
+                    +1, 0, 0,
+                    0, 183, 235);
+
+  /* bottom face */
+  if (faces & FaceBottom)
+    generate_square(index_count, vertex_count,
+                    indices, vertices,
+                    x, y, z,
+                    x, y, z+1,
+                    x+1, y, z,
+                    x+1, y, z+1,
+                    0, -1, 0,
+                    0, 183, 235);
+
+  /* top face */
+  if (faces & FaceTop)
+    generate_square(index_count, vertex_count,
+                    indices, vertices,
+                    x, y+1, z,
+                    x, y+1, z+1,
+                    x+1, y+1, z,
+                    x+1, y+1, z+1,
+                    0, +1, 0,
+                    0, 183, 235);
+
+  /* back face */
+  if (faces & FaceBack)
+    generate_square(index_count, vertex_count,
+                    indices, vertices,
+                    x, y, z,
+                    x, y+1, z,
+                    x+1, y, z,
+                    x+1, y+1, z,
+                    0, 0, -1,
+                    0, 183, 235);
+
+  /* front face */
+  if (faces & FaceFront)
+    generate_square(index_count, vertex_count,
+                    indices, vertices,
+                    x, y, z+1,
+                    x, y+1, z+1,
+                    x+1, y, z+1,
+                    x+1, y+1, z+1,
+                    0, 0, 1,
+                    0, 183, 235);
+}
+
+typedef struct count_job {
+  noise_mesher mesher;
+  size_t count;
+} count_job;
+
+/* 64 voxels at a time, with one popcount per face. */
+static void count_word(void *data, size_t x, size_t y, size_t z,
+                       uint64_t solid, const uint64_t faces[6]) {
+  count_job *job = data;
+
+  if (job->mesher == NoiseMesherNaive) {
+    job->count += 6*__builtin_popcountll(solid);
+    return;
+  }
+
+  /* Merging faces only ever removes squares. */
+  if (job->mesher == NoiseMesherInstanced) {
+    job->count += __builtin_popcountll(faces[0] | faces[1] | faces[2] |
+                                       faces[3] | faces[4] | faces[5]);
+    return;
+  }
+
+  for (size_t f = 0; f < 6; f++)
+    job->count += __builtin_popcountll(faces[f]);
+}
+
+static size_t count_region(noise_mesher mesher, const volume *v) {
+  count_job job = {mesher, 0};
+  for_each_word(v, count_word, &job);
+  return job.count;
+}
+
+/* count_region plus the box, unless the cubes are instanced. */
+static size_t count_volume(noise_mesher mesher, const volume *v) {
+  return count_region(mesher, v) + (mesher == NoiseMesherInstanced ? 0 : 6);
+}
+
+size_t count_squares(noise_mesher mesher,
+                     const occupancy_volume *occupancy) {
+  volume v = whole_volume(occupancy);
+  return count_volume(mesher, &v);
+}
+
+size_t count_chunk_squares(noise_mesher mesher,
+                           const occupancy_volume *occupancy) {
+  volume v = chunk_volume(occupancy);
+  return count_region(mesher, &v);
+}
+
+typedef struct mesh_job {
+  noise_mesher mesher;
+  vertex *vertices;
+  GLuint *indices;
+  size_t *vertex_count, *index_count;
+} mesh_job;
+
+/* Only visits the set bits of the word, lowest first. */
+static void mesh_word(void *data, size_t x, size_t y, size_t z,
+                      uint64_t solid, const uint64_t faces[6]) {
+  mesh_job *job = data;
+
+  for (; solid; solid &= solid - 1) {
+    size_t i = __builtin_ctzll(solid);
+
+    unsigned cube_faces = FaceAll;
+    if (job->mesher == NoiseMesherCulled)
+      cube_faces = word_faces(faces, i);
+
+    generate_cube(job->index_count, job->vertex_count,
+                  job->indices, job->vertices, x + i, y, z, cube_faces);
+  }
+}
+
+/* Appends the squares of the cubes in v to the mesh. */
+static int mesh_region(noise_mesher mesher, const volume *v,
+                       scratch_buffer *mask,
+                       vertex *vertices, GLuint *indices,
+                       size_t *vertex_count, size_t *index_count) {
+  if (mesher == NoiseMesherGreedy) {
+    return mesh_greedy(v, mask, vertices, indices,
+                       vertex_count, index_count);
+  }
+
+  mesh_job job = {mesher, vertices, indices, vertex_count, index_count};
+  for_each_word(v, mesh_word, &job);
+
+  return 0;
+}
+
+/* The box around v, followed by its cubes. */
+static int mesh_whole(noise_mesher mesher, const volume *v,
+                      scratch_buffer *mask,
+                      vertex *vertices, GLuint *indices,
+                      size_t *vertex_count, size_t *index_count) {
+  *vertex_count = 0;
+  *index_count  = 0;
+
+  generate_box(index_count, vertex_count, indices, vertices,
+               v->width, v->height, v->depth);
+
+  return mesh_region(mesher, v, mask, vertices, indices,
+                     vertex_count, index_count);
+}
+
+int mesh_volume(noise_mesher mesher, const occupancy_volume *occupancy,
+                scratch_buffer *mask,
+                vertex *vertices, GLuint *indices,
+                size_t *vertex_count, size_t *index_count) {
+  volume v = whole_volume(occupancy);
+  return mesh_whole(mesher, &v, mask, vertices, indices,
+                    vertex_count, index_count);
+}
 
-  for (size_t z = 0; z < LevelDepth; z++) {
-    for (size_t y = 0; y < LevelHeight; y++) {
-      for (size_t x = 0; x < LevelWidth; x++) {
-        if (noise[x + y*LevelWidth + z*LevelWidth*LevelHeight] >=
-            DensityThreshold) {
-          /* left face */
-          generate_square(&renderer->index_count, &vertex_count,
-                          indices, vertices,
-                          x, y, z,
-                          x, y, z+1,
-                          x, y+1, z,
-                          x, y+1, z+1,
-                          -1, 0, 0,
-                          0, 183, 235);
-
-          /* right face */
-          generate_square(&renderer->index_count, &vertex_count,
-                          indices, vertices,
-                          x+1, y, z,
-                          x+1, y, z+1,
-                          x+1, y+1, z,
-                          x+1, y+1, z+1,
-                          +1, 0, 0,
-                          0, 183, 235);
-
-          /* bottom face */
-          generate_square(&renderer->index_count, &vertex_count,
-                          indices, vertices,
-                          x, y, z,
-                          x, y, z+1,
-                          x+1, y, z,
-                          x+1, y, z+1,
-                          0, -1, 0,
-                          0, 183, 235);
-
-          /* top face */
-          generate_square(&renderer->index_count, &vertex_count,
-                          indices, vertices,
-                          x, y+1, z,
-                          x, y+1, z+1,
-                          x+1, y+1, z,
-                          x+1, y+1, z+1,
-                          0, +1, 0,
-                          0, 183, 235);
-
-
-          /* back face */
-          generate_square(&renderer->index_count, &vertex_count,
-                          indices, vertices,
-                          x, y, z,
-                          x, y+1, z,
-                          x+1, y, z,
-                          x+1, y+1, z,
-                          0, 0, -1,
-                          0, 183, 235);
-
-          /* front face */
-          generate_square(&renderer->index_count, &vertex_count,
-                          indices, vertices,
-                          x, y, z+1,
-                          x, y+1, z+1,
-                          x+1, y, z+1,
-                          x+1, y+1, z+1,
-                          0, 0, 1,
-                          0, 183, 235);
+int mesh_chunk(noise_mesher mesher, const occupancy_volume *occupancy,
+               scratch_buffer *mask,
+               vertex *vertices, GLuint *indices,
+               size_t *vertex_count, size_t *index_count) {
+  *vertex_count = 0;
+  *index_count  = 0;
+
+  volume v = chunk_volume(occupancy);
+  return mesh_region(mesher, &v, mask, vertices, indices,
+                     vertex_count, index_count);
+}
+
+/* Builds the same faces as the culled mesher, one plane at a time: faces
+ * pointing the same way on a plane are recorded in a mask, which is then
+ * covered with rectangles, each grown as far as it can along u and then
+ * along v. */
+static int mesh_greedy(const volume *vol, scratch_buffer *mask_scratch,
+                       vertex *vertices, GLuint *indices,
+                       size_t *vertex_count, size_t *index_count) {
+  const size_t size[3] = {vol->width, vol->height, vol->depth};
+
+  size_t max_area = size[0]*size[1];
+  if (size[0]*size[2] > max_area) max_area = size[0]*size[2];
+  if (size[1]*size[2] > max_area) max_area = size[1]*size[2];
+
+  GLubyte *mask = scratch_reserve(mask_scratch, max_area);
+  if (!mask)
+    return -1;
+
+  for (size_t d = 0; d < 3; d++) {
+    size_t u = (d + 1) % 3, v = (d + 2) % 3;
+
+    for (int sign = -1; sign <= 1; sign += 2) {
+      for (size_t plane = 0; plane <= size[d]; plane++) {
+        /* Voxels behind and in front of the plane, as seen from the face's
+         * normal. Out of range coordinates wrap around and count as empty,
+         * unless they are part of the border, whose faces aren't built. */
+        size_t inside  = sign < 0 ? plane : plane - 1;
+        size_t outside = sign < 0 ? plane - 1 : plane;
+        if (inside >= size[d]) continue;
+
+        int any = 0;
+        for (size_t j = 0; j < size[v]; j++) {
+          for (size_t i = 0; i < size[u]; i++) {
+            size_t a[3], b[3];
+            a[d] = inside;  a[u] = i; a[v] = j;
+            b[d] = outside; b[u] = i; b[v] = j;
+
+            mask[i + j*size[u]] =
+              is_solid(vol, a[0], a[1], a[2]) &&
+              !is_solid(vol, b[0], b[1], b[2]);
+            any |= mask[i + j*size[u]];
+          }
+        }
+
+        if (!any) continue;
+
+        for (size_t j = 0; j < size[v]; j++) {
+          for (size_t i = 0; i < size[u];) {
+            if (!mask[i + j*size[u]]) {
+              i++;
+              continue;
+            }
+
+            size_t w = 1;
+            while (i + w < size[u] && mask[i + w + j*size[u]])
+              w++;
+
+            size_t h = 1;
+            for (; j + h < size[v]; h++) {
+              size_t k = 0;
+              while (k < w && mask[i + k + (j + h)*size[u]])
+                k++;
+              if (k != w) break;
+            }
+
+            for (size_t y = j; y < j + h; y++) {
+              for (size_t x = i; x < i + w; x++)
+                mask[x + y*size[u]] = 0;
+            }
+
+            GLfloat p[3], du[3] = {0, 0, 0}, dv[3] = {0, 0, 0};
+            GLfloat n[3] = {0, 0, 0};
+            p[d] = plane; p[u] = i; p[v] = j;
+            du[u] = w;
+            dv[v] = h;
+            n[d]  = sign;
+
+            generate_square(index_count, vertex_count,
+                            indices, vertices,
+                            p[0], p[1], p[2],
+                            p[0]+dv[0], p[1]+dv[1], p[2]+dv[2],
+                            p[0]+du[0], p[1]+du[1], p[2]+du[2],
+                            p[0]+du[0]+dv[0], p[1]+du[1]+dv[1],
+                            p[2]+du[2]+dv[2],
+                            n[0], n[1], n[2],
+                            0, 183, 235);
+
+            i += w;
+          }
         }
       }
     }
   }
 
+  return 0;
+}
+
+/* Matches the palette of src_packed_vertex. Unknown colors use the first
+ * entry. */
+static const color palette[] = {
+  {127, 127, 127},
+  {0, 183, 235},
+};
+
+static GLubyte palette_index(color c) {
+  for (size_t i = 0; i < sizeof(palette)/sizeof(*palette); i++) {
+    if (palette[i].r == c.r && palette[i].g == c.g && palette[i].b == c.b)
+      return i;
+  }
+
+  return 0;
+}
+
+/* -x, +x, -y, +y, -z, +z, as in src_packed_vertex. */
+static GLubyte normal_index(vec3 n) {
+  if (n.x != 0) return n.x < 0 ? 0 : 1;
+  else if (n.y != 0) return n.y < 0 ? 2 : 3;
+  else return n.z < 0 ? 4 : 5;
+}
+
+void pack_vertices(size_t count, void *vertices) {
+  /* Packed vertices are smaller, so vertex i has been read by the time its
+   * bytes get overwritten. */
+  for (size_t i = 0; i < count; i++) {
+    vertex v = ((vertex*)vertices)[i];
+
+    packed_vertex p;
+    p.x = v.pos.x;
+    p.y = v.pos.y;
+    p.z = v.pos.z;
+    p.normal = normal_index(v.normal);
+    p.color  = palette_index(v.color);
+
+    ((packed_vertex*)vertices)[i] = p;
+  }
+}
+
+vertex unpack_vertex(packed_vertex p) {
+  static const vec3 normals[] = {
+    {-1, 0, 0}, {+1, 0, 0},
+    {0, -1, 0}, {0, +1, 0},
+    {0, 0, -1}, {0, 0, +1},
+  };
+
+  vertex v;
+  v.pos    = (vec3){p.x, p.y, p.z};
+  v.normal = normals[p.normal];
+  v.color  = palette[p.color];
+
+  return v;
+}
+
+void pack_indices(size_t count, void *indices) {
+  /* Every square has 6 indices and 4 vertices, in the same order. */
+  for (size_t i = 0; i < count; i++) {
+    size_t first_vertex = i/(6*SquaresPerDraw) * (4*SquaresPerDraw);
+    ((GLushort*)indices)[i] = ((GLuint*)indices)[i] - first_vertex;
+  }
+}
+
+/* A unit cube at the origin followed by the box, which is drawn separately
+ * starting at index InstancedBoxOffset. */
+#define InstancedBoxOffset 36
+
+static void upload_instanced_mesh(noise_renderer *renderer) {
+  GLuint indices[2*36];
+  vertex vertices[2*24];
+  size_t index_count = 0, vertex_count = 0;
+
+  generate_cube(&index_count, &vertex_count, indices, vertices,
+                0, 0, 0, FaceAll);
+  generate_box(&index_count, &vertex_count, indices, vertices,
+               renderer->width, renderer->height, renderer->depth);
+
+  size_t vertex_size = sizeof(vertex);
+  if (renderer->format == NoiseVertexPacked) {
+    pack_vertices(vertex_count, vertices);
+    vertex_size = sizeof(packed_vertex);
+  }
+
+  pack_indices(index_count, indices);
+
+  renderer->vbo_size = vertex_count*vertex_size;
+  renderer->ibo_size = index_count*sizeof(GLushort);
+
   glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, vertex_count * sizeof(vertex),
+  glBufferData(GL_ARRAY_BUFFER, renderer->vbo_size, vertices, GL_STATIC_DRAW);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, renderer->ibo_size, indices,
+               GL_STATIC_DRAW);
+}
+
+/* Makes sure buffer, bound to target, holds at least size bytes. It grows to
+ * at least twice its size so that meshes getting slightly bigger every frame
+ * don't reallocate it every time. Returns 1 if the contents were lost. */
+static int reserve_buffer(GLenum target, GLuint buffer, size_t *capacity,
+                          size_t size, GLenum usage) {
+  if (size <= *capacity)
+    return 0;
+
+  size_t new_size = *capacity*2;
+  if (new_size < size) new_size = size;
+
+  glBindBuffer(target, buffer);
+  glBufferData(target, new_size, NULL, usage);
+  *capacity = new_size;
+
+  return 1;
+}
+
+/* Room for count instances after the first one, which is always at the
+ * origin. */
+static void reserve_instances(noise_renderer *renderer, size_t count) {
+  if (reserve_buffer(GL_ARRAY_BUFFER, renderer->instances,
+                     &renderer->instances_size, (count + 1)*sizeof(GLuint),
+                     renderer->usage)) {
+    const GLuint origin = 0;
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(origin), &origin);
+  }
+}
+
+typedef struct instance_job {
+  GLuint *instances;
+  size_t count;
+} instance_job;
+
+static void instance_word(void *data, size_t x, size_t y, size_t z,
+                          uint64_t solid, const uint64_t faces[6]) {
+  instance_job *job = data;
+
+  uint64_t visible = faces[0] | faces[1] | faces[2] | faces[3] | faces[4] |
+    faces[5];
+  for (; visible; visible &= visible - 1) {
+    size_t i = __builtin_ctzll(visible);
+    job->instances[job->count++] = (x + i) | y << 10 | z << 20;
+  }
+}
+
+/* Cubes with no visible face are skipped; the others are drawn whole. start
+ * is when meshing began, including the conversion to an occupancy volume. */
+static int generate_instances(noise_renderer *renderer, const volume *v,
+                              double start) {
+  size_t max_count = count_volume(NoiseMesherInstanced, v);
+  GLuint *instances = scratch_reserve(&renderer->instance_scratch,
+                                      max_count*sizeof(GLuint));
+  if (!instances)
+    return -1;
+
+  instance_job job = {instances, 0};
+  for_each_word(v, instance_word, &job);
+  size_t count = job.count;
+
+  renderer->instance_count = count;
+  renderer->index_count    = 36*(count + 1);
+  renderer->indirect_draw  = 0;
+
+  renderer->stats.mesh_time    = timer_now() - start;
+  renderer->stats.vertex_count = 24*(count + 1);
+  renderer->stats.index_count  = renderer->index_count;
+  renderer->stats.upload_bytes = count*sizeof(GLuint);
+
+  reserve_instances(renderer, count);
+  glBindBuffer(GL_ARRAY_BUFFER, renderer->instances);
+  glBufferSubData(GL_ARRAY_BUFFER, sizeof(GLuint), count*sizeof(GLuint),
+                  instances);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  return 0;
+}
+
+void noise_renderer_set_input(noise_renderer *renderer,
+                              noise_output_format format) {
+  renderer->input = format;
+}
+
+int generate_geometry(noise_renderer *renderer, const void *noise) {
+  double start = timer_now();
+
+  if (occupancy_from_output(&renderer->occupancy, renderer->width,
+                            renderer->height, renderer->depth,
+                            renderer->input, noise, DensityThreshold) != 0)
+    return -1;
+
+  volume v = whole_volume(&renderer->occupancy);
+
+  if (renderer->mesher == NoiseMesherInstanced)
+    return generate_instances(renderer, &v, start);
+
+  size_t square_count = count_volume(renderer->mesher, &v);
+
+  vertex *vertices = scratch_reserve(&renderer->vertex_scratch,
+                                     4*square_count*sizeof(vertex));
+  GLuint *indices = scratch_reserve(&renderer->index_scratch,
+                                    6*square_count*sizeof(GLuint));
+  if (!vertices || !indices)
+    return -1;
+
+  size_t vertex_count, index_count;
+  if (mesh_whole(renderer->mesher, &v, &renderer->mask_scratch,
+                 vertices, indices, &vertex_count, &index_count) != 0)
+    return -1;
+
+  renderer->index_count   = index_count;
+  renderer->index_type    = GL_UNSIGNED_SHORT;
+  renderer->indirect_draw = 0;
+
+  size_t vertex_size = sizeof(vertex);
+  if (renderer->format == NoiseVertexPacked) {
+    pack_vertices(vertex_count, vertices);
+    vertex_size = sizeof(packed_vertex);
+  }
+
+  pack_indices(index_count, indices);
+
+  renderer->stats.mesh_time    = timer_now() - start;
+  renderer->stats.vertex_count = vertex_count;
+  renderer->stats.index_count  = index_count;
+  renderer->stats.upload_bytes = vertex_count*vertex_size +
+    index_count*sizeof(GLushort);
+
+  reserve_buffer(GL_ARRAY_BUFFER, renderer->vbo, &renderer->vbo_size,
+                 vertex_count * vertex_size, renderer->usage);
+  glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, vertex_count * vertex_size,
                   vertices);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
 
+  reserve_buffer(GL_ELEMENT_ARRAY_BUFFER, renderer->ibo, &renderer->ibo_size,
+                 index_count * sizeof(GLushort), renderer->usage);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->ibo);
   glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0,
-                  renderer->index_count * sizeof(GLuint), indices);
+                  index_count * sizeof(GLushort), indices);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-                     free(vertices);
-fail_alloc_vertices: free(indices);
-fail_alloc_indices:  return status;
+  return 0;
+}
+
+/* The index count is a 32-bit value, as is every vertex index. */
+#define MaxGpuSquareCount (UINT32_MAX/6)
+
+/* Buffers are grown to hold an extra 1/GpuMeshSlack of what the mesher asked
+ * for, since the next mesh is only known to fit once it has been drawn. */
+#define GpuMeshSlack 2
+
+/* Grows the buffers written by the GPU mesher to hold count squares, or count
+ * instances. */
+static void reserve_gpu_mesh(noise_renderer *renderer, size_t count) {
+  if (renderer->mesher == NoiseMesherInstanced)
+    reserve_instances(renderer, count);
+  else {
+    if (count > MaxGpuSquareCount) count = MaxGpuSquareCount;
+
+    size_t vertex_size = renderer->format == NoiseVertexPacked ?
+      sizeof(packed_vertex) : sizeof(vertex);
+    reserve_buffer(GL_ARRAY_BUFFER, renderer->vbo, &renderer->vbo_size,
+                   4*count*vertex_size, renderer->usage);
+    reserve_buffer(GL_SHADER_STORAGE_BUFFER, renderer->ibo,
+                   &renderer->ibo_size, 6*count*sizeof(GLuint),
+                   renderer->usage);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  renderer->gpu_capacity = count;
+}
+
+/* Room asked for by the last run of the mesher. */
+static size_t gpu_requested(const noise_renderer *renderer) {
+  GLuint requested;
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, renderer->indirect);
+  glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 5*sizeof(GLuint),
+                     sizeof(requested), &requested);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  return requested;
+}
+
+static void run_gpu_mesher(noise_renderer *renderer, GLuint noise) {
+  int instanced = renderer->mesher == NoiseMesherInstanced;
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, renderer->indirect);
+  glClearBufferSubData(GL_DRAW_INDIRECT_BUFFER, GL_R32UI,
+                       instanced ? sizeof(GLuint) : 0, sizeof(GLuint),
+                       GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+  glClearBufferSubData(GL_DRAW_INDIRECT_BUFFER, GL_R32UI,
+                       5*sizeof(GLuint), sizeof(GLuint),
+                       GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  glUseProgram(renderer->mesher_prog);
+  glUniform1ui(glGetUniformLocation(renderer->mesher_prog, "capacity"),
+               renderer->gpu_capacity);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, noise);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2,
+                   instanced ? renderer->instances : renderer->vbo);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, renderer->ibo);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, renderer->indirect);
+
+  glDispatchCompute((renderer->width  + MesherLocalSizeX - 1)/MesherLocalSizeX,
+                    (renderer->height + MesherLocalSizeY - 1)/MesherLocalSizeY,
+                    renderer->depth);
+
+  glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+                  GL_ELEMENT_ARRAY_BARRIER_BIT |
+                  GL_COMMAND_BARRIER_BIT |
+                  GL_BUFFER_UPDATE_BARRIER_BIT);
+  glUseProgram(0);
+}
+
+void generate_geometry_gpu(noise_renderer *renderer, GLuint noise) {
+  /* Makes the noise generator's writes visible to the mesher. */
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  int first_run = !renderer->indirect_draw;
+
+  /* Sized for the previous mesh, or for a few layers of cubes at first. */
+  size_t needed = first_run ?
+    6 + 2*(renderer->width*renderer->height +
+           renderer->height*renderer->depth +
+           renderer->width*renderer->depth) :
+    gpu_requested(renderer);
+  if (needed > renderer->gpu_capacity)
+    reserve_gpu_mesh(renderer, needed + needed/GpuMeshSlack);
+
+  run_gpu_mesher(renderer, noise);
+
+  if (first_run) {
+    needed = gpu_requested(renderer);
+    if (needed > renderer->gpu_capacity) {
+      reserve_gpu_mesh(renderer, needed + needed/GpuMeshSlack);
+      run_gpu_mesher(renderer, noise);
+    }
+  }
+
+  if (renderer->mesher != NoiseMesherInstanced)
+    renderer->index_type = GL_UNSIGNED_INT;
+  renderer->indirect_draw = 1;
+}
+
+size_t noise_renderer_index_count(const noise_renderer *renderer) {
+  if (!renderer->indirect_draw)
+    return renderer->index_count;
+
+  GLuint command[2];
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, renderer->indirect);
+  glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(command), command);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  if (renderer->mesher == NoiseMesherInstanced)
+    return command[0]*(command[1] + 1);
+  else
+    return command[0];
+}
+
+size_t noise_renderer_gpu_bytes(const noise_renderer *renderer) {
+  return renderer->vbo_size + renderer->ibo_size + renderer->instances_size +
+    6*sizeof(GLuint);
+}
+
+/* One draw per run of squares sharing 16-bit indices (see pack_indices). */
+static void draw_short_indices(size_t index_count) {
+  const size_t max_count = 6*SquaresPerDraw;
+  for (size_t first = 0; first < index_count; first += max_count) {
+    size_t count = index_count - first;
+    if (count > max_count) count = max_count;
+
+    glDrawElementsBaseVertex(GL_TRIANGLES, count, GL_UNSIGNED_SHORT,
+                             (void*)(first*sizeof(GLushort)),
+                             first/6*4);
+  }
 }
 
 void render(const noise_renderer *renderer) {
@@ -367,8 +1389,28 @@ void render(const noise_renderer *renderer) {
 
   glBindVertexArray(renderer->vao);
   glUseProgram(renderer->prog);
-  glDrawElements(GL_TRIANGLES, renderer->index_count, GL_UNSIGNED_INT,
-                 NULL);
+  if (renderer->mesher == NoiseMesherInstanced) {
+    /* Not instanced, so the box uses the first instance, at the origin. */
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT,
+                   (void*)(InstancedBoxOffset*sizeof(GLushort)));
+
+    if (renderer->indirect_draw) {
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, renderer->indirect);
+      glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, NULL);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    else {
+      glDrawElementsInstancedBaseInstance(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT,
+                                          NULL, renderer->instance_count, 1);
+    }
+  }
+  else if (renderer->indirect_draw) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, renderer->indirect);
+    glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+  else
+    draw_short_indices(renderer->index_count);
   glUseProgram(0);
   glBindVertexArray(0);
 }
@@ -390,6 +1432,55 @@ void set_mvp(noise_renderer *renderer,
   glUseProgram(0);
 }
 
+void noise_mesh_init(noise_mesh *mesh, noise_vertex_format format) {
+  mesh->index_count = 0;
+  mesh->vbo_size = mesh->ibo_size = 0;
+
+  glGenVertexArrays(1, &mesh->vao);
+  glBindVertexArray(mesh->vao);
+
+  glGenBuffers(1, &mesh->vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+  set_vertex_attribs(format);
+
+  glGenBuffers(1, &mesh->ibo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ibo);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void noise_mesh_release(noise_mesh *mesh) {
+  glDeleteVertexArrays(1, &mesh->vao);
+  glDeleteBuffers(1, &mesh->ibo);
+  glDeleteBuffers(1, &mesh->vbo);
+}
+
+void noise_mesh_upload(noise_mesh *mesh,
+                       const void *vertices, size_t vertex_bytes,
+                       const GLushort *indices, size_t index_count) {
+  mesh->index_count = index_count;
+  mesh->vbo_size = vertex_bytes;
+  mesh->ibo_size = index_count*sizeof(GLushort);
+
+  glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+  glBufferData(GL_ARRAY_BUFFER, mesh->vbo_size, vertices, GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->ibo_size, indices,
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void render_mesh(const noise_renderer *renderer, const noise_mesh *mesh) {
+  glBindVertexArray(mesh->vao);
+  glUseProgram(renderer->prog);
+  draw_short_indices(mesh->index_count);
+  glUseProgram(0);
+  glBindVertexArray(0);
+}
+
 static
 void generate_square(size_t *index_count, size_t *vertex_count,
                      GLuint *indices, vertex *vertices,
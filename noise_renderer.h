@@ -2,20 +2,26 @@
 #define NOISE_RENDERER_H_
 
 #include "vector_math.h"
+#include "scratch.h"
+#include "noise_gen.h"
+#include "occupancy.h"
 #include <GL/glew.h>
+#include <stddef.h>
 #include <stdint.h>
 
-#define LevelWidth  30
-#define LevelHeight 30
-#define LevelDepth  30
+/* Size of the level when none is given. */
+#define DefaultLevelWidth  30
+#define DefaultLevelHeight 30
+#define DefaultLevelDepth  30
 
-#define MaxCubeCount   (1+LevelWidth*LevelHeight*LevelDepth)
-#define MaxSquareCount (MaxCubeCount*6)
-#define MaxVertexCount (MaxSquareCount*4)
-#define MaxIndexCount  (MaxSquareCount*6)
+/* Largest dimension packed_vertex can represent, and the largest one the
+ * instanced mesher can, since it stores 10 bits per coordinate. */
+#define MaxLevelSize          65535
+#define MaxInstancedLevelSize 1024
 
-#define MaxVertexBufferSize (MaxVertexCount * sizeof(vertex))
-#define MaxIndexBufferSize  (MaxIndexCount  * sizeof(GLuint))
+/* Meshes built on the CPU use 16-bit indices, relative to the first vertex of
+ * each run of SquaresPerDraw squares, which is drawn by its own call. */
+#define SquaresPerDraw 16384
 
 #define DensityThreshold 0.5
 
@@ -29,10 +35,69 @@ typedef struct vertex {
   color color;
 } vertex;
 
+/**
+ * The same information for axis-aligned faces on an integer grid: the
+ * position, the normal as an index into -x, +x, -y, +y, -z, +z, and the color
+ * as an index into a palette holding the box's and the cubes' colors.
+ */
+typedef struct packed_vertex {
+  GLushort x, y, z;
+  GLubyte normal;
+  GLubyte color;
+} packed_vertex;
+
+typedef enum noise_vertex_format {
+  NoiseVertexFloat,  /* vertex, 28 bytes */
+  NoiseVertexPacked, /* packed_vertex, 8 bytes */
+} noise_vertex_format;
+
+typedef enum noise_mesher {
+  NoiseMesherNaive,  /* all six faces of every cube */
+  NoiseMesherCulled, /* only faces next to empty space or the volume's edge */
+  NoiseMesherGreedy, /* culled faces merged into rectangles */
+
+  /* One instance of a unit cube for each cube with a visible face, drawn with
+   * glDrawElementsInstanced. Only the cubes' coordinates are uploaded, as
+   * x | y << 10 | z << 20. */
+  NoiseMesherInstanced,
+} noise_mesher;
+
+typedef struct noise_mesh_stats {
+  size_t vertex_count, index_count; /* drawn, including instances */
+  size_t upload_bytes;
+  double mesh_time; /* seconds */
+} noise_mesh_stats;
+
 typedef struct noise_renderer {
+  noise_mesher mesher;
+  noise_vertex_format format;
+  noise_output_format input; /* read by generate_geometry */
+  noise_mesh_stats stats;
+  GLenum usage;
+
+  size_t width, height, depth;
+
   GLuint prog, vs, fs;
   GLuint vbo, ibo, vao;
   size_t index_count;
+  GLenum index_type;
+
+  GLuint instances;
+  size_t instance_count;
+
+  /* Bytes allocated for each buffer, grown when a mesh doesn't fit. */
+  size_t vbo_size, ibo_size, instances_size;
+
+  /* Kept between frames so that meshing doesn't allocate memory once the
+   * largest mesh has been seen. */
+  scratch_buffer vertex_scratch, index_scratch, instance_scratch;
+  scratch_buffer mask_scratch;
+  occupancy_volume occupancy; /* generate_geometry's input, thresholded */
+
+  GLuint mesher_prog, mesher_cs;
+  GLuint indirect;
+  int indirect_draw;
+  size_t gpu_capacity; /* squares, or instances, the GPU mesher can write */
 
   struct {
     GLint model_view;
@@ -62,17 +127,142 @@ typedef enum noise_usage {
   NoiseAnimated,
 } noise_usage;
 
-void noise_renderer_init(noise_renderer *renderer, noise_usage usage);
+/**
+ * Creates a renderer for width×height×depth noise buffers. Returns -1 without
+ * creating anything if a dimension is 0 or above MaxLevelSize, or above
+ * MaxInstancedLevelSize for NoiseMesherInstanced.
+ */
+int noise_renderer_init(noise_renderer *renderer, noise_usage usage,
+                        noise_mesher mesher, noise_vertex_format format,
+                        size_t width, size_t height, size_t depth);
 void noise_renderer_release(noise_renderer *renderer);
 
 /**
- * Generates one cube for every element in the noise buffer with a value above
- * the DensityThreshold, as well as a box around the whole scene.
+ * Number of squares mesh_volume builds for an occupancy volume, including the
+ * box: exact for the naive and culled meshers, and an upper bound for the
+ * greedy one. For NoiseMesherInstanced, this is the number of cubes with a
+ * visible face instead. Voxels are counted 64 at a time, with one popcount
+ * per face.
+ */
+size_t count_squares(noise_mesher mesher,
+                     const occupancy_volume *occupancy);
+
+/**
+ * Generates the faces of one cube for every voxel set in an occupancy volume,
+ * e.g. noise thresholded at DensityThreshold by occupancy_from_noise, as well
+ * as a box around the whole scene. vertices and indices need room for 4
+ * vertices and 6 indices per square, as counted by count_squares. Culling
+ * hidden faces doesn't change the rendered image as long as the camera is
+ * outside of the cubes, and neither does merging the remaining faces. The
+ * greedy mesher keeps its working memory in mask, and returns -1 if it can't
+ * be allocated. NoiseMesherInstanced doesn't build a mesh and can't be used
+ * here.
+ */
+int mesh_volume(noise_mesher mesher, const occupancy_volume *occupancy,
+                scratch_buffer *mask,
+                vertex *vertices, GLuint *indices,
+                size_t *vertex_count, size_t *index_count);
+
+/**
+ * count_squares and mesh_volume for a chunk of a larger world. occupancy
+ * holds the chunk's voxels surrounded by a layer of its neighbours', which
+ * only decide whether the faces on the chunk's edges are hidden, so the chunk
+ * itself is 2 voxels smaller along each axis. No box is built.
+ */
+size_t count_chunk_squares(noise_mesher mesher,
+                           const occupancy_volume *occupancy);
+int mesh_chunk(noise_mesher mesher, const occupancy_volume *occupancy,
+               scratch_buffer *mask,
+               vertex *vertices, GLuint *indices,
+               size_t *vertex_count, size_t *index_count);
+
+/**
+ * Converts count vertices to packed_vertex in place. Their coordinates must be
+ * integers between 0 and 65535.
+ */
+void pack_vertices(size_t count, void *vertices);
+vertex unpack_vertex(packed_vertex p);
+
+/**
+ * Converts count indices built by mesh_volume to GLushort in place, each made
+ * relative to the first vertex of its run of SquaresPerDraw squares.
  */
-int generate_geometry(noise_renderer *renderer, GLfloat *noise);
+void pack_indices(size_t count, void *indices);
+
+/**
+ * Selects the format of the buffers given to generate_geometry,
+ * NoiseOutputFloat by default. Occupancy masks must have been computed with
+ * DensityThreshold for the mesh to be the same.
+ */
+void noise_renderer_set_input(noise_renderer *renderer,
+                              noise_output_format format);
+
+/**
+ * Meshes a noise buffer of the renderer's size and input format with its
+ * mesher, uploads the result and records its size and the time taken in
+ * renderer->stats, which includes thresholding the noise into the renderer's
+ * occupancy volume. Buffers are sized for the mesh at hand and reused by later
+ * calls, growing when a mesh doesn't fit. Returns -1 if memory runs out.
+ */
+int generate_geometry(noise_renderer *renderer, const void *noise);
+
+/**
+ * Builds the same geometry as generate_geometry, in a different order, from a
+ * shader storage buffer holding the noise (e.g. perlin4d_gen's output after
+ * perlin4d_dispatch). Nothing is read back: a compute shader writes the
+ * vertices, the indices and the index count straight into the buffers used
+ * by render, which then issues an indirect draw. The greedy mesher isn't
+ * available on the GPU; it is replaced by the culled one.
+ *
+ * The mesher drops whatever doesn't fit in the buffers and records how much
+ * room it needed, which is read back on the next call to grow them, with some
+ * room to spare. That request has normally been completed by then, so this
+ * doesn't wait for the GPU except on the first call, which makes sure its own
+ * mesh fits. A mesh that outgrows the spare room loses cubes for one frame.
+ */
+void generate_geometry_gpu(noise_renderer *renderer, GLuint noise);
+
+/**
+ * Number of indices drawn by render. After generate_geometry_gpu, this reads
+ * the count back from the GPU and waits for the mesher to finish.
+ */
+size_t noise_renderer_index_count(const noise_renderer *renderer);
+
+/**
+ * Bytes currently allocated for the renderer's vertex, index, instance and
+ * indirect command buffers.
+ */
+size_t noise_renderer_gpu_bytes(const noise_renderer *renderer);
 
 void render(const noise_renderer *renderer);
 void set_mvp(noise_renderer *renderer,
              mat4 model, mat4 view, mat4 projection);
 
+/**
+ * A mesh uploaded on its own, e.g. one chunk of a larger world, and drawn with
+ * the program of a renderer using the same vertex format.
+ */
+typedef struct noise_mesh {
+  GLuint vao, vbo, ibo;
+  size_t index_count;
+  size_t vbo_size, ibo_size;
+} noise_mesh;
+
+void noise_mesh_init(noise_mesh *mesh, noise_vertex_format format);
+void noise_mesh_release(noise_mesh *mesh);
+
+/**
+ * Replaces the mesh's contents. vertices must be in the mesh's format, and
+ * indices must have been converted by pack_indices.
+ */
+void noise_mesh_upload(noise_mesh *mesh,
+                       const void *vertices, size_t vertex_bytes,
+                       const GLushort *indices, size_t index_count);
+
+/**
+ * Draws mesh with the renderer's program and the matrices given to set_mvp.
+ * Unlike render, this doesn't clear the framebuffer first.
+ */
+void render_mesh(const noise_renderer *renderer, const noise_mesh *mesh);
+
 #endif
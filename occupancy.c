@@ -0,0 +1,182 @@
+#include "occupancy.h"
+#include "noise_cpu.h"
+
+void occupancy_init(occupancy_volume *occupancy) {
+  occupancy->width  = 0;
+  occupancy->height = 0;
+  occupancy->depth  = 0;
+  occupancy->row_words = 0;
+  occupancy->words = NULL;
+  scratch_init(&occupancy->storage);
+}
+
+void occupancy_release(occupancy_volume *occupancy) {
+  scratch_release(&occupancy->storage);
+}
+
+static int resize(occupancy_volume *occupancy,
+                  size_t width, size_t height, size_t depth) {
+  size_t row_words = (width + 63)/64;
+  uint64_t *words = scratch_reserve(&occupancy->storage,
+                                    row_words*height*depth*sizeof(*words));
+  if (!words)
+    return -1;
+
+  occupancy->width  = width;
+  occupancy->height = height;
+  occupancy->depth  = depth;
+  occupancy->row_words = row_words;
+  occupancy->words = words;
+
+  return 0;
+}
+
+static uint64_t *row_at(occupancy_volume *occupancy, size_t y, size_t z) {
+  return occupancy->words + (y + z*occupancy->height)*occupancy->row_words;
+}
+
+int occupancy_from_noise(occupancy_volume *occupancy,
+                         size_t width, size_t height, size_t depth,
+                         const GLfloat *noise, GLfloat threshold) {
+  if (resize(occupancy, width, height, depth) != 0)
+    return -1;
+
+  for (size_t z = 0; z < depth; z++) {
+    for (size_t y = 0; y < height; y++) {
+      noise_cpu_threshold(noise + (y + z*height)*width, width, threshold,
+                          row_at(occupancy, y, z));
+    }
+  }
+
+  return 0;
+}
+
+/* Rounded to the nearest step, like the samples. */
+static GLuint quantize(GLfloat threshold, GLuint steps) {
+  if (threshold <= 0) return 0;
+  if (threshold >= 1) return steps;
+  return threshold*steps + 0.5f;
+}
+
+static GLuint word_at(const GLuint *src, size_t count, size_t i) {
+  return i < count ? src[i] : 0;
+}
+
+/* Copies the count bits of src starting at bit start, which holds src_count
+ * words, to dst, clearing the bits of the last word past count. */
+static void copy_bits(const GLuint *src, size_t src_count,
+                      size_t start, size_t count, uint64_t *dst) {
+  for (size_t k = 0; 64*k < count; k++) {
+    size_t bit = start + 64*k;
+    size_t i = bit / 32, shift = bit % 32;
+
+    uint64_t word = word_at(src, src_count, i) |
+      (uint64_t)word_at(src, src_count, i + 1) << 32;
+    word >>= shift;
+    if (shift != 0)
+      word |= (uint64_t)word_at(src, src_count, i + 2) << (64 - shift);
+
+    if (count - 64*k < 64)
+      word &= ((uint64_t)1 << (count - 64*k)) - 1;
+
+    dst[k] = word;
+  }
+}
+
+int occupancy_from_output(occupancy_volume *occupancy,
+                          size_t width, size_t height, size_t depth,
+                          noise_output_format format, const void *data,
+                          GLfloat threshold) {
+  if (format == NoiseOutputFloat) {
+    return occupancy_from_noise(occupancy, width, height, depth, data,
+                                threshold);
+  }
+
+  if (resize(occupancy, width, height, depth) != 0)
+    return -1;
+
+  size_t count = width*height*depth;
+  size_t src_count = noise_output_size(format, count)/sizeof(GLuint);
+  GLuint unorm16 = quantize(threshold, UINT16_MAX);
+  GLuint unorm8  = quantize(threshold, UINT8_MAX);
+
+  for (size_t z = 0; z < depth; z++) {
+    for (size_t y = 0; y < height; y++) {
+      size_t start = (y + z*height)*width;
+      uint64_t *row = row_at(occupancy, y, z);
+
+      if (format == NoiseOutputOccupancy) {
+        copy_bits(data, src_count, start, width, row);
+        continue;
+      }
+
+      for (size_t k = 0; k < occupancy->row_words; k++)
+        row[k] = 0;
+
+      for (size_t x = 0; x < width; x++) {
+        int solid = format == NoiseOutputUnorm16 ?
+          ((const GLushort *)data)[start + x] >= unorm16 :
+          ((const GLubyte *)data)[start + x] >= unorm8;
+        row[x / 64] |= (uint64_t)solid << x % 64;
+      }
+    }
+  }
+
+  return 0;
+}
+
+const uint64_t *occupancy_row(const occupancy_volume *occupancy,
+                              size_t y, size_t z) {
+  return occupancy->words + (y + z*occupancy->height)*occupancy->row_words;
+}
+
+int occupancy_get(const occupancy_volume *occupancy,
+                  size_t x, size_t y, size_t z) {
+  if (x >= occupancy->width || y >= occupancy->height ||
+      z >= occupancy->depth)
+    return 0;
+
+  return occupancy_row(occupancy, y, z)[x / 64] >> x % 64 & 1;
+}
+
+size_t occupancy_count(const occupancy_volume *occupancy) {
+  size_t words = occupancy->row_words*occupancy->height*occupancy->depth;
+
+  size_t count = 0;
+  for (size_t i = 0; i < words; i++)
+    count += __builtin_popcountll(occupancy->words[i]);
+
+  return count;
+}
+
+size_t occupancy_size(const occupancy_volume *occupancy) {
+  return occupancy->row_words*occupancy->height*occupancy->depth*
+    sizeof(*occupancy->words);
+}
+
+/* Word k of row (y, z), or 0 past the volume's edges. */
+static uint64_t neighbour_word(const occupancy_volume *occupancy,
+                               size_t y, size_t z, size_t k) {
+  if (y >= occupancy->height || z >= occupancy->depth)
+    return 0;
+
+  return occupancy_row(occupancy, y, z)[k];
+}
+
+void occupancy_faces(const occupancy_volume *occupancy,
+                     size_t y, size_t z, size_t k, uint64_t faces[6]) {
+  const uint64_t *row = occupancy_row(occupancy, y, z);
+  uint64_t solid = row[k];
+
+  /* Neighbours along x are the same word shifted by one bit, completed by
+   * the nearest bit of the previous or next word. */
+  uint64_t prev = k > 0 ? row[k - 1] : 0;
+  uint64_t next = k + 1 < occupancy->row_words ? row[k + 1] : 0;
+
+  faces[0] = solid & ~(solid << 1 | prev >> 63);
+  faces[1] = solid & ~(solid >> 1 | next << 63);
+  faces[2] = solid & ~neighbour_word(occupancy, y - 1, z, k);
+  faces[3] = solid & ~neighbour_word(occupancy, y + 1, z, k);
+  faces[4] = solid & ~neighbour_word(occupancy, y, z - 1, k);
+  faces[5] = solid & ~neighbour_word(occupancy, y, z + 1, k);
+}
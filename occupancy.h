@@ -0,0 +1,78 @@
+#ifndef OCCUPANCY_H_
+#define OCCUPANCY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <GL/glew.h>
+
+#include "noise_gen.h"
+#include "scratch.h"
+
+/**
+ * A volume holding one bit per voxel, set for voxels whose noise is at least
+ * a threshold: 32 times smaller than the noise itself. Voxel x of row (y, z)
+ * is bit x%64 of word x/64 of that row. Every row starts on a new word and
+ * its bits past width are clear, so that a row and its neighbours along y and
+ * z line up word for word, and 64 voxels can be compared with theirs at once.
+ */
+typedef struct occupancy_volume {
+  size_t width, height, depth;
+  size_t row_words; /* (width + 63)/64 */
+
+  uint64_t *words;
+  scratch_buffer storage;
+} occupancy_volume;
+
+void occupancy_init(occupancy_volume *occupancy);
+void occupancy_release(occupancy_volume *occupancy);
+
+/**
+ * Replaces the contents of occupancy with a width×height×depth volume in
+ * which voxel i of noise is set when it is at least threshold. Rows are
+ * compared with the SIMD kernels of noise_cpu.h. Storage is reused from one
+ * call to the next; returns -1 if it can't be grown.
+ */
+int occupancy_from_noise(occupancy_volume *occupancy,
+                         size_t width, size_t height, size_t depth,
+                         const GLfloat *noise, GLfloat threshold);
+
+/**
+ * Like occupancy_from_noise, for noise in any of the formats of noise_gen.h.
+ * For the unorm formats, threshold is quantized the same way as the samples,
+ * and should lie between 0 and 1. Occupancy masks are only repacked; they
+ * must have been computed with the same threshold.
+ */
+int occupancy_from_output(occupancy_volume *occupancy,
+                          size_t width, size_t height, size_t depth,
+                          noise_output_format format, const void *data,
+                          GLfloat threshold);
+
+/**
+ * The row_words words of row (y, z), which must be in range.
+ */
+const uint64_t *occupancy_row(const occupancy_volume *occupancy,
+                              size_t y, size_t z);
+
+/**
+ * Whether voxel x, y, z is set. Anything outside the volume, including
+ * coordinates that wrapped around below 0, is empty.
+ */
+int occupancy_get(const occupancy_volume *occupancy,
+                  size_t x, size_t y, size_t z);
+
+/** Number of voxels set. */
+size_t occupancy_count(const occupancy_volume *occupancy);
+
+/** Bytes taken by the volume's words. */
+size_t occupancy_size(const occupancy_volume *occupancy);
+
+/**
+ * The faces of the voxels in word k of row (y, z) that are next to empty
+ * space, counting everything outside the volume as empty: bit i of faces[f]
+ * is set when voxel 64*k + i is set and its neighbour along -x, +x, -y, +y,
+ * -z, +z (for f from 0 to 5) isn't.
+ */
+void occupancy_faces(const occupancy_volume *occupancy,
+                     size_t y, size_t z, size_t k, uint64_t faces[6]);
+
+#endif
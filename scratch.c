@@ -0,0 +1,52 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "scratch.h"
+
+static size_t allocation_count = 0;
+
+void scratch_init(scratch_buffer *scratch) {
+  scratch->data = NULL;
+  scratch->size = 0;
+}
+
+void scratch_release(scratch_buffer *scratch) {
+  free(scratch->data);
+  scratch->data = NULL;
+  scratch->size = 0;
+}
+
+void *scratch_reserve(scratch_buffer *scratch, size_t size) {
+  if (size <= scratch->size)
+    return scratch->data;
+
+  size_t new_size = scratch->size*2;
+  if (new_size < size) new_size = size;
+
+  /* The old contents don't need to be copied. */
+  void *data = malloc(new_size);
+  if (!data)
+    return NULL;
+
+  free(scratch->data);
+  scratch->data = data;
+  scratch->size = new_size;
+  allocation_count++;
+
+  return data;
+}
+
+size_t scratch_allocation_count(void) {
+  return allocation_count;
+}
+
+size_t peak_rss(void) {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+
+  /* Linux reports kilobytes. */
+  return (size_t)usage.ru_maxrss * 1024;
+}
@@ -0,0 +1,37 @@
+#ifndef SCRATCH_H_
+#define SCRATCH_H_
+
+#include <stddef.h>
+
+/**
+ * Memory reused from one call to the next, e.g. to build a mesh every frame.
+ * It only ever grows, at least doubling each time, and is freed by
+ * scratch_release.
+ */
+typedef struct scratch_buffer {
+  void *data;
+  size_t size;
+} scratch_buffer;
+
+void scratch_init(scratch_buffer *scratch);
+void scratch_release(scratch_buffer *scratch);
+
+/**
+ * Returns a block of at least size bytes, or NULL if it can't be allocated.
+ * The contents are lost when the block grows.
+ */
+void *scratch_reserve(scratch_buffer *scratch, size_t size);
+
+/**
+ * Number of times scratch buffers have been (re)allocated since the program
+ * started.
+ */
+size_t scratch_allocation_count(void);
+
+/**
+ * Largest resident set size of the process so far, in bytes, or 0 if it isn't
+ * available.
+ */
+size_t peak_rss(void);
+
+#endif
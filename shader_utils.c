@@ -1,12 +1,39 @@
-#include <string.h>
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
 
 #include "shader_utils.h"
+#include "cache.h"
+
+#define ProgramMagic   "GLNOISEP"
+#define ProgramVersion 1
+
+/* Larger files are assumed to be corrupt. */
+#define MaxProgramBinarySize (64*1024*1024)
+
+typedef struct program_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t format;  /* binaryFormat returned by glGetProgramBinary */
+  uint64_t hash;
+  uint64_t length;
+} program_header;
+
+static int cache_enabled = 1;
+static program_cache_stats stats;
 
 GLuint create_shader(GLenum mode, const char *src) {
+  return create_shader_sources(mode, 1, &src);
+}
+
+GLuint create_shader_sources(GLenum mode, size_t count, const char **srcs) {
   GLuint ret = glCreateShader(mode);
-  GLint length = strlen(src);
-  glShaderSource(ret, 1, &src, &length);
+  glShaderSource(ret, count, srcs, NULL);
   glCompileShader(ret);
 
   int status;
@@ -27,3 +54,192 @@ void check_link_errors(GLuint prog) {
   if (!status)
     fprintf(stderr, "Linking error: %s\n", error);
 }
+
+void program_cache_set_enabled(int enabled) {
+  cache_enabled = enabled;
+}
+
+int program_cache_enabled(void) {
+  return cache_enabled;
+}
+
+program_cache_stats program_cache_get_stats(void) {
+  return stats;
+}
+
+/* 64-bit FNV-1a, including the terminating null so that consecutive strings
+ * can't run into each other. */
+static uint64_t hash_string(uint64_t hash, const char *str) {
+  do {
+    hash ^= (unsigned char)*str;
+    hash *= 1099511628211ull;
+  } while (*str++);
+
+  return hash;
+}
+
+static uint64_t hash_program(size_t stage_count, const shader_stage *stages) {
+  const char *renderer = (const char *)glGetString(GL_RENDERER);
+  const char *version  = (const char *)glGetString(GL_VERSION);
+
+  uint64_t hash = 14695981039346656037ull;
+  hash = hash_string(hash, renderer ? renderer : "");
+  hash = hash_string(hash, version ? version : "");
+
+  for (size_t i = 0; i < stage_count; i++) {
+    char mode[16];
+    snprintf(mode, sizeof(mode), "%x", (unsigned)stages[i].mode);
+    hash = hash_string(hash, mode);
+
+    for (size_t j = 0; j < stages[i].count; j++)
+      hash = hash_string(hash, stages[i].srcs[j]);
+  }
+
+  return hash;
+}
+
+/* Returns 0 if prog was loaded, 1 if there is no binary for it and -1 if
+ * there is one but it couldn't be used. */
+static int load_binary(GLuint prog, const char *path, uint64_t hash) {
+  FILE *in = fopen(path, "rb");
+  if (!in)
+    goto fail_open;
+
+  program_header header;
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      memcmp(header.magic, ProgramMagic, sizeof(header.magic)) != 0 ||
+      header.version != ProgramVersion || header.hash != hash ||
+      header.length == 0 || header.length > MaxProgramBinarySize)
+    goto fail_header;
+
+  void *binary = malloc(header.length);
+  if (!binary)
+    goto fail_alloc;
+
+  if (fread(binary, 1, header.length, in) != header.length)
+    goto fail_read;
+
+  glProgramBinary(prog, header.format, binary, header.length);
+
+  GLint status;
+  glGetProgramiv(prog, GL_LINK_STATUS, &status);
+
+  free(binary);
+  fclose(in);
+
+  return status ? 0 : -1;
+
+fail_read:   free(binary);
+fail_alloc:
+fail_header: fclose(in);
+             return -1;
+fail_open:   return 1;
+}
+
+static int store_binary(GLuint prog, const char *path, uint64_t hash) {
+  GLint length;
+  glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    goto fail_length;
+
+  void *binary = malloc(length);
+  if (!binary)
+    goto fail_alloc;
+
+  GLenum format;
+  GLsizei written;
+  glGetProgramBinary(prog, length, &written, &format, binary);
+
+  program_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, ProgramMagic, sizeof(header.magic));
+  header.version = ProgramVersion;
+  header.format  = format;
+  header.hash    = hash;
+  header.length  = written;
+
+  /* Written under a temporary name, so that another instance never loads a
+   * partial file. */
+  char tmp_path[4096];
+  int n = snprintf(tmp_path, sizeof(tmp_path), "%s.%ld", path,
+                   (long)getpid());
+  if (n < 0 || (size_t)n >= sizeof(tmp_path))
+    goto fail_path;
+
+  FILE *out = fopen(tmp_path, "wb");
+  if (!out)
+    goto fail_open;
+
+  if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+      fwrite(binary, 1, written, out) != (size_t)written)
+    goto fail_write;
+
+  if (fclose(out) != 0)
+    goto fail_close;
+
+  if (rename(tmp_path, path) != 0)
+    goto fail_close;
+
+  free(binary);
+  return 0;
+
+fail_write:  fclose(out);
+fail_close:  remove(tmp_path);
+fail_open:
+fail_path:   free(binary);
+fail_alloc:
+fail_length: return -1;
+}
+
+GLuint create_program(size_t stage_count, const shader_stage *stages,
+                      void (*setup)(GLuint prog), GLuint *shaders) {
+  for (size_t i = 0; i < stage_count; i++)
+    shaders[i] = 0;
+
+  GLint formats = 0;
+  if (cache_enabled)
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+  uint64_t hash = hash_program(stage_count, stages);
+
+  char name[32], path[4096];
+  snprintf(name, sizeof(name), "program-%016" PRIx64, hash);
+  int use_cache = formats > 0 && cache_path(name, path, sizeof(path)) == 0;
+
+  GLuint prog = glCreateProgram();
+  if (use_cache) {
+    int ret = load_binary(prog, path, hash);
+    if (ret == 0) {
+      stats.loaded++;
+      return prog;
+    }
+    else if (ret < 0) {
+      /* Starts over with a program that never saw the failed binary. */
+      stats.rejected++;
+      glDeleteProgram(prog);
+      prog = glCreateProgram();
+    }
+
+    glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+
+  for (size_t i = 0; i < stage_count; i++) {
+    shaders[i] = create_shader_sources(stages[i].mode, stages[i].count,
+                                       stages[i].srcs);
+    glAttachShader(prog, shaders[i]);
+  }
+
+  if (setup) setup(prog);
+
+  glLinkProgram(prog);
+  check_link_errors(prog);
+  stats.compiled++;
+
+  /* Failing to save the binary only means compiling it again next time. */
+  GLint linked;
+  glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+  if (use_cache && linked)
+    store_binary(prog, path, hash);
+
+  return prog;
+}
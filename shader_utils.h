@@ -1,6 +1,7 @@
 #ifndef SHADER_UTILS_H_
 #define SHADER_UTILS_H_
 
+#include <stddef.h>
 #include <GL/glew.h>
 
 /**
@@ -8,9 +9,56 @@
  */
 GLuint create_shader(GLenum mode, const char *src);
 
+/**
+ * Like create_shader, but concatenates several strings, e.g. a generated
+ * header with #defines followed by the shader's body.
+ */
+GLuint create_shader_sources(GLenum mode, size_t count, const char **srcs);
+
 /**
  * This prints the program's info log if an error occured.
  */
 void check_link_errors(GLuint prog);
 
+/**
+ * One stage of a program, compiled from the concatenation of srcs.
+ */
+typedef struct shader_stage {
+  GLenum mode;
+  size_t count;
+  const char **srcs;
+} shader_stage;
+
+/**
+ * Links a program made of the given stages. setup, if not NULL, is called
+ * right before linking, e.g. to bind attribute locations; it must do the same
+ * thing every time it is called with the same stages.
+ *
+ * The linked program is saved in the cache directory (see cache_path), under
+ * a hash of the sources, GL_RENDERER and GL_VERSION, and loaded from there
+ * with glProgramBinary on later calls instead of being compiled again. If
+ * the driver rejects the binary, e.g. after an update that didn't change its
+ * version string, the program is compiled and the file replaced.
+ *
+ * shaders receives the shader object of each stage, all 0 when the program
+ * was loaded from a binary. They can be passed to glDeleteShader either way.
+ */
+GLuint create_program(size_t stage_count, const shader_stage *stages,
+                      void (*setup)(GLuint prog), GLuint *shaders);
+
+/**
+ * Turns the program binary cache on (the default) or off. While it is off,
+ * create_program compiles every program and saves nothing.
+ */
+void program_cache_set_enabled(int enabled);
+int program_cache_enabled(void);
+
+typedef struct program_cache_stats {
+  size_t loaded;   /* programs loaded from a binary */
+  size_t compiled; /* programs compiled from source */
+  size_t rejected; /* saved binaries that couldn't be used */
+} program_cache_stats;
+
+program_cache_stats program_cache_get_stats(void);
+
 #endif
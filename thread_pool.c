@@ -0,0 +1,192 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+
+typedef struct worker_arg {
+  thread_pool *pool;
+  size_t id;
+} worker_arg;
+
+static void *worker_main(void *arg);
+static void work(thread_pool *pool, size_t id);
+
+size_t thread_pool_default_size(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (size_t)n : 1;
+}
+
+int thread_pool_init(thread_pool *pool, size_t thread_count) {
+  if (thread_count == 0)
+    thread_count = thread_pool_default_size();
+
+  pool->thread_count = thread_count;
+  pool->generation   = 0;
+  pool->running      = 0;
+  pool->quit         = 0;
+
+  pool->queues = malloc(sizeof(*pool->queues)*thread_count);
+  if (!pool->queues)
+    goto fail_alloc_queues;
+
+  pool->threads = malloc(sizeof(*pool->threads)*thread_count);
+  if (!pool->threads)
+    goto fail_alloc_threads;
+
+  for (size_t i = 0; i < thread_count; i++) {
+    pthread_mutex_init(&pool->queues[i].lock, NULL);
+    pool->queues[i].begin = pool->queues[i].end = 0;
+  }
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  /* Thread 0 is whoever calls thread_pool_run. */
+  size_t started = 1;
+  for (; started < thread_count; started++) {
+    worker_arg *arg = malloc(sizeof(*arg));
+    if (!arg) break;
+
+    arg->pool = pool;
+    arg->id   = started;
+    if (pthread_create(&pool->threads[started], NULL, worker_main, arg)) {
+      free(arg);
+      break;
+    }
+  }
+
+  if (started != thread_count) {
+    pool->thread_count = started;
+    thread_pool_release(pool);
+    return -1;
+  }
+
+  return 0;
+
+fail_alloc_threads: free(pool->queues);
+fail_alloc_queues:  return -1;
+}
+
+void thread_pool_release(thread_pool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = 1;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (size_t i = 1; i < pool->thread_count; i++)
+    pthread_join(pool->threads[i], NULL);
+
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->start);
+  pthread_mutex_destroy(&pool->lock);
+
+  for (size_t i = 0; i < pool->thread_count; i++)
+    pthread_mutex_destroy(&pool->queues[i].lock);
+
+  free(pool->threads);
+  free(pool->queues);
+}
+
+void thread_pool_run(thread_pool *pool, size_t task_count,
+                     thread_pool_fn fn, void *data) {
+  size_t n = pool->thread_count;
+
+  /* Each thread starts with a contiguous slice, which keeps neighbouring
+   * tasks on the same core unless the load is unbalanced. */
+  for (size_t i = 0; i < n; i++) {
+    pool->queues[i].begin = task_count*i/n;
+    pool->queues[i].end   = task_count*(i+1)/n;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->fn      = fn;
+  pool->data    = data;
+  pool->running = n;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  work(pool, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->running != 0)
+    pthread_cond_wait(&pool->done, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void *worker_main(void *data) {
+  worker_arg *arg = data;
+  thread_pool *pool = arg->pool;
+  size_t id = arg->id;
+  free(arg);
+
+  size_t generation = 0;
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->quit && pool->generation == generation)
+      pthread_cond_wait(&pool->start, &pool->lock);
+    generation = pool->generation;
+    int quit = pool->quit;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (quit) break;
+
+    work(pool, id);
+  }
+
+  return NULL;
+}
+
+static int pop(thread_pool_queue *queue, size_t *task) {
+  int ret = 0;
+
+  pthread_mutex_lock(&queue->lock);
+  if (queue->begin < queue->end) {
+    *task = queue->begin++;
+    ret = 1;
+  }
+  pthread_mutex_unlock(&queue->lock);
+
+  return ret;
+}
+
+/* Moves the back half of a victim's range into our own queue. */
+static int steal(thread_pool *pool, size_t id) {
+  for (size_t i = 1; i < pool->thread_count; i++) {
+    thread_pool_queue *victim = &pool->queues[(id + i) % pool->thread_count];
+
+    pthread_mutex_lock(&victim->lock);
+    size_t left = victim->end - victim->begin;
+    size_t begin = victim->end - left/2, end = victim->end;
+    if (left == 1) begin = victim->begin;
+    victim->end = begin;
+    pthread_mutex_unlock(&victim->lock);
+
+    if (begin != end) {
+      thread_pool_queue *own = &pool->queues[id];
+      pthread_mutex_lock(&own->lock);
+      own->begin = begin;
+      own->end   = end;
+      pthread_mutex_unlock(&own->lock);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static void work(thread_pool *pool, size_t id) {
+  size_t task;
+  do {
+    while (pop(&pool->queues[id], &task))
+      pool->fn(pool->data, task);
+  } while (steal(pool, id));
+
+  pthread_mutex_lock(&pool->lock);
+  if (--pool->running == 0)
+    pthread_cond_signal(&pool->done);
+  pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <stddef.h>
+#include <pthread.h>
+
+typedef void (*thread_pool_fn)(void *data, size_t index);
+
+/**
+ * Range of task indices owned by one thread. The owner takes tasks from the
+ * front; idle threads steal the back half.
+ */
+typedef struct thread_pool_queue {
+  pthread_mutex_t lock;
+  size_t begin, end;
+} thread_pool_queue;
+
+/**
+ * A fixed set of threads running parallel loops. The thread calling
+ * thread_pool_run takes part in the work, so a pool of size 1 has no extra
+ * threads.
+ */
+typedef struct thread_pool {
+  size_t thread_count;
+  pthread_t *threads;
+  thread_pool_queue *queues;
+
+  pthread_mutex_t lock;
+  pthread_cond_t start, done;
+  size_t generation;
+  size_t running;
+  int quit;
+
+  thread_pool_fn fn;
+  void *data;
+} thread_pool;
+
+/**
+ * Number of processors currently online, or 1 if it can't be determined.
+ */
+size_t thread_pool_default_size(void);
+
+/**
+ * Creates thread_count-1 worker threads. If thread_count is 0, uses
+ * thread_pool_default_size(). Returns 0 on success.
+ */
+int thread_pool_init(thread_pool *pool, size_t thread_count);
+void thread_pool_release(thread_pool *pool);
+
+/**
+ * Calls fn(data, i) for every i in [0, task_count) and returns once all calls
+ * have completed. The order and the thread each call runs on are unspecified.
+ */
+void thread_pool_run(thread_pool *pool, size_t task_count,
+                     thread_pool_fn fn, void *data);
+
+#endif
@@ -0,0 +1,20 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <time.h>
+
+#include "timer.h"
+
+double timer_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void timer_sleep(double seconds) {
+  if (seconds <= 0) return;
+
+  struct timespec ts;
+  ts.tv_sec  = (time_t)seconds;
+  ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1e9);
+  while (nanosleep(&ts, &ts) != 0);
+}
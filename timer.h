@@ -0,0 +1,13 @@
+#ifndef TIMER_H_
+#define TIMER_H_
+
+/**
+ * Returns the time in seconds according to a monotonic clock. Only the
+ * difference between two calls is meaningful.
+ */
+double timer_now(void);
+
+/** Blocks the calling thread for about the given number of seconds. */
+void timer_sleep(double seconds);
+
+#endif
@@ -86,6 +86,15 @@ mat4 mat4_mul(mat4 a, mat4 b) {
   return out;
 }
 
+mat4 mat4_translation(vec3 offset) {
+  return (mat4){
+    {1, 0, 0, offset.x,
+     0, 1, 0, offset.y,
+     0, 0, 1, offset.z,
+     0, 0, 0, 1}
+  };
+}
+
 mat3 mat4_upper_left_33(mat4 m) {
   mat3 ret;
   memcpy(&mat3_at(ret, 0, 0), &mat4_at(m, 0, 0), 3*sizeof(GLfloat));
@@ -48,6 +48,8 @@ typedef struct mat4 {
 
 mat4 mat4_mul(mat4 a, mat4 b);
 
+mat4 mat4_translation(vec3 offset);
+
 mat3 mat4_upper_left_33(mat4 m);
 
 mat4 mat4_look_at(vec3 eye, vec3 center, vec3 up);
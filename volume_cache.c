@@ -0,0 +1,225 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "volume_cache.h"
+#include "cache.h"
+
+#define VolumeMagic     "GLNOISEV"
+#define VolumeVersion   1
+#define VolumeByteOrder 0x01020304
+
+/* Samples encoded at once when writing a quantized payload. */
+#define EncodeBatch 4096
+
+typedef struct volume_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order; /* rejects files written with another endianness */
+
+  volume_key key;
+
+  uint32_t format;
+  float min, max;      /* range of VolumeUnorm16 samples */
+  uint32_t padding;
+
+  uint64_t payload_offset, payload_size;
+} volume_header;
+
+void volume_key_init(volume_key *key, noise_kind kind, uint64_t seed,
+                     size_t width, size_t height, size_t depth,
+                     size_t octave_count, vec4 start, vec4 scale,
+                     GLfloat slice) {
+  /* Keys are compared and hashed as bytes. */
+  memset(key, 0, sizeof(*key));
+
+  key->kind = kind;
+  key->octave_count = octave_count;
+  key->seed = seed;
+  key->hash_mode = noise_current_hash_mode();
+
+  GLint permutations[PermutationTableSize];
+  make_permutation_table(permutations, PermutationTableSize, seed);
+  for (size_t i = 0; i < PermutationTableSize; i++)
+    key->permutations[i] = permutations[i];
+
+  key->start[0] = start.x; key->start[1] = start.y;
+  key->start[2] = start.z; key->start[3] = start.w;
+  key->scale[0] = scale.x; key->scale[1] = scale.y;
+  key->scale[2] = scale.z; key->scale[3] = scale.w;
+  key->slice = slice;
+
+  key->width  = width;
+  key->height = height;
+  key->depth  = depth;
+}
+
+/* 64-bit FNV-1a. */
+static uint64_t hash_key(const volume_key *key) {
+  const unsigned char *bytes = (const unsigned char *)key;
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < sizeof(*key); i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+
+  return hash;
+}
+
+int volume_cache_path(const volume_key *key, char *path, size_t size) {
+  char name[32];
+  snprintf(name, sizeof(name), "volume-%016" PRIx64, hash_key(key));
+  return cache_path(name, path, size);
+}
+
+static size_t sample_size(volume_format format) {
+  return format == VolumeUnorm16 ? sizeof(uint16_t) : sizeof(GLfloat);
+}
+
+int volume_file_open(volume_file *file, const char *path,
+                     const volume_key *key) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    goto fail_open;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(volume_header))
+    goto fail_stat;
+
+  file->map_size = st.st_size;
+  file->map = mmap(NULL, file->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (file->map == MAP_FAILED)
+    goto fail_map;
+
+  /* The mapping stays valid once the descriptor is closed. */
+  close(fd);
+
+  const volume_header *header = file->map;
+  if (memcmp(header->magic, VolumeMagic, sizeof(header->magic)) != 0 ||
+      header->version != VolumeVersion ||
+      header->byte_order != VolumeByteOrder ||
+      memcmp(&header->key, key, sizeof(*key)) != 0 ||
+      (header->format != VolumeFloat && header->format != VolumeUnorm16))
+    goto fail_header;
+
+  size_t count = key->width*key->height*key->depth;
+  if (header->payload_offset % VolumeAlignment != 0 ||
+      header->payload_size != count*sample_size(header->format) ||
+      header->payload_offset + header->payload_size > file->map_size)
+    goto fail_header;
+
+  file->format = header->format;
+  file->width  = key->width;
+  file->height = key->height;
+  file->depth  = key->depth;
+  file->noise  = file->format == VolumeFloat ?
+    (const GLfloat *)((const char *)file->map + header->payload_offset) :
+    NULL;
+
+  return 0;
+
+fail_header: munmap(file->map, file->map_size);
+             return -1;
+fail_map:
+fail_stat:   close(fd);
+fail_open:   return -1;
+}
+
+void volume_file_close(volume_file *file) {
+  munmap(file->map, file->map_size);
+}
+
+void volume_file_read(const volume_file *file, GLfloat *noise) {
+  const volume_header *header = file->map;
+  const char *payload = (const char *)file->map + header->payload_offset;
+  size_t count = file->width*file->height*file->depth;
+
+  if (file->format == VolumeFloat) {
+    memcpy(noise, payload, count*sizeof(*noise));
+    return;
+  }
+
+  const uint16_t *samples = (const uint16_t *)payload;
+  float step = (header->max - header->min) / UINT16_MAX;
+  for (size_t i = 0; i < count; i++)
+    noise[i] = header->min + samples[i]*step;
+}
+
+static int write_payload(FILE *out, volume_format format, const GLfloat *noise,
+                         size_t count, float min, float max) {
+  if (format == VolumeFloat)
+    return fwrite(noise, sizeof(*noise), count, out) == count ? 0 : -1;
+
+  float factor = max > min ? UINT16_MAX / (max - min) : 0;
+
+  uint16_t batch[EncodeBatch];
+  for (size_t i = 0; i < count; i += EncodeBatch) {
+    size_t n = count - i < EncodeBatch ? count - i : EncodeBatch;
+    for (size_t j = 0; j < n; j++)
+      batch[j] = lrintf((noise[i + j] - min)*factor);
+
+    if (fwrite(batch, sizeof(*batch), n, out) != n)
+      return -1;
+  }
+
+  return 0;
+}
+
+int volume_file_write(const char *path, const volume_key *key,
+                      volume_format format, const GLfloat *noise) {
+  size_t count = key->width*key->height*key->depth;
+
+  volume_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, VolumeMagic, sizeof(header.magic));
+  header.version    = VolumeVersion;
+  header.byte_order = VolumeByteOrder;
+  header.key        = *key;
+  header.format     = format;
+
+  header.min = header.max = count > 0 ? noise[0] : 0;
+  for (size_t i = 1; format == VolumeUnorm16 && i < count; i++) {
+    if (noise[i] < header.min) header.min = noise[i];
+    if (noise[i] > header.max) header.max = noise[i];
+  }
+
+  header.payload_offset = VolumeAlignment;
+  header.payload_size   = count*sample_size(format);
+
+  char tmp_path[4096];
+  int n = snprintf(tmp_path, sizeof(tmp_path), "%s.%ld", path,
+                   (long)getpid());
+  if (n < 0 || (size_t)n >= sizeof(tmp_path))
+    goto fail_path;
+
+  FILE *out = fopen(tmp_path, "wb");
+  if (!out)
+    goto fail_open;
+
+  static const char zeros[VolumeAlignment - sizeof(volume_header)];
+  if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+      fwrite(zeros, sizeof(zeros), 1, out) != 1 ||
+      write_payload(out, format, noise, count, header.min, header.max) != 0)
+    goto fail_write;
+
+  if (fclose(out) != 0)
+    goto fail_close;
+
+  if (rename(tmp_path, path) != 0)
+    goto fail_close;
+
+  return 0;
+
+fail_write: fclose(out);
+fail_close: remove(tmp_path);
+fail_open:
+fail_path:  return -1;
+}
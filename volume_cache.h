@@ -0,0 +1,88 @@
+#ifndef VOLUME_CACHE_H_
+#define VOLUME_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <GL/glew.h>
+
+#include "noise_gen.h"
+#include "vector_math.h"
+
+/* Payloads start on a page boundary, so that a mapped float payload is
+ * suitably aligned for any use, including a GL upload straight from the
+ * mapping. */
+#define VolumeAlignment 4096
+
+typedef enum volume_format {
+  VolumeFloat,   /* GLfloat per sample, used in place */
+  VolumeUnorm16, /* uint16_t per sample over [min, max], decoded on read */
+} volume_format;
+
+/**
+ * Everything that determines a generated volume: the parameters passed to
+ * perlin3d, simplex3d or perlin4d_init (and the slice, for the latter),
+ * including the seed, the permutation table derived from it and the hash mode.
+ * 3D generators leave the w components at 0.
+ */
+typedef struct volume_key {
+  uint32_t kind;  /* noise_kind */
+  uint32_t octave_count;
+  uint64_t seed;
+  int32_t permutations[PermutationTableSize];
+  float start[4], scale[4];
+  float slice;
+  uint32_t hash_mode; /* noise_hash_mode */
+  uint64_t width, height, depth;
+} volume_key;
+
+/**
+ * Fills key for a volume generated with the given parameters.
+ */
+void volume_key_init(volume_key *key, noise_kind kind, uint64_t seed,
+                     size_t width, size_t height, size_t depth,
+                     size_t octave_count, vec4 start, vec4 scale,
+                     GLfloat slice);
+
+/**
+ * Writes the path of the cache file for key to path, as cache_path does.
+ * Returns 0 on success.
+ */
+int volume_cache_path(const volume_key *key, char *path, size_t size);
+
+/**
+ * A volume file mapped in memory. For VolumeFloat, noise points straight into
+ * the mapping and can be passed to generate_geometry or glBufferData without
+ * copying it; it is NULL otherwise.
+ */
+typedef struct volume_file {
+  void *map;
+  size_t map_size;
+
+  volume_format format;
+  size_t width, height, depth;
+  const GLfloat *noise;
+} volume_file;
+
+/**
+ * Maps the file at path. Returns -1 if it can't be read or wasn't written for
+ * exactly key, e.g. by a version that derived tables differently.
+ */
+int volume_file_open(volume_file *file, const char *path,
+                     const volume_key *key);
+void volume_file_close(volume_file *file);
+
+/**
+ * Copies the samples to noise, decoding them if they are quantized. noise
+ * needs room for width×height×depth floats.
+ */
+void volume_file_read(const volume_file *file, GLfloat *noise);
+
+/**
+ * Saves a width×height×depth volume generated for key in the given format.
+ * The file is written under a temporary name and then renamed, so that
+ * readers never see it partially written. Returns 0 on success.
+ */
+int volume_file_write(const char *path, const volume_key *key,
+                      volume_format format, const GLfloat *noise);
+
+#endif
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "workgroup_tuner.h"
+#include "cache.h"
+
+const workgroup_size workgroup_candidates[] = {
+  {64, 1, 1},
+  {32, 2, 1},
+  {16, 4, 1},
+  { 8, 8, 1},
+  {16, 16, 1},
+  { 8, 4, 2},
+  { 4, 4, 4},
+  { 8, 8, 4},
+};
+
+const size_t workgroup_candidate_count =
+  sizeof(workgroup_candidates)/sizeof(*workgroup_candidates);
+
+#define MaxShaderName  32
+#define MaxDriverName  256
+#define MaxEntryCount  64
+
+#define WorkgroupFile "workgroups"
+
+typedef struct entry {
+  char shader[MaxShaderName];
+  char driver[MaxDriverName];
+  workgroup_size size;
+} entry;
+
+static entry entries[MaxEntryCount];
+static size_t entry_count = 0;
+static int loaded = 0;
+
+static void current_driver(char *driver, size_t size);
+static void load(void);
+static void save(void);
+
+int workgroup_lookup(const char *shader, workgroup_size *size) {
+  char driver[MaxDriverName];
+  current_driver(driver, sizeof(driver));
+
+  load();
+
+  for (size_t i = 0; i < entry_count; i++) {
+    if (strcmp(entries[i].shader, shader) == 0 &&
+        strcmp(entries[i].driver, driver) == 0) {
+      *size = entries[i].size;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+void workgroup_remember(const char *shader, workgroup_size size) {
+  char driver[MaxDriverName];
+  current_driver(driver, sizeof(driver));
+
+  load();
+
+  entry *e = NULL;
+  for (size_t i = 0; i < entry_count && !e; i++) {
+    if (strcmp(entries[i].shader, shader) == 0 &&
+        strcmp(entries[i].driver, driver) == 0)
+      e = &entries[i];
+  }
+
+  if (!e) {
+    /* Forget the oldest entry when full. */
+    if (entry_count == MaxEntryCount) {
+      memmove(entries, entries + 1, sizeof(*entries)*(MaxEntryCount - 1));
+      entry_count--;
+    }
+
+    e = &entries[entry_count++];
+    snprintf(e->shader, sizeof(e->shader), "%s", shader);
+    snprintf(e->driver, sizeof(e->driver), "%s", driver);
+  }
+
+  e->size = size;
+  save();
+}
+
+static void current_driver(char *driver, size_t size) {
+  const char *vendor   = (const char*)glGetString(GL_VENDOR);
+  const char *renderer = (const char*)glGetString(GL_RENDERER);
+  const char *version  = (const char*)glGetString(GL_VERSION);
+
+  snprintf(driver, size, "%s / %s / %s",
+           vendor ? vendor : "?", renderer ? renderer : "?",
+           version ? version : "?");
+
+  /* Tabs and newlines separate fields in the file. */
+  for (char *c = driver; *c; c++) {
+    if (*c == '\t' || *c == '\n') *c = ' ';
+  }
+}
+
+/* One entry per line: shader, shape and driver, separated by tabs. */
+static void load(void) {
+  if (loaded) return;
+  loaded = 1;
+
+  char path[1024];
+  if (cache_path(WorkgroupFile, path, sizeof(path)) != 0)
+    return;
+
+  FILE *file = fopen(path, "r");
+  if (!file) return;
+
+  char line[MaxShaderName + MaxDriverName + 64];
+  while (entry_count < MaxEntryCount && fgets(line, sizeof(line), file)) {
+    entry *e = &entries[entry_count];
+
+    char *shader = strtok(line, "\t");
+    char *shape  = strtok(NULL, "\t");
+    char *driver = strtok(NULL, "\n");
+    if (!shader || !shape || !driver) continue;
+
+    if (sscanf(shape, "%ux%ux%u", &e->size.x, &e->size.y, &e->size.z) != 3)
+      continue;
+
+    snprintf(e->shader, sizeof(e->shader), "%s", shader);
+    snprintf(e->driver, sizeof(e->driver), "%s", driver);
+    entry_count++;
+  }
+
+  fclose(file);
+}
+
+static void save(void) {
+  char path[1024];
+  if (cache_path(WorkgroupFile, path, sizeof(path)) != 0)
+    return;
+
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    fprintf(stderr, "Could not save workgroup sizes to %s.\n", path);
+    return;
+  }
+
+  for (size_t i = 0; i < entry_count; i++) {
+    fprintf(file, "%s\t%ux%ux%u\t%s\n", entries[i].shader,
+            entries[i].size.x, entries[i].size.y, entries[i].size.z,
+            entries[i].driver);
+  }
+
+  fclose(file);
+}
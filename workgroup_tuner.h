@@ -0,0 +1,31 @@
+#ifndef WORKGROUP_TUNER_H_
+#define WORKGROUP_TUNER_H_
+
+#include <stddef.h>
+#include <GL/glew.h>
+
+typedef struct workgroup_size {
+  GLuint x, y, z;
+} workgroup_size;
+
+/**
+ * Shapes tried by the autotuner, from flat rows to cubes.
+ */
+extern const workgroup_size workgroup_candidates[];
+extern const size_t workgroup_candidate_count;
+
+/**
+ * Used when no candidate could be compiled.
+ */
+#define DefaultWorkgroupSize (workgroup_size){8, 8, 1}
+
+/**
+ * Looks up the fastest shape found for a shader on the current driver, as
+ * identified by GL_VENDOR, GL_RENDERER and GL_VERSION. Results are kept in
+ * memory and in the workgroups file of the cache directory. Returns 1 if a
+ * shape is known.
+ */
+int workgroup_lookup(const char *shader, workgroup_size *size);
+void workgroup_remember(const char *shader, workgroup_size size);
+
+#endif